@@ -25,3 +25,5 @@ import buildRewriter from './src/harness/node-rewriter.js';
 export {buildRewriter};
 
 export * from './src/harness/common.js';
+
+export {buildStream, readStream} from './src/harness/stream.js';
@@ -0,0 +1,380 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Parses many files across a pool of threads. Each thread has its own deque of files, which it
+// takes from the bottom of, and once that's empty it steals from the top of the others. Usage:
+//
+//   ./_batch [-j threads] [-l] <file or directory>...
+//
+// Directories are walked for .js, .mjs and .cjs files. Results are printed in input order once
+// all files are done, with timing on stderr. With -l, each file's result is instead one line of
+// JSON, with its imports decoded:
+//
+//   {"path":"a.js","tokens":12,"statements":3,"imports":["./b.js"]}
+//   {"path":"c.js","error":-1,"line":4,"imports":[]}
+
+#include "../core/token.h"
+#include "../core/parser.h"
+#include "../core/unescape.h"
+#include "map.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+
+typedef struct {
+  const char *path;
+  int len;
+  int ret;         // zero or ERROR__...
+  int line_no;     // of error
+  int statements;
+  int tokens;
+  int imports_count;
+  int imports_cap;
+  char **imports;  // raw specifier strings, including quotes
+} batch_file;
+
+#define DEQUE_EMPTY  -1
+#define DEQUE_RETRY  -2  // lost a race with another thief or the owner
+
+// Chase-Lev deque of file indexes (as per Lê et al., "Correct and Efficient Work-Stealing for Weak
+// Memory Models"). Only the owner pushes and takes, at the bottom, and any thread steals from the
+// top. Every file is pushed before the workers start, so it never needs to grow.
+typedef struct {
+  _Atomic long top;
+  char pad[64 - sizeof(long)];  // keep thieves off the owner's cache line
+  _Atomic long bottom;
+  int *buf;
+  long cap;
+} batch_deque;
+
+static batch_file *files;
+static int files_count;
+static int files_cap;
+
+static batch_deque *deques;
+static int deques_count;
+
+void blep_parser_callback(parserdef *pd) {
+  batch_file *f = pd->arg;
+  struct token *t = blep_parser_cursor(pd);
+  ++f->tokens;
+
+  if (!(t->type == TOKEN_STRING && t->special == SPECIAL__EXTERNAL)) {
+    return;
+  }
+  if (f->imports_count == f->imports_cap) {
+    f->imports_cap = f->imports_cap ? f->imports_cap * 2 : 8;
+    f->imports = realloc(f->imports, sizeof(char *) * f->imports_cap);
+  }
+  f->imports[f->imports_count++] = strndup(t->p, t->len);
+}
+
+int blep_parser_open(parserdef *pd, int type) {
+  return 0;
+}
+
+void blep_parser_close(parserdef *pd, int type) {
+  // ignore
+}
+
+static void parse_file(batch_file *f) {
+  mapped_file m;
+  if (map_file(f->path, &m) < 0) {
+    f->ret = ERROR__INTERNAL;
+    return;
+  }
+  f->len = m.len;
+
+  parserdef pd;
+  pd.arg = f;
+
+  int ret = blep_parser_init(&pd, m.buf, m.len);
+  if (ret >= 0) {
+    do {
+      ret = blep_parser_run(&pd);
+      ++f->statements;
+    } while (ret > 0);
+  }
+
+  f->ret = ret;
+  if (ret) {
+    f->line_no = blep_parser_cursor(&pd)->line_no;
+  }
+  unmap_file(&m);
+}
+
+static void deque_push(batch_deque *q, int index) {
+  long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+  q->buf[b % q->cap] = index;
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+static int deque_take(batch_deque *q) {
+  long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+
+  int index = DEQUE_EMPTY;
+  if (t <= b) {
+    index = q->buf[b % q->cap];
+    if (t != b) {
+      return index;
+    }
+    // the last one, so race any thieves for it
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst,
+        memory_order_relaxed)) {
+      index = DEQUE_EMPTY;
+    }
+  }
+  atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+  return index;
+}
+
+static int deque_steal(batch_deque *q) {
+  long t = atomic_load_explicit(&q->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+  if (t >= b) {
+    return DEQUE_EMPTY;
+  }
+  int index = q->buf[t % q->cap];
+  if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst,
+      memory_order_relaxed)) {
+    return DEQUE_RETRY;
+  }
+  return index;
+}
+
+// claims the next file from our own deque, else steals from another. returns -1 when done: no
+// files are added once workers start, so this is once every deque is seen empty.
+static int claim_file(int self) {
+  int index = deque_take(&deques[self]);
+  while (index < 0) {
+    int retry = 0;
+    for (int i = 1; i < deques_count; ++i) {
+      index = deque_steal(&deques[(self + i) % deques_count]);
+      if (index >= 0) {
+        return index;
+      }
+      retry |= (index == DEQUE_RETRY);
+    }
+    if (!retry) {
+      return -1;
+    }
+  }
+  return index;
+}
+
+static void *worker(void *arg) {
+  int self = (int) (long) arg;
+  int index;
+  while ((index = claim_file(self)) >= 0) {
+    parse_file(&files[index]);
+  }
+  return NULL;
+}
+
+// prints p as a JSON string, assuming it's UTF-8
+static void print_json_string(const char *p, int len) {
+  putchar('"');
+  for (int i = 0; i < len; ++i) {
+    unsigned char c = p[i];
+    if (c == '"' || c == '\\') {
+      putchar('\\');
+      putchar(c);
+    } else if (c < 0x20) {
+      printf("\\u%04x", c);
+    } else {
+      putchar(c);
+    }
+  }
+  putchar('"');
+}
+
+static void print_json(batch_file *f) {
+  printf("{\"path\":");
+  print_json_string(f->path, strlen(f->path));
+  if (f->ret) {
+    printf(",\"error\":%d,\"line\":%d", f->ret, f->line_no);
+  } else {
+    printf(",\"tokens\":%d,\"statements\":%d", f->tokens, f->statements);
+  }
+
+  printf(",\"imports\":[");
+  for (int j = 0; j < f->imports_count; ++j) {
+    char *raw = f->imports[j];
+    int len = strlen(raw);
+    char *value = malloc(len + 1);
+    int out = blep_unescape(raw, len, value);
+    if (j) {
+      putchar(',');
+    }
+    if (out == UNESCAPE__RAW) {
+      print_json_string(raw + 1, len - 2);
+    } else if (out >= 0) {
+      print_json_string(value, out);
+    } else {
+      printf("null");  // can't be held in UTF-8, or invalid
+    }
+    free(value);
+  }
+  printf("]}\n");
+}
+
+static void add_file(const char *path) {
+  if (files_count == files_cap) {
+    files_cap = files_cap ? files_cap * 2 : 256;
+    files = realloc(files, sizeof(batch_file) * files_cap);
+  }
+  batch_file *f = &files[files_count++];
+  bzero(f, sizeof(batch_file));
+  f->path = path;
+}
+
+static int is_js_name(const char *name) {
+  const char *dot = strrchr(name, '.');
+  return dot && (!strcmp(dot, ".js") || !strcmp(dot, ".mjs") || !strcmp(dot, ".cjs"));
+}
+
+// adds a file, or walks a directory for JS files. returns nonzero if path couldn't be read.
+static int add_path(char *path, int explicit) {
+  struct stat st;
+  if (stat(path, &st)) {
+    return 1;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    if (explicit || (S_ISREG(st.st_mode) && is_js_name(path))) {
+      add_file(path);
+    } else {
+      free(path);
+    }
+    return 0;
+  }
+
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return 1;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    if (ent->d_name[0] == '.' && (!ent->d_name[1] || (ent->d_name[1] == '.' && !ent->d_name[2]))) {
+      continue;
+    }
+    int len = strlen(path) + strlen(ent->d_name) + 2;
+    char *child = malloc(len);
+    snprintf(child, len, "%s/%s", path, ent->d_name);
+    add_path(child, 0);
+  }
+  closedir(dir);
+  free(path);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int json = 0;
+  int i = 1;
+
+  for (;;) {
+    if (i + 1 < argc && !strcmp(argv[i], "-j")) {
+      threads = atoi(argv[i + 1]);
+      i += 2;
+    } else if (i < argc && !strcmp(argv[i], "-l")) {
+      json = 1;
+      ++i;
+    } else {
+      break;
+    }
+  }
+  if (i == argc || threads <= 0) {
+    fprintf(stderr, "usage: %s [-j threads] [-l] <file or directory>...\n", argv[0]);
+    return 1;
+  }
+
+  for (; i < argc; ++i) {
+    if (add_path(strdup(argv[i]), 1)) {
+      fprintf(stderr, "could not read: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // split files into contiguous runs, one per thread, pushed in reverse so each owner takes its
+  // run in order and thieves take from its end
+  if (threads > files_count) {
+    threads = files_count ? files_count : 1;
+  }
+  deques_count = threads;
+  deques = calloc(threads, sizeof(batch_deque));
+  for (i = 0; i < threads; ++i) {
+    int lo = (long) files_count * i / threads;
+    int hi = (long) files_count * (i + 1) / threads;
+    batch_deque *q = &deques[i];
+    q->cap = hi - lo ? hi - lo : 1;
+    q->buf = malloc(sizeof(int) * q->cap);
+    while (hi > lo) {
+      deque_push(q, --hi);
+    }
+  }
+
+  pthread_t *pool = calloc(threads, sizeof(pthread_t));
+  for (i = 0; i < threads; ++i) {
+    pthread_create(&pool[i], NULL, worker, (void *) (long) i);
+  }
+  for (i = 0; i < threads; ++i) {
+    pthread_join(pool[i], NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  int errors = 0;
+  long bytes = 0;
+  for (i = 0; i < files_count; ++i) {
+    batch_file *f = &files[i];
+    bytes += f->len;
+
+    if (json) {
+      errors += (f->ret != 0);
+      print_json(f);
+      continue;
+    } else if (f->ret) {
+      ++errors;
+      printf("%s: error=%d line=%d\n", f->path, f->ret, f->line_no);
+    } else {
+      printf("%s: tokens=%d statements=%d imports=%d\n", f->path, f->tokens, f->statements, f->imports_count);
+    }
+    for (int j = 0; j < f->imports_count; ++j) {
+      printf("  %s\n", f->imports[j]);
+    }
+  }
+
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "%d files (%d errors), %.2fMB in %.3fs on %d threads, %.1fMB/s\n",
+      files_count, errors, bytes / 1e6, secs, threads, secs ? bytes / 1e6 / secs : 0);
+  return errors ? 2 : 0;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+set -eu
+clang -O2 -DSPEED -pthread batch.c map.c ../core/*.c $@ -o _batch
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include "map.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int map_file(const char *path, mapped_file *out) {
+  out->buf = NULL;
+  out->len = 0;
+  out->mapped = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size > 0x7fffffff) {
+    close(fd);
+    return -1;
+  }
+  int len = st.st_size;
+  long page = sysconf(_SC_PAGESIZE);
+
+  if (len && len % page) {
+    void *p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      close(fd);
+      out->buf = p;
+      out->len = len;
+      out->mapped = 1;
+      return len;
+    }
+  }
+
+  char *buf = malloc(len + 1);
+  int pos = 0;
+  while (buf && pos < len) {
+    ssize_t r = pread(fd, buf + pos, len - pos, pos);
+    if (r <= 0) {
+      free(buf);
+      buf = NULL;
+      break;
+    }
+    pos += r;
+  }
+  close(fd);
+  if (!buf) {
+    return -1;
+  }
+
+  buf[len] = 0;
+  out->buf = buf;
+  out->len = len;
+  return len;
+}
+
+void unmap_file(mapped_file *f) {
+  if (f->mapped) {
+    munmap(f->buf, f->len);
+  } else {
+    free(f->buf);
+  }
+  f->buf = NULL;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#ifndef __BLEP_MAP_H
+#define __BLEP_MAP_H
+
+typedef struct {
+  char *buf;
+  int len;
+  int mapped;  // if zero, buf came from malloc
+} mapped_file;
+
+// maps the file at path read-only into out. The parser needs a trailing NUL: if the file doesn't
+// end on a page boundary, the rest of its last page is guaranteed to be zero-filled, so we get
+// this for free. Otherwise (or if mmap isn't possible) this falls back to reading a heap copy.
+// returns the file's length or < 0 for error.
+int map_file(const char *path, mapped_file *out);
+
+void unmap_file(mapped_file *f);
+
+#endif//__BLEP_MAP_H
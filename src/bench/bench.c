@@ -0,0 +1,216 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Measures tokenizer and parser throughput over files. Usage:
+//
+//   ./_bench [-n reps] <file>...
+//
+// Each file is read once, then tokenized (without the parser's hints, so regexps may be guessed
+// wrong) and fully parsed reps times each. Reports MB/s, tokens/s and latency from each file's
+// median run, then for each mode over all files: MB/s and tokens/s in total, and the p50/p99 of
+// the time each file took per MB, which shows the files slowest for their size. Build with
+// -DBLEP_STATS to also print counters from the parse.
+
+#include "../core/token.h"
+#include "../core/parser.h"
+#include "../batch/map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define BENCH_REPS  20
+
+static long tokens;
+static int stack_arena[PARSER_NEST_MAX * 2];  // as per the wasm harness
+
+void blep_parser_callback(parserdef *pd) {
+  ++tokens;
+}
+
+int blep_parser_open(parserdef *pd, int type) {
+  return 0;
+}
+
+void blep_parser_close(parserdef *pd, int type) {
+  // ignore
+}
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// returns zero or ERROR__...
+static int run_tokenize(mapped_file *m) {
+  tokendef td;
+  int ret = blep_token_init(&td, m->buf, m->len);
+  if (ret >= 0) {
+    blep_token_stack(&td, stack_arena, PARSER_NEST_MAX);
+    while ((ret = blep_token_next(&td)) > 0) {
+      ++tokens;
+    }
+  }
+  return ret;
+}
+
+static int run_parse(mapped_file *m) {
+  parserdef pd;
+  int ret = blep_parser_init(&pd, m->buf, m->len);
+  if (ret >= 0) {
+    blep_token_stack(&(pd.td), stack_arena, PARSER_NEST_MAX);
+    do {
+      ret = blep_parser_run(&pd);
+    } while (ret > 0);
+  }
+  return ret;
+}
+
+#ifdef BLEP_STATS
+// parses once more, printing what drove its cost
+static void print_stats(mapped_file *m) {
+  parserdef pd;
+  if (blep_parser_init(&pd, m->buf, m->len) >= 0) {
+    blep_token_stack(&(pd.td), stack_arena, PARSER_NEST_MAX);
+    while (blep_parser_run(&pd) > 0);
+  }
+  statsdef *s = blep_stats(&pd);
+
+  int lexed = 0;
+  for (int i = 0; i <= _TOKEN_MAX; ++i) {
+    lexed += s->tokens[i];
+  }
+  printf("  lexed=%d replayed=%d void=%d string=%d template=%d regexp=%d bytes\n", lexed,
+      s->replayed, s->void_bytes, s->string_bytes, s->template_bytes, s->regexp_bytes);
+  printf("  lookahead=%d restores=%d relexed=%d bytes, updates=%d depth_max=%d\n", s->set_restores,
+      s->restores, s->relexed_bytes, s->updates, s->depth_max);
+  printf("  callbacks=%d opens=%d closes=%d\n", s->callbacks, s->opens, s->closes);
+}
+#endif
+
+// nearest-rank percentile of the sorted values
+static double percentile(double *sorted, int count, int pct) {
+  int rank = (count * pct + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// totals for one mode over all files
+typedef struct {
+  const char *mode;
+  int (*fn)(mapped_file *);
+  double *per_mb;  // each file's median time per MB
+  int files;
+  double bytes;
+  double tokens;
+  double time;
+} bench_mode;
+
+// runs fn reps times over m, printing a line of results. returns zero or ERROR__...
+static int bench(const char *path, bench_mode *bm, mapped_file *m, int reps) {
+  double *times = malloc(sizeof(double) * reps);
+  long count = 0;
+  int ret = bm->fn(m);  // untimed, to warm up
+
+  for (int i = 0; i < reps && !ret; ++i) {
+    tokens = 0;
+    double start = now();
+    ret = bm->fn(m);
+    times[i] = now() - start;
+    count = tokens;
+  }
+
+  if (ret) {
+    printf("%-32s %-8s error=%d\n", path, bm->mode, ret);
+  } else {
+    qsort(times, reps, sizeof(double), compare_double);
+    double p50 = times[reps / 2];
+    printf("%-32s %-8s %9.1f %12.0f %9.3f\n", path, bm->mode, m->len / 1e6 / p50, count / p50,
+        p50 * 1e3);
+
+    if (m->len) {
+      bm->per_mb[bm->files++] = p50 / (m->len / 1e6);
+    }
+    bm->bytes += m->len;
+    bm->tokens += count;
+    bm->time += p50;
+  }
+  free(times);
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  int reps = BENCH_REPS;
+  int i = 1;
+
+  if (i + 1 < argc && !strcmp(argv[i], "-n")) {
+    reps = atoi(argv[i + 1]);
+    i += 2;
+  }
+  if (i == argc || reps <= 0) {
+    fprintf(stderr, "usage: %s [-n reps] <file>...\n", argv[0]);
+    return 1;
+  }
+
+  bench_mode modes[] = {
+    {"tokenize", run_tokenize},
+    {"parse", run_parse},
+  };
+  const int mode_count = sizeof(modes) / sizeof(bench_mode);
+  for (int j = 0; j < mode_count; ++j) {
+    modes[j].per_mb = malloc(sizeof(double) * (argc - i));
+  }
+
+  int err = 0;
+  printf("%-32s %-8s %9s %12s %9s\n", "file", "mode", "MB/s", "tokens/s", "ms");
+  for (; i < argc; ++i) {
+    mapped_file m;
+    if (map_file(argv[i], &m) < 0) {
+      fprintf(stderr, "could not read: %s\n", argv[i]);
+      err = 1;
+      continue;
+    }
+    for (int j = 0; j < mode_count; ++j) {
+      err |= bench(argv[i], &modes[j], &m, reps) != 0;
+    }
+#ifdef BLEP_STATS
+    print_stats(&m);
+#endif
+    unmap_file(&m);
+  }
+
+  printf("\n%-32s %-8s %9s %12s %9s %9s\n", "corpus", "mode", "MB/s", "tokens/s", "p50 ms/MB",
+      "p99 ms/MB");
+  for (int j = 0; j < mode_count; ++j) {
+    bench_mode *bm = &modes[j];
+    if (bm->files) {
+      char label[32];
+      snprintf(label, sizeof(label), "%d files", bm->files);
+      qsort(bm->per_mb, bm->files, sizeof(double), compare_double);
+      printf("%-32s %-8s %9.1f %12.0f %9.3f %9.3f\n", label, bm->mode,
+          bm->bytes / 1e6 / bm->time, bm->tokens / bm->time,
+          percentile(bm->per_mb, bm->files, 50) * 1e3, percentile(bm->per_mb, bm->files, 99) * 1e3);
+    }
+    free(bm->per_mb);
+  }
+  return err;
+}
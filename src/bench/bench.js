@@ -0,0 +1,152 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @fileoverview Measures parser throughput through runner.wasm, as a counterpart to bench.c. Usage:
+ *
+ *   node bench.js [-n reps] <file>...
+ *
+ * Tokenizes only (as per bench.c), runs per-token callbacks via run(), and batches via runBatch().
+ * Reports as bench.c does: per file from its median run, then per mode over all files, including
+ * the p50/p99 of the time each file took per MB.
+ */
+
+import buildHarness from '../harness/node-harness.js';
+import * as fs from 'fs';
+import {performance} from 'perf_hooks';
+
+const BENCH_REPS = 20;
+
+const args = process.argv.slice(2);
+let reps = BENCH_REPS;
+if (args[0] === '-n') {
+  reps = +args[1];
+  args.splice(0, 2);
+}
+if (!args.length || !(reps > 0)) {
+  console.error('usage: bench.js [-n reps] <file>...');
+  process.exit(1);
+}
+
+const harness = await buildHarness();
+
+/**
+ * Nearest-rank percentile of the sorted values.
+ *
+ * @param {number[]} sorted
+ * @param {number} pct
+ */
+const percentile = (sorted, pct) => sorted[Math.max(Math.ceil(sorted.length * pct / 100) - 1, 0)];
+
+/**
+ * @typedef {{
+ *   perMB: number[],
+ *   bytes: number,
+ *   tokens: number,
+ *   time: number,
+ * }}
+ * Totals
+ */
+
+/** @type {Map<string, Totals>} */
+const totals = new Map();
+
+/**
+ * @param {string} path
+ * @param {string} mode
+ * @param {number} size
+ * @param {() => number} fn returning the number of tokens
+ */
+function bench(path, mode, size, fn) {
+  const times = [];
+  let count = fn();  // untimed, to warm up
+  for (let i = 0; i < reps; ++i) {
+    const start = performance.now();
+    count = fn();
+    times.push(performance.now() - start);
+  }
+  times.sort((a, b) => a - b);
+
+  const p50 = times[reps >> 1];
+  const row = [
+    path.padEnd(32),
+    mode.padEnd(8),
+    (size / 1e3 / p50).toFixed(1).padStart(9),
+    (count / p50 * 1e3).toFixed(0).padStart(12),
+    p50.toFixed(3).padStart(9),
+  ];
+  console.info(row.join(' '));
+
+  let t = totals.get(mode);
+  if (!t) {
+    t = {perMB: [], bytes: 0, tokens: 0, time: 0};
+    totals.set(mode, t);
+  }
+  if (size) {
+    t.perMB.push(p50 / (size / 1e6));
+  }
+  t.bytes += size;
+  t.tokens += count;
+  t.time += p50;
+}
+
+console.info(['file'.padEnd(32), 'mode'.padEnd(8), 'MB/s'.padStart(9), 'tokens/s'.padStart(12),
+    'ms'.padStart(9)].join(' '));
+
+for (const path of args) {
+  const buffer = fs.readFileSync(path);
+  const size = buffer.length;
+
+  bench(path, 'tokenize', size, () => {
+    harness.prepare(size).set(buffer);
+    return harness.tokenize();
+  });
+
+  bench(path, 'parse', size, () => {
+    harness.prepare(size).set(buffer);
+    let tokens = 0;
+    harness.handle({callback() { ++tokens; }});
+    harness.run();
+    return tokens;
+  });
+
+  bench(path, 'batch', size, () => {
+    harness.prepare(size).set(buffer);
+    let tokens = 0;
+    harness.runBatch((records) => {
+      for (let i = 0; i < records.length; i += 7) {
+        tokens += (records[i + 1] !== -1) ? 1 : 0;
+      }
+    });
+    return tokens;
+  });
+}
+
+console.info();
+console.info(['corpus'.padEnd(32), 'mode'.padEnd(8), 'MB/s'.padStart(9), 'tokens/s'.padStart(12),
+    'p50 ms/MB'.padStart(9), 'p99 ms/MB'.padStart(9)].join(' '));
+for (const [mode, t] of totals) {
+  t.perMB.sort((a, b) => a - b);
+  const row = [
+    `${t.perMB.length} files`.padEnd(32),
+    mode.padEnd(8),
+    (t.bytes / 1e3 / t.time).toFixed(1).padStart(9),
+    (t.tokens / t.time * 1e3).toFixed(0).padStart(12),
+    percentile(t.perMB, 50).toFixed(3).padStart(9),
+    percentile(t.perMB, 99).toFixed(3).padStart(9),
+  ];
+  console.info(row.join(' '));
+}
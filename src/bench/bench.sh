@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Builds the native benchmark (as per "build.sh release") and runs it, then the same through
+# runner.wasm in Node. Runs over corpus/ (see corpus.sh) unless files are passed.
+
+cd "${BASH_SOURCE%/*}" || exit
+
+set -eu
+
+if [[ $# -eq 0 ]]; then
+  if [[ ! -d corpus ]]; then
+    ./corpus.sh
+  fi
+  set -- corpus/*.js
+fi
+
+clang -O2 -DSPEED bench.c ../batch/map.c ../core/*.c -o _bench
+echo "native" >&2
+./_bench "$@"
+rm _bench
+
+echo "wasm" >&2
+node bench.js "$@"
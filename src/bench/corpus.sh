@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# Fetches a fixed corpus of real code into corpus/, and generates a couple of synthetic files for
+# cases real code rarely stresses. Packages come from npm at pinned versions, and each tarball must
+# match its integrity hash (the registry's dist.integrity, as in package-lock.json) before anything
+# is taken from it.
+
+cd "${BASH_SOURCE%/*}" || exit
+
+set -eu
+mkdir -p corpus
+
+REGISTRY=${NPM_REGISTRY:-https://registry.npmjs.org}
+
+function fetch() {
+  local name=$1 package=$2 version=$3 integrity=$4 path=$5
+  if [[ -f "corpus/$name" ]]; then
+    return
+  fi
+
+  local tgz="corpus/.$package-$version.tgz"
+  if [[ ! -f "$tgz" ]]; then
+    echo "Fetching $package@$version..." >&2
+    curl -sfL "$REGISTRY/$package/-/$package-$version.tgz" -o "$tgz.part"
+    local actual=$(node -e '
+      const hash = require("crypto").createHash("sha512");
+      hash.update(require("fs").readFileSync(process.argv[1]));
+      process.stdout.write("sha512-" + hash.digest("base64"));
+    ' "$tgz.part")
+    if [[ "$actual" != "$integrity" ]]; then
+      echo "integrity mismatch for $package@$version: $actual" >&2
+      rm "$tgz.part"
+      exit 1
+    fi
+    mv "$tgz.part" "$tgz"
+  fi
+  tar -xzOf "$tgz" "package/$path" > "corpus/$name.part"
+  mv "corpus/$name.part" "corpus/$name"
+}
+
+fetch react-dom.development.js react-dom 17.0.2 \
+    sha512-s4h96KtLDUQlsENhMn1ar8t2bEa+q/YAtj8pPPdIjPDGBDIVNsrD9aXNWqspUe6AzKCIG0C1HZZLqLV7qpOBGA== \
+    umd/react-dom.development.js
+fetch react-dom.production.min.js react-dom 17.0.2 \
+    sha512-s4h96KtLDUQlsENhMn1ar8t2bEa+q/YAtj8pPPdIjPDGBDIVNsrD9aXNWqspUe6AzKCIG0C1HZZLqLV7qpOBGA== \
+    umd/react-dom.production.min.js
+fetch lodash.js lodash 4.17.21 \
+    sha512-v2kDEe57lecTulaDIuNTPy3Ry4gLGJ6Z1O3vE1krgXZNrsQ+LFTGHVxVjcXPs17LhbZVGedAJv8XZ1tvj5FvSg== \
+    lodash.js
+fetch lodash.min.js lodash 4.17.21 \
+    sha512-v2kDEe57lecTulaDIuNTPy3Ry4gLGJ6Z1O3vE1krgXZNrsQ+LFTGHVxVjcXPs17LhbZVGedAJv8XZ1tvj5FvSg== \
+    lodash.min.js
+fetch tsc.js typescript 4.3.2 \
+    sha512-zZ4hShnmnoVnAHpVHWpTcxdv7dWP60S2FsydQLV8V5PbS3FifjWFFRiHSWpDJahly88PRyV5teTSLoq4eG7mKw== \
+    lib/tsc.js
+fetch acorn.js acorn 8.3.0 \
+    sha512-tqPKHZ5CaBJw0Xmy0ZZvLs1qTV+BNFSyvn77ASXkpBNfIRk8ev26fKrD9iLGwGA9zedPao52GSHzq8lyZG0NUw== \
+    dist/acorn.js
+fetch esprima.js esprima 4.0.1 \
+    sha512-eGuFFw7Upda+g4p+QHvnW0RyTX/SVeJBDM/gCtMARO0cLuT2HcEKnTPvhjV6aGeqrCB/sbNop0Kszm0jsaWU4A== \
+    dist/esprima.js
+
+# mostly block and line comments, sprinkled with code
+node -e '
+  const out = [];
+  for (let i = 0; i < 20000; ++i) {
+    out.push(`/**\n * Comment ${i} with some text, "code", and // markers inside.\n */`);
+    out.push(`// line comment ${i}`, `export const v${i} = ${i}; /* trailing */`);
+  }
+  process.stdout.write(out.join("\n") + "\n");
+' > corpus/comments.js
+
+# brackets nested well past the tokenizer's built-in stack, but within the parser's limit
+node -e '
+  const depth = 500;
+  const out = [];
+  for (let i = 0; i < 200; ++i) {
+    out.push(`x${i} = ` + "(".repeat(depth) + "[{a: f(1)}]" + ")".repeat(depth) + ";");
+  }
+  process.stdout.write(out.join("\n") + "\n");
+' > corpus/nesting.js
+
+echo "Ok! => corpus/"
@@ -0,0 +1,115 @@
+#include "feed.h"
+#include <string.h>
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+EMSCRIPTEN_KEEPALIVE
+void blep_feed_init(feeddef *fd, parserdef *pd, char *buf, int cap) {
+  fd->pd = pd;
+  fd->buf = buf;
+  fd->cap = cap;
+  fd->len = 0;
+  fd->offset = 0;
+  fd->final = 0;
+  fd->started = 0;
+  fd->arena = NULL;
+  fd->arena_size = 0;
+  fd->save_size = 0;
+  buf[0] = 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_feed_stack(feeddef *fd, int *arena, int size) {
+  fd->arena = arena;
+  fd->arena_size = size;
+}
+
+// copies the live part of an arena stack (and its open_at) from one half of the arena to the other,
+// as a checkpoint only holds the built-in stack
+static inline void feed_copy_stack(feeddef *fd, int to_save) {
+  int n = fd->pd->td.depth + 1;
+  int *live = fd->arena;
+  int *save = fd->arena + fd->arena_size * 2;
+  int *from = to_save ? live : save;
+  int *to = to_save ? save : live;
+  memcpy(to, from, sizeof(int) * n);
+  memcpy(to + fd->arena_size, from + fd->arena_size, sizeof(int) * n);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_feed_buffer(feeddef *fd, char *buf, int cap) {
+  if (fd->started) {
+    blep_token_shift(&(fd->pd->td), buf - fd->buf);
+  }
+  fd->buf = buf;
+  fd->cap = cap;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_feed_space(feeddef *fd) {
+  if (fd->started) {
+    // the cursor is the first token of the statement in progress, everything before it is done
+    tokendef *td = &(fd->pd->td);
+    int drop = td->curr.vp - fd->buf;
+    if (drop > 0) {
+      memmove(fd->buf, fd->buf + drop, fd->len - drop + 1);
+      blep_token_shift(td, -drop);
+      fd->len -= drop;
+      fd->offset += drop;
+    }
+  }
+  return fd->cap - 1 - fd->len;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_feed_push(feeddef *fd, int len, int final) {
+  fd->len += len;
+  fd->buf[fd->len] = 0;
+  fd->final = final;
+  if (fd->started) {
+    fd->pd->td.end = fd->buf + fd->len;
+  }
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_feed_run(feeddef *fd) {
+  parserdef *pd = fd->pd;
+  tokendef *td = &(pd->td);
+
+  if (!fd->started) {
+    int ret = blep_parser_init(pd, fd->buf, fd->len);
+    if (!fd->final && td->reached_end) {
+      return FEED__MORE;  // the first token might be incomplete, set up again next time
+    } else if (ret < 0) {
+      return ret;
+    } else if (fd->arena && (ret = blep_token_stack(td, fd->arena, fd->arena_size))) {
+      return ret;
+    }
+    fd->started = 1;
+  }
+
+  td->reached_end = 0;
+  fd->save_size = blep_token_checkpoint_size(td);
+  memcpy(&(fd->save), td, fd->save_size);
+  if (fd->arena) {
+    feed_copy_stack(fd, 1);
+  }
+
+  int ret = blep_parser_run(pd);
+  if (!fd->final && td->reached_end) {
+    memcpy(td, &(fd->save), fd->save_size);
+    if (fd->arena) {
+      feed_copy_stack(fd, 0);
+    }
+    pd->skip = 0;
+    pd->open = 0;
+    return FEED__MORE;
+  } else if (ret < 0) {
+    return ret;
+  }
+  return ret ? FEED__STATEMENT : FEED__DONE;
+}
@@ -0,0 +1,48 @@
+#ifndef __BLEP_FEED_H
+#define __BLEP_FEED_H
+
+#include "parser.h"
+
+#define FEED__DONE       0
+#define FEED__STATEMENT  1  // a top-level statement was parsed
+#define FEED__MORE       2  // out of input, so the statement in progress will be parsed again
+
+// Feeds input to a parser in chunks, so only the statements in progress need to be held. The
+// parser can't suspend part-way through a statement, so a statement that runs out of input is
+// rolled back and parsed again from its start once more input is pushed. Callbacks made before the
+// rollback will be made again.
+typedef struct {
+  parserdef *pd;
+  char *buf;    // window of input, with a NULL at buf[len]
+  int cap;      // size of buf, including the NULL
+  int len;
+  int offset;   // of buf[0] within the whole input
+  int final;    // no more input follows what's in buf
+  int started;  // whether pd has been set up
+  int *arena;   // if set, see blep_feed_stack
+  int arena_size;
+
+  int save_size;
+  tokendef save;  // checkpoint at the start of the statement in progress
+} feeddef;
+
+void blep_feed_init(feeddef *, parserdef *, char *, int);
+
+// gives the parse a bigger stack, as per blep_token_stack, but arena holds 4 * size ints: half is
+// the stack, and half a copy of it for each rollback. call after init and before the first run.
+void blep_feed_stack(feeddef *, int *arena, int size);
+
+// the window has been moved or resized, e.g. via realloc(), and must hold the same contents
+void blep_feed_buffer(feeddef *, char *, int);
+
+// drops input that's no longer needed, returning the space for more at buf[len]. the offset of the
+// first byte kept is available in offset.
+int blep_feed_space(feeddef *);
+
+// len more bytes have been written at buf[len]
+void blep_feed_push(feeddef *, int, int final);
+
+// returns FEED__..., or ERROR__... on error
+int blep_feed_run(feeddef *);
+
+#endif//__BLEP_FEED_H
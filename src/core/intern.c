@@ -0,0 +1,84 @@
+#include "intern.h"
+#include <string.h>
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+static inline int intern_slots(int size) {
+  int slots = 1;
+  while (slots * 2 * (int) sizeof(intern_slot) <= size) {
+    slots *= 2;
+  }
+  return slots * (int) sizeof(intern_slot) <= size ? slots : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_intern_init(interndef *id, char *buf, void *table, int size) {
+  int slots = intern_slots(size);
+  id->buf = buf;
+  id->slots = table;
+  id->mask = slots - 1;
+  id->count = 0;
+  memset(table, 0, sizeof(intern_slot) * slots);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_intern_grow(interndef *id, void *table, int size) {
+  int slots = intern_slots(size);
+  if (slots <= id->mask + 1) {
+    return INTERN__FULL;
+  }
+
+  intern_slot *prev = id->slots;
+  int prev_slots = id->mask + 1;
+  id->slots = table;
+  id->mask = slots - 1;
+  memset(table, 0, sizeof(intern_slot) * slots);
+
+  // names are all distinct, so just find each an empty slot
+  for (intern_slot *s = prev; s < prev + prev_slots; ++s) {
+    if (!s->hash) {
+      continue;
+    }
+    int i = s->hash & id->mask;
+    while (id->slots[i].hash) {
+      i = (i + 1) & id->mask;
+    }
+    id->slots[i] = *s;
+  }
+  return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_intern_token(interndef *id, struct token *t) {
+  if (!t->hash) {
+    return -1;
+  } else if (id->mask < 0) {
+    return INTERN__FULL;
+  }
+
+  int i = t->hash & id->mask;
+  for (;;) {
+    intern_slot *s = id->slots + i;
+    if (!s->hash) {
+      break;
+    } else if (s->hash == t->hash && s->len == t->len && !memcmp(id->buf + s->at, t->p, t->len)) {
+      return s->id;
+    }
+    i = (i + 1) & id->mask;
+  }
+
+  if ((id->count + 1) * 4 > (id->mask + 1) * 3) {
+    return INTERN__FULL;
+  }
+
+  intern_slot *s = id->slots + i;
+  s->hash = t->hash;
+  s->id = id->count++;
+  s->at = t->p - id->buf;
+  s->len = t->len;
+  return s->id;
+}
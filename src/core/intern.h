@@ -0,0 +1,37 @@
+
+#ifndef __BLEP_INTERN_H
+#define __BLEP_INTERN_H
+
+#include "token.h"
+#include "def.h"
+
+// Assigns each distinct name (TOKEN_LIT or TOKEN_SYMBOL, by raw bytes) a dense id, in the order
+// first seen, via an open-addressed table in caller-provided memory. Keywords and properties are
+// names too.
+
+#define INTERN__FULL  -8  // past 3/4 full, see blep_intern_grow
+
+typedef struct {
+  uint32_t hash;  // zero if empty
+  int id;
+  int at;         // first occurrence, relative to buf
+  int len;
+} intern_slot;
+
+typedef struct {
+  char *buf;
+  intern_slot *slots;
+  int mask;   // slots - 1, a power of two
+  int count;  // ids assigned so far
+} interndef;
+
+// uses the largest power of two of slots which fits within size bytes
+void blep_intern_init(interndef *, char *buf, void *table, int size);
+
+// moves every name into a new (larger) table, which must not overlap the current one
+int blep_intern_grow(interndef *, void *table, int size);
+
+// returns the id of the name at t, -1 if t isn't a name, or INTERN__FULL
+int blep_intern_token(interndef *, struct token *t);
+
+#endif//__BLEP_INTERN_H
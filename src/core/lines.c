@@ -0,0 +1,59 @@
+#include "lines.h"
+#include "simd.h"
+#include <string.h>
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+EMSCRIPTEN_KEEPALIVE
+int blep_lines_index(char *buf, int len, int *out, int cap) {
+  char *end = buf + len;
+  int count = 0;
+
+#ifdef BLEP_SIMD
+  // aligned loads never cross a page, so the first and last blocks can be read whole
+  char *b = vec_align(buf);
+  uint64_t valid = ~vec_before(buf - b);
+
+  for (; b < end; b += VEC_SIZE) {
+    uint64_t newline = vec_mask(vec_eq(vec_load(b), '\n')) & valid & vec_before(end - b);
+    while (newline) {
+      int i = vec_index(newline);
+      if (count < cap) {
+        out[count] = b + i - buf;
+      }
+      ++count;
+      newline &= ~vec_before(i + 1);
+    }
+    valid = VEC_FULL;
+  }
+#else
+  for (char *p = buf; (p = memchr(p, '\n', end - p)); ++p) {
+    if (count < cap) {
+      out[count] = p - buf;
+    }
+    ++count;
+  }
+#endif
+
+  return count;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_lines_find(int *index, int count, int offset) {
+  int lo = 0;
+  int hi = count;
+
+  while (lo < hi) {
+    int mid = (lo + hi) >> 1;
+    if (index[mid] < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
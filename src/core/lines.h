@@ -0,0 +1,16 @@
+
+#ifndef __BLEP_LINES_H
+#define __BLEP_LINES_H
+
+// Finds lines and columns from offsets after the fact, via a table of where each newline is. This
+// is the only way to get columns, and the only way to get lines when built with BLEP_NO_LINES.
+
+// writes the offset of each '\n' in buf to out (up to cap of them), returning how many there are,
+// so call with cap zero to size the table first
+int blep_lines_index(char *buf, int len, int *out, int cap);
+
+// returns the line holding offset, from zero, via a binary search of the count newlines in index:
+// its column is then offset less one past the previous newline
+int blep_lines_find(int *index, int count, int offset);
+
+#endif//__BLEP_LINES_H
@@ -0,0 +1,38 @@
+
+#ifndef __BLEP_PARSER_INLINE_H
+#define __BLEP_PARSER_INLINE_H
+
+// Builds the parser into the including file, with its functions static inline and its callbacks
+// fixed at compile time, so that paths the embedder doesn't need compile out completely. Include
+// this instead of parser.h (and don't also link parser.c), having first defined any of:
+//
+//   BLEP_PARSER_CALLBACK(pd)        called per-token, or define BLEP_PARSER_TOKENS 0 for none
+//   BLEP_PARSER_OPEN(pd, type)      called per-stack, or define BLEP_PARSER_STACKS 0 for none
+//   BLEP_PARSER_CLOSE(pd, type)
+//
+// The callbacks default to blep_parser_callback, blep_parser_open and blep_parser_close as usual,
+// but can be macros or static functions. Without stacks, nothing is ever skipped or scanned, and
+// pd->open stays zero, so this can't be used with blep_recover_run. The tokenizer (token.c) is
+// still linked as normal.
+//
+// For example, to only validate, as in test262.c:
+//
+//   #define BLEP_PARSER_TOKENS 0
+//   #define BLEP_PARSER_STACKS 0
+//   #include "parser-inline.h"
+
+#ifdef __BLEP_PARSER_H
+#error "parser-inline.h must be included before parser.h"
+#endif
+
+#define BLEP_PARSER_API static inline
+
+#include "parser.c"
+
+// don't leak the parser's shorthand into the embedder
+#undef td
+#undef cursor
+#undef peek
+#undef debugf
+
+#endif//__BLEP_PARSER_INLINE_H
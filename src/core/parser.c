@@ -20,6 +20,25 @@
 #endif
 
 
+// the client's callbacks, which an embedder including this file directly can replace or turn off
+// so that their paths compile out, see parser-inline.h
+#ifndef BLEP_PARSER_CALLBACK
+#define BLEP_PARSER_CALLBACK blep_parser_callback
+#endif
+#ifndef BLEP_PARSER_OPEN
+#define BLEP_PARSER_OPEN blep_parser_open
+#endif
+#ifndef BLEP_PARSER_CLOSE
+#define BLEP_PARSER_CLOSE blep_parser_close
+#endif
+#ifndef BLEP_PARSER_TOKENS
+#define BLEP_PARSER_TOKENS 1
+#endif
+#ifndef BLEP_PARSER_STACKS
+#define BLEP_PARSER_STACKS 1
+#endif
+
+
 #define MODULE_LIST__IMPORT   0
 #define MODULE_LIST__EXPORT   1
 #define MODULE_LIST__REEXPORT 2
@@ -29,78 +48,102 @@
 #define STATEMENT__BLOCK      2
 
 
-static int consume_statement(int);
-static int consume_expr(int);
-static int consume_expr_group();
-static int consume_expr_statement();
-static int consume_definition_group();
-static int consume_function(int);
-static int consume_class(int);
-static int consume_expr_zero_many(int);
-static int consume_expr_internal(int);
-static int consume_definition_list(int, int);
-static int consume_destructuring(int);
-
-
-static int parser_skip = 0;
+static int consume_statement(parserdef *, int);
+static int consume_expr(parserdef *, int);
+static int consume_expr_group(parserdef *);
+static int consume_expr_statement(parserdef *);
+static int consume_definition_group(parserdef *);
+static int consume_function(parserdef *, int);
+static int consume_class(parserdef *, int);
+static int consume_expr_zero_many(parserdef *, int);
+static int consume_expr_internal(parserdef *, int);
+static int consume_definition_list(parserdef *, int, int);
+static int consume_destructuring(parserdef *, int);
 
 
+#define td (&(pd->td))
 #define cursor (&(td->curr))
 #define peek (&(td->peek))
 
 
 // emit cursor and continue
-static inline int cursor_next() {
-  if (!parser_skip) {
-    blep_parser_callback();
+static inline int cursor_next(parserdef *pd) {
+  if (BLEP_PARSER_TOKENS && !pd->skip) {
+    blep_stat(td, callbacks, 1);
+    BLEP_PARSER_CALLBACK(pd);
+  }
+  return blep_token_next(td);
+}
+
+// notes a stack the client will be told is closed
+static inline void parser_opened(parserdef *pd, int type) {
+  if (pd->open < PARSER_NEST_MAX) {
+    pd->opened[pd->open] = type;
   }
-  return blep_token_next();
+  ++pd->open;
 }
 
 // begins an optional stack (client can ignore it)
 #define _STACK_BEGIN(type) { \
   const int _stack_type = type; \
-  int _prev_parser_skip = parser_skip; \
-  parser_skip = parser_skip || blep_parser_open(type);
+  int _prev_skip = pd->skip; \
+  if (BLEP_PARSER_STACKS) { \
+    pd->skip = pd->skip ? pd->skip : (blep_stat(td, opens, 1), BLEP_PARSER_OPEN(pd, type)); \
+    if (!pd->skip) { parser_opened(pd, _stack_type); } \
+  }
 
-// ends an optional stack
+// ends an optional stack (without stacks, nothing else leaves skip changed here)
 #define _STACK_END() ; \
-  if (!parser_skip) { blep_parser_close(_stack_type); } \
-  parser_skip = _prev_parser_skip; \
+  if (BLEP_PARSER_STACKS) { \
+    if (!pd->skip) { blep_stat(td, closes, 1); BLEP_PARSER_CLOSE(pd, _stack_type); --pd->open; } \
+    pd->skip = _prev_skip; \
+  } \
 }
 
 // ends an optional stack _and_ consumes an upcoming semicolon on same line
 #define _STACK_END_SEMICOLON() \
     if (cursor->type == TOKEN_SEMICOLON && cursor->special == 0) { \
-      cursor_next(); /* only if on same line */ \
+      cursor_next(pd); /* only if on same line */ \
     } \
     _STACK_END();
 
 #define _SET_RESTORE() \
-  if (!parser_skip) { \
-    ++parser_skip; \
-    blep_token_set_restore();
+  if (!pd->skip) { \
+    ++pd->skip; \
+    blep_token_set_restore(td);
 
 #define _RESUME_RESTORE() \
-    --parser_skip; \
-    blep_token_restore(); \
+    --pd->skip; \
+    blep_token_restore(td); \
   }
 
 #define _check(v) { int _ret = v; if (_ret) { return _ret; }};
 
+// returns _call, unless this is already nested too deep
+#define _nest(_call) { \
+  if (pd->nest == PARSER_NEST_MAX) { \
+    debugf("hit nesting limit"); \
+    return ERROR__STACK; \
+  } \
+  ++pd->nest; \
+  int _ret = _call; \
+  --pd->nest; \
+  return _ret; \
+}
+
 // consume a single string (permissively allow ``)
-inline static int consume_basic_key_string_special(int special) {
+inline static int consume_basic_key_string_special(parserdef *pd, int special) {
   if (cursor->type != TOKEN_STRING || (cursor->p[0] == '`' && cursor->len > 1 && cursor->p[cursor->len - 1] != '`')) {
     // can't have templated string here at all, but allow single
     return ERROR__UNEXPECTED;
   }
   cursor->special = special;
-  cursor_next();
+  cursor_next(pd);
   return 0;
 }
 
 // consume a name of a function/class etc, needed as sometimes it's _just_ a name, not a decl
-inline static int consume_defn_name(int special) {
+inline static int consume_defn_name(parserdef *pd, int special) {
   if (cursor->special == LIT_EXTENDS || cursor->type != TOKEN_LIT) {
 #ifdef DEBUG
     if (peek->p) {
@@ -109,13 +152,13 @@ inline static int consume_defn_name(int special) {
     }
 #endif
     // emit empty symbol if a decl (move cursor => peek temporarily)
-    if (special && !parser_skip) {
+    if (BLEP_PARSER_TOKENS && special && !pd->skip) {
       memcpy(peek, cursor, sizeof(struct token));
       peek->vp = peek->p;  // no more void pointer for next token
       cursor->len = 0;
       cursor->special = special;
       cursor->type = TOKEN_SYMBOL;
-      cursor_next();
+      cursor_next(pd);
     }
     return 0;
   }
@@ -124,34 +167,113 @@ inline static int consume_defn_name(int special) {
     // this is a decl so the name is important
     cursor->type = TOKEN_SYMBOL;  // nb. should really ban reserved words
     cursor->special = special;
-    cursor_next();
+    cursor_next(pd);
   } else {
     // otherwise, it's actually just a lit
     cursor->type = TOKEN_LIT;
     cursor->special = 0;
-    cursor_next();
+    cursor_next(pd);
+  }
+  return 0;
+}
+
+static int scan_import(parserdef *);
+
+// skims from cursor up to and past the token closing depth, using only the tokenizer's own stack
+static int scan_close(parserdef *pd, int depth) {
+  while (td->depth >= depth) {  // nb. this is the depth after cursor, as nothing is peeked here
+    if (cursor->type == TOKEN_EOF) {
+      debugf("got EOF while scanning");
+      return ERROR__UNEXPECTED;
+    }
+    if (cursor->type == TOKEN_LIT && cursor->special == LIT_IMPORT && blep_token_peek(td) == TOKEN_PAREN) {
+      _check(scan_import(pd));
+    } else {
+      blep_token_next(td);
+    }
+  }
+  int ret = blep_token_next(td);
+  return ret < 0 ? ret : 0;
+}
+
+// whether cursor, just inside "import(", is a target that's just a string (so not a template with
+// holes, or the start of a longer expression)
+static inline int is_import_target(parserdef *pd) {
+  if (cursor->type != TOKEN_STRING ||
+      (cursor->p[0] == '`' && cursor->len > 1 && cursor->p[cursor->len - 1] != '`')) {
+    return 0;
+  }
+  blep_token_peek(td);
+  return peek->type == TOKEN_CLOSE || peek->special == MISC_COMMA;
+}
+
+// skims over "import(...)" at cursor, emitting its target if that's just a string
+static int scan_import(parserdef *pd) {
+  blep_token_next(td);
+  int depth = td->depth;
+
+  if (blep_token_next(td) == TOKEN_STRING) {
+    if (BLEP_PARSER_TOKENS && is_import_target(pd)) {
+      cursor->special = SPECIAL__EXTERNAL;
+      blep_stat(td, callbacks, 1);
+      BLEP_PARSER_CALLBACK(pd);
+    }
+    blep_token_next(td);
+  }
+  return scan_close(pd, depth);
+}
+
+// consumes "import(...)" at cursor, marking its target as SPECIAL__EXTERNAL as scan_import does
+static int consume_import_call(parserdef *pd) {
+  cursor->special = 0;
+  cursor_next(pd);  // "import"
+  cursor_next(pd);  // "("
+  if (is_import_target(pd)) {
+    cursor->special = SPECIAL__EXTERNAL;
+  }
+  _check(consume_expr_zero_many(pd, 0));
+
+  if (cursor->type != TOKEN_CLOSE) {
+    debugf("expected close for import(), was: %d", cursor->type);
+    return ERROR__UNEXPECTED;
   }
+  cursor_next(pd);  // consuming close
   return 0;
 }
 
-static inline int consume_dict(int is_class) {
+// whether the {} at cursor can be skimmed rather than parsed
+static inline int can_scan(parserdef *pd) {
+  return pd->skip == PARSER_SKIP_SCAN && cursor->type == TOKEN_BRACE && !peek->p;
+}
+
+// consumes the body of a function, which is skimmed if scanning
+static int consume_body(parserdef *pd) {
+  if (!can_scan(pd)) {
+    return consume_statement(pd, 0);
+  }
+  int depth = td->depth;
+  blep_token_next(td);
+  return scan_close(pd, depth);
+}
+
+static inline int consume_dict(parserdef *pd, int is_class) {
 #ifdef DEBUG
   if (cursor->type != TOKEN_BRACE) {
     debugf("missing open brace for dict");
     return ERROR__UNEXPECTED;
   }
 #endif
-  cursor_next();
+  cursor_next(pd);
 
   for (;;) {
     if (cursor->special == MISC_SPREAD) {
-      cursor_next();
-      _check(consume_expr(0));
+      cursor_next(pd);
+      _check(consume_expr(pd, 0));
       continue;
     }
 
     // static prefix
-    int is_static = (cursor->special == LIT_STATIC && blep_token_peek() != TOKEN_PAREN);
+    int is_static = (cursor->special == LIT_STATIC && blep_token_peek(td) != TOKEN_PAREN);
     if (is_static) {
 #if DEBUG
       if (!is_class) {
@@ -160,12 +282,12 @@ static inline int consume_dict(int is_class) {
       }
 #endif
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
     }
 
     // "async" prefix
     if (cursor->special == LIT_ASYNC) {
-      int peek_type = blep_token_peek();
+      int peek_type = blep_token_peek(td);
       switch (peek_type) {
         case TOKEN_OP:
           if (peek->special != MISC_STAR) {
@@ -176,20 +298,20 @@ static inline int consume_dict(int is_class) {
         case TOKEN_KEYWORD:  // reentry
         case TOKEN_LIT:
           cursor->type = TOKEN_KEYWORD;  // "async" is keyword
-          cursor_next();
+          cursor_next(pd);
           break;
       }
     }
 
     // generator
     if (cursor->special == MISC_STAR) {
-      cursor_next();
+      cursor_next(pd);
     }
 
     // get/set without bracket
-    if ((cursor->special == LIT_GET || cursor->special == LIT_SET) && blep_token_peek() != TOKEN_PAREN) {
+    if ((cursor->special == LIT_GET || cursor->special == LIT_SET) && blep_token_peek(td) != TOKEN_PAREN) {
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
     }
 
     // name or bracketed name
@@ -203,7 +325,7 @@ static inline int consume_dict(int is_class) {
         if (!is_class) {
 
           // if followed by : = or (, then this is a property
-          switch (blep_token_peek()) {
+          switch (blep_token_peek(td)) {
             case TOKEN_COLON:
             case TOKEN_PAREN:
               break;
@@ -219,20 +341,20 @@ static inline int consume_dict(int is_class) {
           }
         }
 
-        cursor_next();
+        cursor_next(pd);
         break;
       }
 
       case TOKEN_NUMBER:
-        cursor_next();
+        cursor_next(pd);
         break;
 
       case TOKEN_STRING:
-        _check(consume_basic_key_string_special(0));
+        _check(consume_basic_key_string_special(pd, 0));
         break;
 
       case TOKEN_ARRAY:
-        _check(consume_expr_group());
+        _check(consume_expr_group(pd));
         break;
 
       default:
@@ -246,8 +368,8 @@ static inline int consume_dict(int is_class) {
         // method
         _STACK_BEGIN(STACK__FUNCTION);
         _STACK_BEGIN(STACK__INNER);
-        _check(consume_definition_group());
-        _check(consume_statement(0));
+        _check(consume_definition_group(pd));
+        _check(consume_body(pd));
         _STACK_END();
         _STACK_END();
         break;
@@ -260,17 +382,17 @@ static inline int consume_dict(int is_class) {
 
       case TOKEN_COLON:
         // nb. this allows "async * foo:" or "async foo =" which is nonsensical
-        cursor_next();
+        cursor_next(pd);
         // this isn't really a statement, but we want to _abandon_ like it is (we pass 1 to consume_expr)
 
         if (is_class && !is_static) {
           // this expression is only run when the outer class is instantiated
           // this isn't on statics, because they're run immediately
           _STACK_BEGIN(STACK__INNER);
-          _check(consume_expr(1));
+          _check(consume_expr(pd, 1));
           _STACK_END();
         } else {
-          _check(consume_expr(1));
+          _check(consume_expr(pd, 1));
         }
 
         break;
@@ -279,7 +401,7 @@ static inline int consume_dict(int is_class) {
     // handle tail cases (close, eof, op, etc)
     switch (cursor->type) {
       case TOKEN_CLOSE:
-        cursor_next();
+        cursor_next(pd);
         return 0;
 
       case TOKEN_EOF:
@@ -289,7 +411,7 @@ static inline int consume_dict(int is_class) {
 
       case TOKEN_OP:
         if (cursor->special == MISC_COMMA) {
-          cursor_next();
+          cursor_next(pd);
           continue;
         }
         if (cursor->special == MISC_STAR) {
@@ -298,7 +420,7 @@ static inline int consume_dict(int is_class) {
         break;
 
       case TOKEN_SEMICOLON:
-        cursor_next();
+        cursor_next(pd);
         continue;
 
       case TOKEN_SYMBOL:  // reentry
@@ -316,20 +438,20 @@ static inline int consume_dict(int is_class) {
 
 // consume zero or many expressions (which can also be blank), separated by commas
 // may consume literally nothing
-static int consume_expr_zero_many(int is_statement) {
+static int consume_expr_zero_many(parserdef *pd, int is_statement) {
   for (;;) {
-    _check(consume_expr_internal(is_statement));
+    _check(consume_expr_internal(pd, is_statement));
     if (cursor->special != MISC_COMMA) {
       break;
     }
-    cursor_next();
+    cursor_next(pd);
   }
 
   return 0;
 }
 
 // consumes a boring grouped expr (paren, array, ternary)
-static int consume_expr_group() {
+static int consume_expr_group(parserdef *pd) {
   int open = cursor->type;
 #ifdef DEBUG
   switch (cursor->type) {
@@ -343,36 +465,36 @@ static int consume_expr_group() {
       return ERROR__UNEXPECTED;
   }
 #endif
-  cursor_next();
-  _check(consume_expr_zero_many(0));
+  cursor_next(pd);
+  _check(consume_expr_zero_many(pd, 0));
 
   if (cursor->type != TOKEN_CLOSE) {
     debugf("expected close for expr group (got %d), open was: %d", cursor->type, open);
     return ERROR__UNEXPECTED;
   }
-  cursor_next();  // consuming close
+  cursor_next(pd);  // consuming close
   return 0;
 }
 
 // consume arrowfunc from and including "=>"
-static int consume_arrowfunc_from_arrow(int is_statement) {
+static int consume_arrowfunc_from_arrow(parserdef *pd, int is_statement) {
   if (cursor->special != MISC_ARROW) {
     debugf("arrowfunc missing =>");
     return ERROR__UNEXPECTED;
   }
-  cursor_next();  // consume =>
+  cursor_next(pd);  // consume =>
 
   if (cursor->type == TOKEN_BRACE) {
-    return consume_statement(0);
+    return consume_body(pd);
   }
-  _check(consume_expr(is_statement));
+  _check(consume_expr(pd, is_statement));
   return 0;
 }
 
 // we assume that we're pointing at one (is_arrowfunc has returned true)
-static int consume_arrowfunc(int is_statement) {
+static int consume_arrowfunc(parserdef *pd, int is_statement) {
   // "async" prefix without immediate =>
-  int is_async = (cursor->special == LIT_ASYNC && !(blep_token_peek() == TOKEN_OP && peek->special == MISC_ARROW));
+  int is_async = (cursor->special == LIT_ASYNC && !(blep_token_peek(td) == TOKEN_OP && peek->special == MISC_ARROW));
   if (is_async) {
     cursor->type = TOKEN_KEYWORD;
   }
@@ -380,7 +502,7 @@ static int consume_arrowfunc(int is_statement) {
   _STACK_BEGIN(STACK__FUNCTION);
 
   if (is_async) {
-    cursor_next();
+    cursor_next(pd);
   }
 
   _STACK_BEGIN(STACK__INNER);
@@ -389,11 +511,11 @@ static int consume_arrowfunc(int is_statement) {
     case TOKEN_LIT:
       cursor->type = TOKEN_SYMBOL;
       cursor->special = SPECIAL__DECLARE;
-      cursor_next();
+      cursor_next(pd);
       break;
 
     case TOKEN_PAREN:
-      _check(consume_definition_group());
+      _check(consume_definition_group(pd));
       break;
 
     default:
@@ -401,13 +523,13 @@ static int consume_arrowfunc(int is_statement) {
       return ERROR__UNEXPECTED;
   }
 
-  _check(consume_arrowfunc_from_arrow(is_statement));
+  _check(consume_arrowfunc_from_arrow(pd, is_statement));
   _STACK_END();
   _STACK_END();
   return 0;
 }
 
-static int consume_template_string() {
+static int consume_template_string(parserdef *pd) {
 #ifdef DEBUG
   if (cursor->type != TOKEN_STRING || cursor->p[0] != '`') {
     debugf("bad templated string");
@@ -417,19 +539,19 @@ static int consume_template_string() {
 
   for (;;) {
     char end = cursor->p[cursor->len - 1];
-    cursor_next();
+    cursor_next(pd);
 
     if (end == '`') {
       return 0;
     } else if (end != '{') {
       // we don't have to check for "${", the only case where it won't exist if the file ends with:
       //   `foo{
-      // ... in which case consume_expr() below fails
+      // ... in which case consume_expr(pd) below fails
       debugf("templated string didn't end with ` or ${");
       return ERROR__UNEXPECTED;
     }
 
-    _check(consume_expr_zero_many(0));
+    _check(consume_expr_zero_many(pd, 0));
 
     if (!(cursor->type == TOKEN_STRING && cursor->p[0] == '}')) {
       debugf("templated string didn't restart with }, was %d", cursor->type);
@@ -438,7 +560,7 @@ static int consume_template_string() {
   }
 }
 
-static int maybe_consume_destructuring() {
+static int maybe_consume_destructuring(parserdef *pd) {
   switch (cursor->type) {
     case TOKEN_ARRAY:
     case TOKEN_BRACE:
@@ -453,20 +575,20 @@ static int maybe_consume_destructuring() {
   _SET_RESTORE();
   // thankfully, destructuring isn't allowed inside parens (e.g. `({x}) = {x}` is invalid), so just
   // check for equals here.
-  is_destructuring = (consume_destructuring(0) == 0) && cursor->special == MISC_EQUALS;
+  is_destructuring = (consume_destructuring(pd, 0) == 0) && cursor->special == MISC_EQUALS;
   _RESUME_RESTORE();
 
   debugf("lookahead got destructuring: %d", is_destructuring);
   if (is_destructuring) {
-    return consume_destructuring(0);
+    return consume_destructuring(pd, 0);
   }
   return 0;
 }
 
 // does lookahead to check for `async () =>` or `() =>`
-static int lookahead_is_paren_arrowfunc() {
+static int lookahead_is_paren_arrowfunc(parserdef *pd) {
   if (cursor->special == LIT_ASYNC) {
-    cursor_next();
+    cursor_next(pd);
   }
 
 #ifdef DEBUG
@@ -475,14 +597,14 @@ static int lookahead_is_paren_arrowfunc() {
     return ERROR__UNEXPECTED;
   }
 #endif
-  cursor_next();
+  cursor_next(pd);
 
-  if (consume_definition_list(0, 0)) {
+  if (consume_definition_list(pd, 0, 0)) {
     return 0;  // error is not arrowfunc
   }
 
   if (cursor->type == TOKEN_CLOSE) {
-    cursor_next();
+    cursor_next(pd);
     if (cursor->special == MISC_ARROW) {
       return 1;
     }
@@ -490,12 +612,12 @@ static int lookahead_is_paren_arrowfunc() {
   return 0;
 }
 
-static int maybe_consume_arrowfunc(int is_statement) {
+static int maybe_consume_arrowfunc(parserdef *pd, int is_statement) {
   // short-circuits
   if (cursor->type == TOKEN_LIT) {
-    blep_token_peek();
+    blep_token_peek(td);
     if (peek->special == MISC_ARROW) {
-      return consume_arrowfunc(is_statement);  // "blah =>" or even "async =>"
+      return consume_arrowfunc(pd, is_statement);  // "blah =>" or even "async =>"
     } else if (cursor->special != LIT_ASYNC) {
       return 0;
     } else if (peek->type == TOKEN_LIT) {
@@ -503,7 +625,7 @@ static int maybe_consume_arrowfunc(int is_statement) {
       if (peek->special == LIT_FUNCTION) {
         return 0;
       }
-      return consume_arrowfunc(is_statement);  // "async foo"
+      return consume_arrowfunc(pd, is_statement);  // "async foo"
     } else if (peek->type != TOKEN_PAREN) {
       return 0;  // "async ???" ignored, not group OR arrowfunc
     }
@@ -513,19 +635,19 @@ static int maybe_consume_arrowfunc(int is_statement) {
   // nb. We could look for "()" here, as it's invalid in expr position and is probably followed by
   // a `=>`. But we allow it anyway and the lookahead in this case is not much.
 
-  if (parser_skip) {
+  if (pd->skip) {
     return 0;  // treat as group, we don't care about this
   }
 
   int is_arrowfunc = 0;
 
   _SET_RESTORE();
-  is_arrowfunc = lookahead_is_paren_arrowfunc();
+  is_arrowfunc = lookahead_is_paren_arrowfunc(pd);
   _RESUME_RESTORE();
 
   debugf("lookahead found arrowfunc=%d", is_arrowfunc);
   if (is_arrowfunc) {
-    return consume_arrowfunc(is_statement);
+    return consume_arrowfunc(pd, is_statement);
   }
 
   return 0;
@@ -540,7 +662,7 @@ static int is_token_assign_like(struct token *t) {
 }
 
 // like the other, but counts ()'s
-static int consume_expr_internal(int is_statement) {
+static int consume_expr_body(parserdef *pd, int is_statement) {
   int paren_count = 0;
 
 restart_expr:
@@ -549,7 +671,7 @@ restart_expr:
   char *start = cursor->p;
 
   // lookahead #1: check for arrowfunc at this position
-  _check(maybe_consume_arrowfunc(is_statement));
+  _check(maybe_consume_arrowfunc(pd, is_statement));
   if (start != cursor->p) {
     if (paren_count == 0) {
       // arrowfunc is expr on its own
@@ -561,7 +683,7 @@ restart_expr:
     }
   } else {
     // lookahead #2: check for destructuring at this position
-    _check(maybe_consume_destructuring());
+    _check(maybe_consume_destructuring(pd));
     if (start != cursor->p) {
       value_line = cursor->line_no;
     }
@@ -575,13 +697,13 @@ restart_expr:
     switch (cursor->type) {
       case TOKEN_OP:
         if (!value_line && cursor->p[0] == '/') {
-          blep_token_update(TOKEN_REGEXP);  // we got it wrong
+          blep_token_update(td, TOKEN_REGEXP);  // we got it wrong
         }
         break;
 
       case TOKEN_REGEXP:
         if (value_line) {
-          blep_token_update(TOKEN_OP);  // we got it wrong
+          blep_token_update(td, TOKEN_OP);  // we got it wrong
         }
         break;
 
@@ -591,7 +713,7 @@ restart_expr:
         switch (cursor->special) {
           case LIT_ASYNC:
             // we check for arrowfunc at head, so this must be symbol or "async function"
-            blep_token_peek();
+            blep_token_peek(td);
             if (peek->special == LIT_FUNCTION) {
               cursor->type = TOKEN_KEYWORD;
             }
@@ -610,7 +732,7 @@ restart_expr:
             break;
 
           case LIT_NEW:
-            blep_token_peek();
+            blep_token_peek(td);
             if (peek->special != MISC_DOT) {
               // "new.target" is valid, allow all
               cursor->type = TOKEN_OP;
@@ -635,46 +757,46 @@ restart_expr:
         switch (cursor->special) {
           case LIT_ASYNC:
           case LIT_FUNCTION:
-            _check(consume_function(0));
+            _check(consume_function(pd, 0));
             continue;
 
           case LIT_CLASS:
-            _check(consume_class(0));
+            _check(consume_class(pd, 0));
             continue;
         }
 
-        cursor_next();  // invalid but allow anyway
+        cursor_next(pd);  // invalid but allow anyway
         continue;
 
       case TOKEN_ARRAY:
         value_line = cursor->line_no;  // nb. don't transition, might be array index
-        _check(consume_expr_group());
+        _check(consume_expr_group(pd));
         continue;
 
       case TOKEN_BRACE:
         _transition_to_value();
-        _check(consume_dict(0));
+        _check(consume_dict(pd, 0));
         continue;
 
       case TOKEN_TERNARY:
         // nb. needs value on left (and contents!), but nonsensical otherwise
-        _check(consume_expr_group());
+        _check(consume_expr_group(pd));
         value_line = 0;
         continue;
 
       case TOKEN_PAREN:
         if (value_line) {
           // this is a function call
-          _check(consume_expr_group());
+          _check(consume_expr_group(pd));
           value_line = cursor->line_no;
           continue;
         }
         ++paren_count;
-        cursor_next();
+        cursor_next(pd);
 
         // if we see a TOKEN_LIT immediately after us, see if it's actually a paren'ed lvalue
         // (this is incredibly uncommon, don't do this, e.g.: `(x)++`)
-        if (cursor->type != TOKEN_LIT || cursor->special & _MASK_KEYWORD || blep_token_peek() != TOKEN_CLOSE) {
+        if (cursor->type != TOKEN_LIT || cursor->special & _MASK_KEYWORD || blep_token_peek(td) != TOKEN_CLOSE) {
           goto restart_expr;
         }
 
@@ -683,18 +805,18 @@ restart_expr:
 
         int paren_remain = paren_count;
         do {
-          cursor_next();
-          blep_token_peek();
+          cursor_next(pd);
+          blep_token_peek(td);
           --paren_remain;
         } while (peek->type == TOKEN_CLOSE && paren_remain);
 
-        blep_token_peek();
+        blep_token_peek(td);
         is_lvalue = is_token_assign_like(peek) || peek->special == MISC_INCDEC;
         _RESUME_RESTORE();
 
         cursor->type = TOKEN_SYMBOL;
         cursor->special = is_lvalue ? SPECIAL__CHANGE : 0;
-        cursor_next();
+        cursor_next(pd);
         // parens will be caught next loop
         continue;
 
@@ -703,11 +825,11 @@ restart_expr:
           return 0;
         }
         --paren_count;
-        cursor_next();
+        cursor_next(pd);
 
         // if we saw () in skip mode, we don't look for the arrowfunc, so check for it here
-        if (parser_skip && cursor->special == MISC_ARROW) {
-          _check(consume_arrowfunc_from_arrow(is_statement));
+        if (pd->skip && cursor->special == MISC_ARROW) {
+          _check(consume_arrowfunc_from_arrow(pd, is_statement));
         }
 
         value_line = td->line_no;
@@ -717,30 +839,41 @@ restart_expr:
         if (cursor->p[0] == '}') {
           return 0;  // tokenizer tells us we're finished `${}`
         } else if (cursor->p[0] == '`') {
-          _check(consume_template_string())
+          _check(consume_template_string(pd))
           value_line = cursor->line_no;
         } else {
           _transition_to_value();
-          cursor_next();
+          cursor_next(pd);
         }
         continue;
 
       case TOKEN_SYMBOL:
         _transition_to_value();
+
+        // dynamic "import(...)" is all that's wanted while scanning, but is marked the same way
+        if (cursor->special == LIT_IMPORT && blep_token_peek(td) == TOKEN_PAREN) {
+          if (pd->skip == PARSER_SKIP_SCAN) {
+            _check(scan_import(pd));
+          } else {
+            _check(consume_import_call(pd));
+            value_line = cursor->line_no;
+          }
+          continue;
+        }
         cursor->special = 0;  // nothing special about symbols
 
-        blep_token_peek();
+        blep_token_peek(td);
         if (is_token_assign_like(peek) || peek->special == MISC_INCDEC) {
           cursor->special = SPECIAL__CHANGE;
         }
 
-        cursor_next();
+        cursor_next(pd);
         continue;
 
       case TOKEN_NUMBER:
       case TOKEN_REGEXP:
         _transition_to_value();
-        cursor_next();
+        cursor_next(pd);
         continue;
 
       case TOKEN_OP:
@@ -766,37 +899,37 @@ restart_expr:
 
       if (cursor->special == LIT_YIELD) {
         int line_no = cursor->line_no;
-        cursor_next();
+        cursor_next(pd);
         if (cursor->line_no != line_no) {
           _maybe_abandon();  // "yield \n 123" is invalid (generates ASI)
         }
       } else {
-        cursor_next();
+        cursor_next(pd);
       }
 
       value_line = 0;
       continue;
     } else if (is_token_assign_like(cursor)) {
       // nb. special-case for = as we allow arrowfunc after it
-      cursor_next();
+      cursor_next(pd);
       goto restart_expr;
     }
 
     switch (cursor->special) {
       case LIT_YIELD:
-        cursor_next();
+        cursor_next(pd);
 
       case MISC_ARROW:
         // this only happens for badly attached arrows or in skip mode
-        cursor_next();
+        cursor_next(pd);
         if (cursor->type == TOKEN_BRACE) {
-          _check(consume_statement(0));
+          _check(consume_statement(pd, 0));
         }
         goto restart_expr;
 
       case MISC_COMMA:
         if (paren_count) {
-          cursor_next();
+          cursor_next(pd);
           goto restart_expr;
         }
         return 0;
@@ -806,7 +939,7 @@ restart_expr:
         if (!value_line) {
           _maybe_abandon();
         }
-        cursor_next();
+        cursor_next(pd);
 
         // technically chain only allows e.g, ?.foo, ?.['foo'], or ?.(arg)
         // but broadly means "value but only continue if non-null"
@@ -818,7 +951,7 @@ restart_expr:
           return ERROR__UNEXPECTED;
         }
         cursor->special = SPECIAL__PROPERTY;
-        cursor_next();
+        cursor_next(pd);
         continue;
 
       case MISC_INCDEC:
@@ -826,24 +959,24 @@ restart_expr:
           if (cursor->line_no != value_line) {
             _maybe_abandon();  // not attached to previous, avoid consuming
           }
-          cursor_next();  // this is not attached to a simple lvalue
+          cursor_next(pd);  // this is not attached to a simple lvalue
           continue;
         }
 
         int paren_count_here = 0;
 
         // otherwise, look for upcoming lvalue
-        cursor_next();
+        cursor_next(pd);
         while (cursor->type == TOKEN_PAREN) {
           ++paren_count_here;
-          cursor_next();
+          cursor_next(pd);
         }
         paren_count += paren_count_here;
         if (cursor->type != TOKEN_LIT) {
           continue;  // e.g. `++((1`, ignore
         }
 
-        blep_token_peek();
+        blep_token_peek(td);
         if (peek->type == TOKEN_CLOSE) {
           // easy, e.g. `++(((x)` or `++x)`, we don't care if we're missing further )'s, invalid anyway
         } else if (paren_count_here) {
@@ -858,13 +991,13 @@ restart_expr:
         cursor->type = TOKEN_SYMBOL;
         cursor->special = SPECIAL__CHANGE;
         value_line = cursor->line_no;
-        cursor_next();
+        cursor_next(pd);
         continue;
 
       default:
         // all other ops are fine
         value_line = 0;
-        cursor_next();
+        cursor_next(pd);
     }
   }
 
@@ -872,9 +1005,13 @@ restart_expr:
 #undef _transition_to_value
 }
 
-static inline int consume_expr(int is_statement) {
+static int consume_expr_internal(parserdef *pd, int is_statement) {
+  _nest(consume_expr_body(pd, is_statement));
+}
+
+static inline int consume_expr(parserdef *pd, int is_statement) {
   char *start = cursor->p;
-  _check(consume_expr_internal(is_statement));
+  _check(consume_expr_internal(pd, is_statement));
 
   if (start == cursor->p) {
     debugf("could not consume expr, was: %d (%.*s)", cursor->type, cursor->len, cursor->p);
@@ -885,7 +1022,7 @@ static inline int consume_expr(int is_statement) {
 
 // consume destructuring: this is not always __DECLARE, because it could be in an expr
 // special will contain SPECIAL__TOP or SPECIAL__DECLARE
-static int consume_destructuring(int special) {
+static int consume_destructuring_body(parserdef *pd, int special) {
 #ifdef DEBUG
   int special_mask = (SPECIAL__TOP | SPECIAL__DECLARE);
   if ((special | special_mask) != special_mask) {
@@ -899,18 +1036,18 @@ static int consume_destructuring(int special) {
 #endif
   int start = cursor->type;
   cursor->special = SPECIAL__DESTRUCTURING;
-  cursor_next();
+  cursor_next(pd);
 
   for (;;) {
     switch (cursor->type) {
       case TOKEN_CLOSE:
-        cursor_next();
+        cursor_next(pd);
         return 0;
 
       case TOKEN_SYMBOL:  // reentry
       case TOKEN_LIT: {
         // if this [foo] or {foo} without colon, announce now
-        if (blep_token_peek() == TOKEN_COLON) {
+        if (blep_token_peek(td) == TOKEN_COLON) {
           // variable name after colon
           cursor->special = SPECIAL__PROPERTY;
         } else {
@@ -918,12 +1055,12 @@ static int consume_destructuring(int special) {
           cursor->type = TOKEN_SYMBOL;
           cursor->special = SPECIAL__PROPERTY | SPECIAL__CHANGE | special;
         }
-        cursor_next();
+        cursor_next(pd);
         break;
       }
 
       case TOKEN_STRING:
-        _check(consume_basic_key_string_special(0));
+        _check(consume_basic_key_string_special(pd, 0));
 
         if (cursor->type != TOKEN_COLON) {
           debugf("destructuring had string with no trailing colon");
@@ -934,26 +1071,26 @@ static int consume_destructuring(int special) {
       case TOKEN_ARRAY:
         if (start == TOKEN_BRACE) {
           // this is a computed property name
-          _check(consume_expr_group());
+          _check(consume_expr_group(pd));
           break;
         }
-        _check(consume_destructuring(special));
+        _check(consume_destructuring(pd, special));
         break;
 
       case TOKEN_BRACE:
         // nb. doesn't make sense in object context, but harmless
-        _check(consume_destructuring(special));
+        _check(consume_destructuring(pd, special));
         break;
 
       case TOKEN_OP:
         if (cursor->special == MISC_COMMA) {
           // nb. solo comma
-          cursor_next();
+          cursor_next(pd);
           continue;
         }
         if (cursor->special == MISC_SPREAD) {
           // this basically effects the next lit or destructured thing
-          cursor_next();
+          cursor_next(pd);
           continue;
         }
         // fall-through
@@ -965,39 +1102,43 @@ static int consume_destructuring(int special) {
 
     // check for colon: blah
     if (cursor->type == TOKEN_COLON) {
-      cursor_next();
+      cursor_next(pd);
 
       switch (cursor->type) {
         case TOKEN_ARRAY:
         case TOKEN_BRACE:
-          _check(consume_destructuring(special));
+          _check(consume_destructuring(pd, special));
           break;
 
         case TOKEN_SYMBOL:  // reentry
         case TOKEN_LIT:
           cursor->type = TOKEN_SYMBOL;
           cursor->special = SPECIAL__CHANGE | special;
-          cursor_next();
+          cursor_next(pd);
           break;
       }
     }
 
     // consume default
     if (cursor->special == MISC_EQUALS) {
-      cursor_next();
-      _check(consume_expr(0));
+      cursor_next(pd);
+      _check(consume_expr(pd, 0));
     }
   }
 }
 
+static int consume_destructuring(parserdef *pd, int special) {
+  _nest(consume_destructuring_body(pd, special));
+}
+
 // consumes a single definition (e.g. `catch (x)` or x in `function(x, y) {}`
-static int consume_optional_definition(int special, int is_statement) {
+static int consume_optional_definition(parserdef *pd, int special, int is_statement) {
   int is_spread = 0;
   int is_assign = 0;
 
   // this only applies to functions
   if (cursor->special == MISC_SPREAD) {
-    cursor_next();
+    cursor_next(pd);
     is_spread = 1;
   }
 
@@ -1009,19 +1150,19 @@ static int consume_optional_definition(int special, int is_statement) {
       cursor->special = SPECIAL__DECLARE | special;
 
       // look for assignment, incredibly likely, but check anyway
-      blep_token_peek();
+      blep_token_peek(td);
       switch (peek->special) {
         case LIT_IN:
         case LIT_OF:
         case MISC_EQUALS:
           cursor->special |= SPECIAL__CHANGE;
       }
-      cursor_next();
+      cursor_next(pd);
       break;
 
     case TOKEN_BRACE:
     case TOKEN_ARRAY:
-      _check(consume_destructuring(special | SPECIAL__DECLARE));
+      _check(consume_destructuring(pd, special | SPECIAL__DECLARE));
       break;
 
     default:
@@ -1036,50 +1177,50 @@ static int consume_optional_definition(int special, int is_statement) {
 }
 
 // consumes an optional "= <expr>"
-static int consume_optional_assign_suffix(int is_statement) {
+static int consume_optional_assign_suffix(parserdef *pd, int is_statement) {
   if (cursor->special == MISC_EQUALS) {
-    cursor_next();
+    cursor_next(pd);
     _STACK_BEGIN(STACK__EXPR);
-    _check(consume_expr(is_statement));
+    _check(consume_expr(pd, is_statement));
     _STACK_END();
   }
   return 0;
 }
 
 // consumes a number of comma-separated definitions (does not create stack)
-static int consume_definition_list(int special, int is_statement) {
+static int consume_definition_list(parserdef *pd, int special, int is_statement) {
   for (;;) {
-    _check(consume_optional_definition(special, is_statement));
-    _check(consume_optional_assign_suffix(is_statement));
+    _check(consume_optional_definition(pd, special, is_statement));
+    _check(consume_optional_assign_suffix(pd, is_statement));
     if (cursor->special != MISC_COMMA) {
       return 0;
     }
-    cursor_next();
+    cursor_next(pd);
   }
 }
 
 // wraps consume_definition_list (comma-separated list) by looking for parens
 // used in functions (normal, class, arrow)
-static int consume_definition_group() {
+static int consume_definition_group(parserdef *pd) {
   if (cursor->type != TOKEN_PAREN) {
     debugf("definition didn't start with paren, was type=%d special=%d", cursor->type, cursor->special);
     return ERROR__UNEXPECTED;
   }
-  cursor_next();
+  cursor_next(pd);
 
   if (cursor->type != TOKEN_CLOSE) {
-    _check(consume_definition_list(SPECIAL__TOP, 0));
+    _check(consume_definition_list(pd, SPECIAL__TOP, 0));
 
     if (cursor->type != TOKEN_CLOSE) {
       debugf("arg_group did not finish with close");
       return ERROR__UNEXPECTED;
     }
   }
-  cursor_next();
+  cursor_next(pd);
   return 0;
 }
 
-static int consume_function(int special) {
+static int consume_function(parserdef *pd, int special) {
   cursor->type = TOKEN_KEYWORD;
 
   // nb. this is either a top-level declaration or within an expr
@@ -1090,7 +1231,7 @@ static int consume_function(int special) {
 
   if (cursor->special == LIT_ASYNC) {
     is_async = 1;
-    cursor_next();
+    cursor_next(pd);
     cursor->type = TOKEN_KEYWORD;
   }
 
@@ -1098,26 +1239,26 @@ static int consume_function(int special) {
     debugf("function did not start with 'function'");
     return ERROR__UNEXPECTED;
   }
-  cursor_next();
+  cursor_next(pd);
 
   if (cursor->special == MISC_STAR) {
     is_generator = 1;
-    cursor_next();
+    cursor_next(pd);
   }
 
-  _check(consume_defn_name(special));
+  _check(consume_defn_name(pd, special));
   debugf("function, generator=%d async=%d", is_generator, is_async);
 
   _STACK_BEGIN(STACK__INNER);
-  _check(consume_definition_group());
-  _check(consume_statement(0));
+  _check(consume_definition_group(pd));
+  _check(consume_body(pd));
   _STACK_END();
 
   _STACK_END();
   return 0;
 }
 
-static int consume_class(int special) {
+static int consume_class(parserdef *pd, int special) {
 #ifdef DEBUG
   if (cursor->special != LIT_CLASS) {
     debugf("expected class keyword");
@@ -1126,27 +1267,34 @@ static int consume_class(int special) {
 #endif
   cursor->type = TOKEN_KEYWORD;
   _STACK_BEGIN(STACK__CLASS);
-  cursor_next();
+  cursor_next(pd);
 
-  _check(consume_defn_name(special));
+  _check(consume_defn_name(pd, special));
 
   if (cursor->special == LIT_EXTENDS) {
     cursor->type = TOKEN_KEYWORD;
-    cursor_next();
+    cursor_next(pd);
 
     // nb. something must be here (but if it's not, that's an error, as we expect a '{' following)
     // we actually allow any expr here (e.g., `1+2`) although technically it should be one token
     _STACK_BEGIN(STACK__EXPR);
-    _check(consume_expr(1));  // use "is_statement=1" because we want to fail early
+    _check(consume_expr(pd, 1));  // use "is_statement=1" because we want to fail early
     _STACK_END();
   }
 
-  _check(consume_dict(1));
+  if (can_scan(pd)) {
+    // skim over the whole class body, as nothing in it is emitted
+    int depth = td->depth;
+    blep_token_next(td);
+    _check(scan_close(pd, depth));
+  } else {
+    _check(consume_dict(pd, 1));
+  }
   _STACK_END();
   return 0;
 }
 
-static int consume_decl_stack(int special) {
+static int consume_decl_stack(parserdef *pd, int special) {
 #ifdef DEBUG
   if (!(cursor->special & _MASK_DECL)) {
     debugf("expected decl start");
@@ -1156,26 +1304,26 @@ static int consume_decl_stack(int special) {
   _STACK_BEGIN(STACK__DECLARE);
   special |= (cursor->special == LIT_VAR ? SPECIAL__TOP : 0);
   cursor->type = TOKEN_KEYWORD;
-  cursor_next();
-  _check(consume_definition_list(special, 1));
+  cursor_next(pd);
+  _check(consume_definition_list(pd, special, 1));
   _STACK_END_SEMICOLON();
   return 0;
 }
 
 
-static int consume_module_list_deep(int mode) {
+static int consume_module_list_deep(parserdef *pd, int mode) {
 #ifdef DEBUG
   if (cursor->type != TOKEN_BRACE) {
     debugf("expected { to start module deep");
     return ERROR__UNEXPECTED;
   }
 #endif
-  cursor_next();
+  cursor_next(pd);
 
   for (;;) {
     switch (cursor->type) {
       case TOKEN_CLOSE:
-        cursor_next();
+        cursor_next(pd);
         return 0;
 
       case TOKEN_SYMBOL:  // reentry
@@ -1184,7 +1332,7 @@ static int consume_module_list_deep(int mode) {
 
       case TOKEN_OP:
         if (cursor->special == MISC_COMMA) {
-          cursor_next();
+          cursor_next(pd);
           continue;
         }
         // fall-through
@@ -1194,7 +1342,7 @@ static int consume_module_list_deep(int mode) {
         return ERROR__UNEXPECTED;
     }
 
-    blep_token_peek();
+    blep_token_peek(td);
     if (peek->special == LIT_AS) {
       // this isn't a definition, but it's a property of the thing being imported or exported
       // e.g., "foo as bar"
@@ -1208,11 +1356,11 @@ static int consume_module_list_deep(int mode) {
         cursor->special = SPECIAL__EXTERNAL;
         cursor->type = TOKEN_LIT;  // reset in case
       }
-      cursor_next();
+      cursor_next(pd);
 
       // consume "as"
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
 
       if (cursor->type != TOKEN_LIT && cursor->type != TOKEN_SYMBOL) {
         debugf("missing literal after 'as'");
@@ -1228,7 +1376,7 @@ static int consume_module_list_deep(int mode) {
         cursor->type = TOKEN_LIT;
         cursor->special = SPECIAL__EXTERNAL;
       }
-      cursor_next();
+      cursor_next(pd);
 
     } else {
       // we found "foo" on its own
@@ -1251,34 +1399,34 @@ static int consume_module_list_deep(int mode) {
           cursor->type = TOKEN_SYMBOL;
           cursor->special = SPECIAL__EXTERNAL | SPECIAL__DECLARE | SPECIAL__TOP;
       }
-      cursor_next();
+      cursor_next(pd);
 
     }
 
     // check for comma in loop
     if (cursor->special == MISC_COMMA) {
-      cursor_next();
+      cursor_next(pd);
     }
   }
 }
 
 // consumes comma-separated part after `import` keyword
-static int consume_import_module_list() {
+static int consume_import_module_list(parserdef *pd) {
   for (;;) {
     // check for inner brace
     if (cursor->type == TOKEN_BRACE) {
-      _check(consume_module_list_deep(MODULE_LIST__IMPORT));
+      _check(consume_module_list_deep(pd, MODULE_LIST__IMPORT));
       if (cursor->special != MISC_COMMA) {
         return 0;
       }
-      cursor_next();
+      cursor_next(pd);
       continue;
     }
 
     switch (cursor->type) {
       case TOKEN_OP:
         if (cursor->special == MISC_COMMA) {
-          cursor_next();
+          cursor_next(pd);
           continue;
         }
 
@@ -1286,14 +1434,14 @@ static int consume_import_module_list() {
         if (cursor->special != MISC_STAR) {
           return 0;
         }
-        cursor_next();
+        cursor_next(pd);
 
         if (cursor->special != LIT_AS) {
           debugf("expected `* as ...`");
           return ERROR__UNEXPECTED;
         }
         cursor->type = TOKEN_KEYWORD;
-        cursor_next();
+        cursor_next(pd);
 
         if (cursor->type != TOKEN_LIT && cursor->type != TOKEN_SYMBOL) {
           debugf("missing literal after 'import * as'");
@@ -1301,7 +1449,7 @@ static int consume_import_module_list() {
         }
         cursor->type = TOKEN_SYMBOL;
         cursor->special = SPECIAL__DECLARE | SPECIAL__TOP;
-        cursor_next();
+        cursor_next(pd);
         break;
 
       case TOKEN_SYMBOL:  // reentry
@@ -1309,7 +1457,7 @@ static int consume_import_module_list() {
         // this imports the defaultExport of another file as a single name
         cursor->type = TOKEN_SYMBOL;
         cursor->special = SPECIAL__DECLARE | SPECIAL__TOP;
-        cursor_next();
+        cursor_next(pd);
         break;
 
       default:
@@ -1319,11 +1467,11 @@ static int consume_import_module_list() {
     if (cursor->special != MISC_COMMA) {
       return 0;
     }
-    cursor_next();
+    cursor_next(pd);
   }
 }
 
-static int consume_import() {
+static int consume_import(parserdef *pd) {
 #ifdef DEBUG
   if (cursor->special != LIT_IMPORT) {
     debugf("missing import keyword");
@@ -1331,10 +1479,10 @@ static int consume_import() {
   }
 #endif
   cursor->type = TOKEN_KEYWORD;
-  cursor_next();
+  cursor_next(pd);
 
   if (cursor->type != TOKEN_STRING) {
-    _check(consume_import_module_list());
+    _check(consume_import_module_list(pd));
 
     // consume "from"
     if (cursor->special != LIT_FROM) {
@@ -1342,26 +1490,26 @@ static int consume_import() {
       return ERROR__UNEXPECTED;
     }
     cursor->type = TOKEN_KEYWORD;
-    cursor_next();
+    cursor_next(pd);
   }
 
   // match string (but not if `${}`).
-  return consume_basic_key_string_special(SPECIAL__EXTERNAL);
+  return consume_basic_key_string_special(pd, SPECIAL__EXTERNAL);
 }
 
 // consumes only a reexport (must be on `export` keyword)
-static int consume_export_reexport() {
+static int consume_export_reexport(parserdef *pd) {
 #ifdef DEBUG
   if (cursor->special != LIT_EXPORT) {
     debugf("missing export keyword");
     return ERROR__UNEXPECTED;
   }
 #endif
-  cursor_next();  // move to star/brace
+  cursor_next(pd);  // move to star/brace
 
   switch (cursor->type) {
     case TOKEN_BRACE:
-      _check(consume_module_list_deep(MODULE_LIST__REEXPORT));
+      _check(consume_module_list_deep(pd, MODULE_LIST__REEXPORT));
       break;
 
     case TOKEN_OP:
@@ -1369,11 +1517,11 @@ static int consume_export_reexport() {
         debugf("expected `export *`");
         return ERROR__UNEXPECTED;
       }
-      cursor_next();
+      cursor_next(pd);
 
       if (cursor->special == LIT_AS) {
         cursor->type = TOKEN_KEYWORD;
-        cursor_next();
+        cursor_next(pd);
 
         if (cursor->type != TOKEN_LIT && cursor->type != TOKEN_SYMBOL) {
           debugf("reexport * as foo missing foo");
@@ -1382,7 +1530,7 @@ static int consume_export_reexport() {
 
         cursor->type = TOKEN_LIT;
         cursor->special = SPECIAL__EXTERNAL;
-        cursor_next();
+        cursor_next(pd);
       }
       break;
 
@@ -1396,25 +1544,25 @@ static int consume_export_reexport() {
     return ERROR__INTERNAL;
   }
   cursor->type = TOKEN_KEYWORD;
-  cursor_next();
-  return consume_basic_key_string_special(SPECIAL__EXTERNAL);
+  cursor_next(pd);
+  return consume_basic_key_string_special(pd, SPECIAL__EXTERNAL);
 }
 
 // consumes a declare export (must be on `export` keyword) from self
-static int consume_export_declare() {
+static int consume_export_declare(parserdef *pd) {
 #ifdef DEBUG
   if (cursor->special != LIT_EXPORT) {
     debugf("missing export keyword");
     return ERROR__UNEXPECTED;
   }
 #endif
-  cursor_next();  // move over export
+  cursor_next(pd);  // move over export
 
   int special_hoist;
   int is_default = (cursor->special == LIT_DEFAULT);
   if (is_default) {
     cursor->type = TOKEN_KEYWORD;
-    cursor_next();  // move over "default"
+    cursor_next(pd);  // move over "default"
     special_hoist = SPECIAL__DECLARE | SPECIAL__CHANGE | SPECIAL__DEFAULT;
   } else {
     special_hoist = SPECIAL__DECLARE | SPECIAL__CHANGE | SPECIAL__EXTERNAL;
@@ -1422,25 +1570,25 @@ static int consume_export_declare() {
 
   switch (cursor->special) {
     case LIT_CLASS:
-      _check(consume_class(special_hoist));
+      _check(consume_class(pd, special_hoist));
       return 0;
 
     case LIT_ASYNC:
-      blep_token_peek();
+      blep_token_peek(td);
       if (peek->special != LIT_FUNCTION) {
         break;  // this will be an expr
       }
       // fall-through
 
     case LIT_FUNCTION:
-      _check(consume_function(special_hoist));
+      _check(consume_function(pd, special_hoist));
       return 0;
   }
 
   if (is_default) {
-    return consume_expr_statement();  // MUST be expr
+    return consume_expr_statement(pd);  // MUST be expr
   } else if (cursor->special & _MASK_DECL) {
-    return consume_decl_stack(SPECIAL__EXTERNAL);
+    return consume_decl_stack(pd, SPECIAL__EXTERNAL);
   }
 
   debugf("bad `export` declaration (should be default, var/lit/const, function, class)");
@@ -1448,7 +1596,7 @@ static int consume_export_declare() {
 }
 
 // consumes a regular export or a reexport, generating stack information
-static int consume_export_wrap() {
+static int consume_export_wrap(parserdef *pd) {
 #ifdef DEBUG
   if (cursor->special != LIT_EXPORT) {
     debugf("missing export keyword");
@@ -1458,22 +1606,22 @@ static int consume_export_wrap() {
   cursor->type = TOKEN_KEYWORD;  // set first so valid for STACK_BEGIN
 
   // check if this is actually a reexport
-  blep_token_peek();
+  blep_token_peek(td);
 
   int is_reexport = 0;
   if (peek->special == MISC_STAR) {
     is_reexport = 1;  // must be `export * from 'foo'`
   } else if (peek->type == TOKEN_BRACE) {
     _SET_RESTORE();
-    cursor_next();  // move to star/brace
-    _check(consume_module_list_deep(MODULE_LIST__EXPORT));
+    cursor_next(pd);  // move to star/brace
+    _check(consume_module_list_deep(pd, MODULE_LIST__EXPORT));
     is_reexport = (cursor->special == LIT_FROM);
     _RESUME_RESTORE();
 
     if (!is_reexport) {
       _STACK_BEGIN(STACK__MODULE);
-      cursor_next();
-      _check(consume_module_list_deep(MODULE_LIST__EXPORT));
+      cursor_next(pd);
+      _check(consume_module_list_deep(pd, MODULE_LIST__EXPORT));
       _STACK_END_SEMICOLON();
       return 0;
     }
@@ -1481,22 +1629,22 @@ static int consume_export_wrap() {
 
   if (is_reexport) {
     _STACK_BEGIN(STACK__MODULE);
-    _check(consume_export_reexport());
+    _check(consume_export_reexport(pd));
     _STACK_END_SEMICOLON();
   } else {
     _STACK_BEGIN(STACK__EXPORT);
-    _check(consume_export_declare());
+    _check(consume_export_declare(pd));
     _STACK_END_SEMICOLON();
   }
 
   return 0;
 }
 
-static inline int consume_control_group_inner(int control_hash) {
+static inline int consume_control_group_inner(parserdef *pd, int control_hash) {
   switch (control_hash) {
     case LIT_CATCH:
       // special-case catch, which creates a local scoped var
-      return consume_optional_definition(0, 0);
+      return consume_optional_definition(pd, 0, 0);
 
     case LIT_AWAIT:
     case LIT_FOR:
@@ -1505,7 +1653,7 @@ static inline int consume_control_group_inner(int control_hash) {
     default:
       if (cursor->type != TOKEN_CLOSE) {
         _STACK_BEGIN(STACK__EXPR);
-        _check(consume_expr_zero_many(0));
+        _check(consume_expr_zero_many(pd, 0));
         _STACK_END();
       }
       return 0;
@@ -1521,10 +1669,10 @@ static inline int consume_control_group_inner(int control_hash) {
       // started with "var" etc
       int special = cursor->special == LIT_VAR ? SPECIAL__TOP : 0;
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
 
       char *start = cursor->p;
-      _check(consume_optional_definition(special, 0));
+      _check(consume_optional_definition(pd, special, 0));
       if (start == cursor->p) {
         debugf("expected var def after decl");
         return ERROR__UNEXPECTED;
@@ -1533,18 +1681,18 @@ static inline int consume_control_group_inner(int control_hash) {
       // `for (var x of y)` or `for (var {x,y} of z)`
       if (cursor->special == LIT_OF || cursor->special == LIT_IN) {
         cursor->type = TOKEN_OP;
-        cursor_next();
+        cursor_next(pd);
         _STACK_BEGIN(STACK__EXPR);
-        _check(consume_expr(0));
+        _check(consume_expr(pd, 0));
         _STACK_END();
         allow_semicolon = 0;
       } else {
         // otherwise, this is a ;; loop and can be a normal decl
         // step past optional "= 1" and "," then continue more definitions
-        _check(consume_optional_assign_suffix(0));
+        _check(consume_optional_assign_suffix(pd, 0));
         if (cursor->special == MISC_COMMA) {
-          cursor_next();
-          _check(consume_definition_list(special, 0));
+          cursor_next(pd);
+          _check(consume_definition_list(pd, special, 0));
         }
       }
       _STACK_END();
@@ -1555,7 +1703,7 @@ static inline int consume_control_group_inner(int control_hash) {
     } else {
       // otherwise, this is an expr
       // ... it allows "is" and "of" to be mapped to keywords
-      _check(consume_expr_zero_many(0));
+      _check(consume_expr_zero_many(pd, 0));
     }
   }
 
@@ -1568,31 +1716,31 @@ static inline int consume_control_group_inner(int control_hash) {
   if (cursor->type != TOKEN_SEMICOLON) {
     return 0;  // not always valid, but just allow it anyway
   }
-  cursor_next();
+  cursor_next(pd);
 
   // consume middle block (skip if semicolon)
   if (cursor->type != TOKEN_SEMICOLON) {
     _STACK_BEGIN(STACK__EXPR);
-    _check(consume_expr_zero_many(0));
+    _check(consume_expr_zero_many(pd, 0));
     _STACK_END();
   }
   if (cursor->type != TOKEN_SEMICOLON) {
     debugf("expected 2nd semicolon");
     return ERROR__UNEXPECTED;
   }
-  cursor_next();
+  cursor_next(pd);
 
   // consume right block (skip if close)
   if (cursor->type == TOKEN_CLOSE) {
     return 0;
   }
   _STACK_BEGIN(STACK__EXPR);
-  _check(consume_expr_zero_many(0));
+  _check(consume_expr_zero_many(pd, 0));
   _STACK_END();
   return 0;
 }
 
-static int consume_control() {
+static int consume_control(parserdef *pd) {
 #ifdef DEBUG
   if (!(cursor->special & _MASK_CONTROL)) {
     debugf("expected _MASK_CONTROL for consume_control");
@@ -1605,38 +1753,38 @@ static int consume_control() {
 
   _STACK_BEGIN(STACK__CONTROL);
   cursor->type = TOKEN_KEYWORD;
-  cursor_next();
+  cursor_next(pd);
 
   // match "for" and "for await"
   if (control_hash == LIT_FOR) {
     if (cursor->special == LIT_AWAIT) {
       control_hash = LIT_AWAIT;
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
     }
   }
 
   // match inner parens of control
   if (consume_paren && cursor->type == TOKEN_PAREN) {
-    cursor_next();
-    _check(consume_control_group_inner(control_hash));
+    cursor_next(pd);
+    _check(consume_control_group_inner(pd, control_hash));
     if (cursor->type != TOKEN_CLOSE) {
       debugf("could not find closer of control ()");
       return ERROR__UNEXPECTED;
     }
-    cursor_next();
+    cursor_next(pd);
   }
 
   // special case do-while
   if (control_hash == LIT_DO) {
-    _check(consume_statement(0));
+    _check(consume_statement(pd, 0));
 
     // we awkwardly peer into the parser to see if we _just_ consumed a semicolon
     // this allows us to to parse `do 1 \n ; while (0)`, which is totally valid
     // (although ; isn't attached to the prior stack)
     char prev = cursor->vp[-1];
     if (prev != ';' && cursor->type == TOKEN_SEMICOLON) {
-      cursor_next();
+      cursor_next(pd);
     }
 
     if (cursor->special != LIT_WHILE) {
@@ -1644,7 +1792,7 @@ static int consume_control() {
       return ERROR__UNEXPECTED;
     }
     cursor->type = TOKEN_KEYWORD;
-    cursor_next();
+    cursor_next(pd);
 
     if (cursor->type != TOKEN_PAREN) {
       debugf("could not find paren for while");
@@ -1652,27 +1800,27 @@ static int consume_control() {
     }
 
     // this isn't special (can't define var/let etc), just consume as expr on paren
-    _check(consume_expr_group());
+    _check(consume_expr_group(pd));
 
     // can have newlines here, consume next anyway
     if (cursor->type == TOKEN_SEMICOLON) {
-      cursor_next();
+      cursor_next(pd);
     }
 
   } else {
     // ... otherwise it's a boring statement
-     _check(consume_statement(0));
+     _check(consume_statement(pd, 0));
   }
 
   _STACK_END();
   return 0;
 }
 
-static int consume_expr_statement() {
+static int consume_expr_statement(parserdef *pd) {
   _STACK_BEGIN(STACK__EXPR);
 
   char *start = cursor->p;
-  _check(consume_expr_zero_many(1));
+  _check(consume_expr_zero_many(pd, 1));
   if (start == cursor->p) {
     debugf("could not consume any expr statement, token=%d %.*s", cursor->type, cursor->len, cursor->p);
     return ERROR__UNEXPECTED;
@@ -1682,7 +1830,7 @@ static int consume_expr_statement() {
   return 0;
 }
 
-static int consume_statement(int mode) {
+static int consume_statement_body(parserdef *pd, int mode) {
   switch (cursor->type) {
     case TOKEN_EOF:
     case TOKEN_COLON:
@@ -1696,32 +1844,32 @@ static int consume_statement(int mode) {
       // naked block statement (or under function)
       cursor->type = TOKEN_BLOCK;
       _STACK_BEGIN(STACK__BLOCK);
-      cursor_next();
+      cursor_next(pd);
 
       do {
-        _check(consume_statement(STATEMENT__BLOCK));
+        _check(consume_statement(pd, STATEMENT__BLOCK));
       } while (cursor->type != TOKEN_CLOSE);
 
       cursor->special = TOKEN_BLOCK;
-      cursor_next();
+      cursor_next(pd);
       _STACK_END();
       return 0;
 
     case TOKEN_SEMICOLON:
       _STACK_BEGIN(STACK__MISC);
-      cursor_next();
+      cursor_next(pd);
       _STACK_END();
       return 0;
 
     case TOKEN_LABEL:  // reentry
       _STACK_BEGIN(STACK__LABEL);
-      cursor_next();
+      cursor_next(pd);
 
       if (cursor->type != TOKEN_COLON) {
         return ERROR__UNEXPECTED;
       }
-      cursor_next();
-      _check(consume_statement(0));
+      cursor_next(pd);
+      _check(consume_statement(pd, 0));
 
       _STACK_END();
       return 0;
@@ -1732,7 +1880,7 @@ static int consume_statement(int mode) {
       break;
 
     default:
-      return consume_expr_statement();
+      return consume_expr_statement(pd);
   }
 
   switch (cursor->special) {
@@ -1740,13 +1888,13 @@ static int consume_statement(int mode) {
       _STACK_BEGIN(STACK__LABEL);
 
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
 
       if (cursor->type != TOKEN_COLON) {
         debugf("no : after default");
         return ERROR__UNEXPECTED;
       }
-      cursor_next();
+      cursor_next(pd);
       // nb. this doesn't parent a statement
 
       _STACK_END();
@@ -1756,17 +1904,17 @@ static int consume_statement(int mode) {
       _STACK_BEGIN(STACK__LABEL);
 
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
 
       _STACK_BEGIN(STACK__EXPR);
-      _check(consume_expr(0));
+      _check(consume_expr(pd, 0));
       _STACK_END();
 
       if (cursor->type != TOKEN_COLON) {
         debugf("no : after case");
         return ERROR__UNEXPECTED;
       }
-      cursor_next();
+      cursor_next(pd);
       // nb. this doesn't parent a statement
 
       _STACK_END();
@@ -1778,11 +1926,11 @@ static int consume_statement(int mode) {
       int line_no = cursor->line_no;
 
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
 
       if (line_no == cursor->line_no && cursor->type != TOKEN_SEMICOLON) {
         _STACK_BEGIN(STACK__EXPR);
-        _check(consume_expr_zero_many(1));
+        _check(consume_expr_zero_many(pd, 1));
         _STACK_END();
       }
 
@@ -1793,7 +1941,7 @@ static int consume_statement(int mode) {
       _STACK_BEGIN(STACK__MISC);
 
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
 
       _STACK_END_SEMICOLON();
       return 0;
@@ -1804,13 +1952,13 @@ static int consume_statement(int mode) {
       int line_no = cursor->line_no;
 
       cursor->type = TOKEN_KEYWORD;
-      cursor_next();
+      cursor_next(pd);
 
       if (line_no == cursor->line_no) {
         if (cursor->type == TOKEN_LIT) {
           cursor->special = 0;
           cursor->type = TOKEN_LABEL;
-          cursor_next();
+          cursor_next(pd);
         }
       }
 
@@ -1818,7 +1966,7 @@ static int consume_statement(int mode) {
       return 0;
 
     case LIT_ASYNC:
-      blep_token_peek();
+      blep_token_peek(td);
       if (peek->special != LIT_FUNCTION) {
         break;  // only "async function" is a top-level function
       }
@@ -1826,25 +1974,25 @@ static int consume_statement(int mode) {
 
     case LIT_FUNCTION:
       if (!mode) {
-        return consume_expr_statement();
+        return consume_expr_statement(pd);
       }
-      return consume_function(SPECIAL__DECLARE | SPECIAL__CHANGE);
+      return consume_function(pd, SPECIAL__DECLARE | SPECIAL__CHANGE);
 
     case LIT_CLASS:
       if (!mode) {
-        return consume_expr_statement();
+        return consume_expr_statement(pd);
       }
-      return consume_class(SPECIAL__DECLARE | SPECIAL__CHANGE);
+      return consume_class(pd, SPECIAL__DECLARE | SPECIAL__CHANGE);
 
     case LIT_IMPORT:
       // if this is "import(" or "import.", treat as expr
-      blep_token_peek();
+      blep_token_peek(td);
       if (peek->type == TOKEN_PAREN || peek->special == MISC_DOT) {
-        return consume_expr_statement();
+        return consume_expr_statement(pd);
       }
       if (mode == STATEMENT__TOP) {
         _STACK_BEGIN(STACK__MODULE);
-        _check(consume_import());
+        _check(consume_import(pd));
         _STACK_END_SEMICOLON();
         return 0;
       }
@@ -1852,27 +2000,27 @@ static int consume_statement(int mode) {
 
     case LIT_EXPORT:
       if (mode == STATEMENT__TOP) {
-        return consume_export_wrap();
+        return consume_export_wrap(pd);
       }
       break;
   }
 
   if (!(cursor->special & _MASK_MASQUERADE)) {
-    if (blep_token_peek() == TOKEN_COLON) {
+    if (blep_token_peek(td) == TOKEN_COLON) {
       // nb. "await:" is invalid in async functions, but it's nonsensical anyway
       // we restart this function to parse as label
       cursor->special = 0;
       cursor->type = TOKEN_LABEL;
-      return consume_statement(0);
+      return consume_statement(pd, 0);
     }
   }
 
   if (cursor->special & _MASK_CONTROL) {
-    return consume_control();
+    return consume_control(pd);
   } else if (cursor->special & _MASK_DECL) {
-    return consume_decl_stack(0);
+    return consume_decl_stack(pd, 0);
   } else if (cursor->special & _MASK_UNARY_OP || !cursor->special) {
-    return consume_expr_statement();
+    return consume_expr_statement(pd);
   }
 
   // catches things like "enum", "protected", which are keywords but largely unhandled
@@ -1880,40 +2028,51 @@ static int consume_statement(int mode) {
   if (cursor->special & _MASK_KEYWORD) {
     _STACK_BEGIN(STACK__MISC);
     cursor->type = TOKEN_KEYWORD;
-    cursor_next();
+    cursor_next(pd);
     _STACK_END_SEMICOLON();
     return 0;
   }
 
-  return consume_expr_statement();
+  return consume_expr_statement(pd);
+}
+
+static int consume_statement(parserdef *pd, int mode) {
+  _nest(consume_statement_body(pd, mode));
 }
 
 EMSCRIPTEN_KEEPALIVE
-int blep_parser_init(char *p, int len) {
-  _check(blep_token_init(p, len));
-  parser_skip = 0;
+int blep_parser_init(parserdef *pd, char *p, int len) {
+  _check(blep_token_init(td, p, len));
+  pd->skip = 0;
+  pd->nest = 0;
+  pd->open = 0;
 
   if (p[0] == '#' && p[1] == '!') {
     td->at = memchr(p, '\n', td->end - p);
     if (td->at == NULL) {
       td->at = p + len;
     }
-    blep_token_peek();
+    blep_token_peek(td);
     peek->vp = p;
   }
 
-  blep_token_next();
+  blep_token_next(td);
   return 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
-int blep_parser_run() {
+int blep_parser_run(parserdef *pd) {
   if (cursor->type == TOKEN_EOF) {
-    return 0;
+    // the tokenizer ends early if brackets nest past its stack
+    return td->depth == td->stack_size ? ERROR__STACK : 0;
   }
   char *head = cursor->p;
 
-  _check(consume_statement(STATEMENT__TOP));
+  int ret = consume_statement(pd, STATEMENT__TOP);
+  if (ret < 0) {
+    // ... which is usually found part-way through a statement, as an unexpected EOF
+    return td->depth == td->stack_size ? ERROR__STACK : ret;
+  }
 
   int len = cursor->p - head;
   if (len == 0 && cursor->type != TOKEN_EOF) {
@@ -1924,6 +2083,15 @@ int blep_parser_run() {
 }
 
 EMSCRIPTEN_KEEPALIVE
-struct token *blep_parser_cursor() {
+statsdef *blep_stats(parserdef *pd) {
+#ifdef BLEP_STATS
+  return &(td->stats);
+#else
+  return NULL;
+#endif
+}
+
+EMSCRIPTEN_KEEPALIVE
+struct token *blep_parser_cursor(parserdef *pd) {
   return cursor;
 }
@@ -5,14 +5,50 @@
 #include "token.h"
 #include "def.h"
 
-int blep_parser_init(char *, int);
-int blep_parser_run();
-struct token *blep_parser_cursor();
+// statements and expressions (and so brackets) can't nest more than this, or ERROR__STACK is
+// returned: each level costs a few native stack frames (up to ~512 bytes natively at -O2), so
+// lower this if that stack is small
+#ifndef PARSER_NEST_MAX
+#define PARSER_NEST_MAX  1024
+#endif
+
+typedef struct {
+  tokendef td;  // tokenizer state, must be first
+  int skip;     // nonzero while inside a stack the client has skipped, or PARSER_SKIP_SCAN
+  int nest;     // nested statements and expressions being parsed, see PARSER_NEST_MAX
+  void *arg;    // for use by callbacks, never touched by the parser
+
+  // stacks opened (and not skipped) but not yet closed, with their types if they fit, so that an
+  // error can close them, see blep_recover_run
+  int open;
+  unsigned char opened[PARSER_NEST_MAX];
+} parserdef;
+
+// empty unless the parser is built into the including file, see parser-inline.h
+#ifndef BLEP_PARSER_API
+#define BLEP_PARSER_API
+#endif
+
+// all state is held in the passed parserdef, so any number of these can be in use at once
+BLEP_PARSER_API int blep_parser_init(parserdef *, char *, int);
+BLEP_PARSER_API int blep_parser_run(parserdef *);
+BLEP_PARSER_API struct token *blep_parser_cursor(parserdef *);
+
+// counters for the parse so far, reset by init, or NULL unless built with -DBLEP_STATS
+BLEP_PARSER_API statsdef *blep_stats(parserdef *);
+
+// returned by blep_parser_open to skip a stack, and within it skim over the bodies of functions and
+// classes by balancing brackets rather than parsing them. only dynamic "import(...)" is looked for
+// while scanning, and a plain string target is passed to blep_parser_callback as SPECIAL__EXTERNAL
+// (just as a full parse marks it). this is much faster, but lexing alone might mistake a regexp
+// for division (or the reverse) inside a body, so scanned bodies with unusual regexps can confuse
+// what follows.
+#define PARSER_SKIP_SCAN  2
 
 // below must be provided
 
-void blep_parser_callback();
-int blep_parser_open(int);
-void blep_parser_close(int);
+void blep_parser_callback(parserdef *);
+int blep_parser_open(parserdef *, int);
+void blep_parser_close(parserdef *, int);
 
-#endif//__BLEP_PARSER_H
\ No newline at end of file
+#endif//__BLEP_PARSER_H
@@ -0,0 +1,154 @@
+#include "recover.h"
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+// how t moves the tokenizer's bracket depth
+static inline int recover_delta(struct token *t) {
+  switch (t->type) {
+    case TOKEN_BRACE:
+    case TOKEN_ARRAY:
+    case TOKEN_PAREN:
+    case TOKEN_TERNARY:
+    case TOKEN_BLOCK:
+      return 1;
+
+    case TOKEN_CLOSE:
+      return -1;
+
+    case TOKEN_STRING: {
+      // templates open at "`...${" and close at "}...`"
+      int more = t->p[t->len - 1] == '{';
+      if (t->p[0] == '`') {
+        return more;
+      }
+      return t->p[0] == '}' ? more - 1 : 0;
+    }
+  }
+  return 0;
+}
+
+// brackets open before the cursor, allowing for a peeked token (the tokenizer's depth starts at 1)
+static inline int recover_depth(tokendef *td) {
+  int after = td->depth - (td->peek.p ? recover_delta(&(td->peek)) : 0);
+  return after - recover_delta(&(td->curr)) - 1;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_recover_init(recoverdef *rd, parserdef *pd, char *buf, recover_error *errors, int cap) {
+  rd->pd = pd;
+  rd->buf = buf;
+  rd->errors = errors;
+  rd->cap = cap;
+  rd->count = 0;
+  rd->inside = 0;
+}
+
+// steps over the byte at the cursor, where the tokenizer couldn't start a token (which is also how
+// it stops at a close with nothing open, passed on here as such)
+static void recover_step(parserdef *pd, int quiet) {
+  tokendef *td = &(pd->td);
+  struct token *t = &(td->curr);
+
+  if (*t->p == '}' || *t->p == ')' || *t->p == ']') {
+    t->type = TOKEN_CLOSE;
+    t->len = 1;
+    t->special = 0;
+    if (!quiet) {
+      blep_stat(td, callbacks, 1);
+      blep_parser_callback(pd);
+    }
+  }
+  td->ring__len = td->ring__pos;  // anything left to replay is this again
+  td->at = t->p + 1;
+}
+
+// as blep_token_next, but steps over anything that can't be lexed
+static int recover_next(parserdef *pd, int quiet) {
+  int ret;
+  while ((ret = blep_token_next(&(pd->td))) == ERROR__UNEXPECTED) {
+    recover_step(pd, quiet);
+  }
+  return ret;
+}
+
+static void recover_note(recoverdef *rd, int ret, int depth) {
+  parserdef *pd = rd->pd;
+  if (rd->count < rd->cap) {
+    int open = pd->open < PARSER_NEST_MAX ? pd->open : PARSER_NEST_MAX;
+    recover_error *e = rd->errors + rd->count;
+    e->ret = ret;
+    e->at = pd->td.curr.p - rd->buf;
+    e->stack = open ? pd->opened[open - 1] : 0;
+    e->depth = depth;
+  }
+  ++rd->count;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_recover_run(recoverdef *rd) {
+  parserdef *pd = rd->pd;
+  tokendef *td = &(pd->td);
+  struct token *t = &(td->curr);
+  char *head = t->p;
+
+  int ret = blep_parser_run(pd);
+  if (ret > 0 || (!ret && t->p == td->end)) {
+    return ret;
+  } else if (t->type == TOKEN_EOF && td->depth == td->stack_size) {
+    return ERROR__STACK;  // the tokenizer gave up, so there's nothing left to find
+  }
+
+  if (!ret) {
+    // the tokenizer stopped as if at the end
+    recover_note(rd, *t->p == '}' || *t->p == ')' || *t->p == ']' ? ERROR__STACK : ERROR__UNEXPECTED, 0);
+    recover_step(pd, 0);
+    recover_next(pd, 0);
+    return t->p - head;
+  }
+
+  // if statements were resumed inside brackets, closing them isn't another error
+  int depth = recover_depth(td);
+  if (!(t->p == head && t->type == TOKEN_CLOSE && depth > 0 && depth <= rd->inside)) {
+    recover_note(rd, ret, depth);
+  }
+
+  // anything the client skipped stays skipped, but lookahead would have been passed on
+  int quiet = pd->skip && !td->restore__at;
+  if (td->restore__at) {
+    blep_token_restore(td);
+  }
+  pd->skip = 0;
+
+  for (int i = (pd->open < PARSER_NEST_MAX ? pd->open : PARSER_NEST_MAX) - 1; i >= 0; --i) {
+    blep_stat(td, closes, 1);
+    blep_parser_close(pd, pd->opened[i]);
+  }
+  pd->open = 0;
+
+  // pass tokens on until a boundary no deeper than here, always moving past at least one
+  int floor = recover_depth(td);
+  int before = floor;
+  while (t->type != TOKEN_EOF) {
+    int type = t->type;
+    int brace = type == TOKEN_CLOSE && t->p[0] == '}';
+    int line_no = t->line_no;
+
+    if (!quiet) {
+      blep_stat(td, callbacks, 1);
+      blep_parser_callback(pd);
+    }
+    recover_next(pd, quiet);
+
+    before = recover_depth(td);  // nothing is peeked now
+    if (before <= floor && (type == TOKEN_SEMICOLON || brace || t->line_no != line_no)) {
+      break;
+    }
+  }
+
+  rd->inside = before;
+  return t->p - head;
+}
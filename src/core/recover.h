@@ -0,0 +1,36 @@
+
+#ifndef __BLEP_RECOVER_H
+#define __BLEP_RECOVER_H
+
+#include "parser.h"
+
+// An error found by blep_recover_run, which keeps parsing after it.
+typedef struct {
+  int ret;    // ERROR__... as returned by blep_parser_run
+  int at;     // offset of the token the parser stopped at
+  int stack;  // type of the innermost stack open there, or zero if none
+  int depth;  // brackets open before that token
+} recover_error;
+
+// Parses input in one pass even if it has errors, recording them into caller-provided storage.
+// After an error, every open stack is closed and tokens are passed to blep_parser_callback as they
+// were lexed (not retyped by the parser) until a statement boundary which is no deeper in brackets
+// than the error: after a ";" or "}", or where a new line starts. Statements are then parsed from
+// there, even if that's inside brackets, where a stray close later is skipped but not an error.
+typedef struct {
+  parserdef *pd;
+  char *buf;
+  recover_error *errors;
+  int cap;
+  int count;   // errors found, which might be more than cap
+  int inside;  // brackets open where statements were last resumed, so closes might be stray
+} recoverdef;
+
+// the parser must already be set up over buf, via blep_parser_init
+void blep_recover_init(recoverdef *, parserdef *, char *buf, recover_error *errors, int cap);
+
+// as blep_parser_run, but only returns an error if it can't be recovered from (the tokenizer ran
+// out of stack)
+int blep_recover_run(recoverdef *);
+
+#endif//__BLEP_RECOVER_H
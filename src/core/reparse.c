@@ -0,0 +1,238 @@
+#include "reparse.h"
+#include <string.h>
+#include <strings.h>
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+// a token's end is found by reading just past it, and ops may look a few bytes further again
+#define REPARSE_MARGIN  3
+
+static inline void reparse_shift_token(struct token *t, long delta, int lines) {
+  if (t->p) {
+    t->vp += delta;
+    t->p += delta;
+    t->line_no += lines;
+  }
+}
+
+static inline int reparse_same_token(struct token *old, struct token *t, long delta) {
+  if (!old->p || !t->p) {
+    return !old->p && !t->p;
+  }
+  return old->vp + delta == t->vp && old->p + delta == t->p && old->len == t->len &&
+      old->type == t->type && old->special == t->special;
+}
+
+// nb. empty tokens are only found in invalid input, and might already have been passed to the last
+// statement
+int blep_reparse_can_save(parserdef *pd) {
+  tokendef *td = &(pd->td);
+  return !pd->skip && !td->restore__at && td->ring__pos == td->ring__len &&
+      td->depth < REPARSE_STACK && td->curr.len;
+}
+
+void blep_reparse_save(reparse_point *rp, tokendef *td, int statement) {
+  rp->statement = statement;
+  memcpy(&(rp->curr), &(td->curr), sizeof(struct token));
+  memcpy(&(rp->peek), &(td->peek), sizeof(struct token));
+  rp->at = td->at;
+  rp->line_no = td->line_no;
+  rp->depth = td->depth;
+
+  // nb. the slot at depth isn't part of the stack, but is read when lexing semicolons
+  memcpy(rp->stack, td->stack, sizeof(int) * (td->depth + 1));
+}
+
+void blep_reparse_load(reparse_point *rp, parserdef *pd, char *end) {
+  tokendef *td = &(pd->td);
+  blep_token_init(td, rp->at, end - rp->at);
+
+  memcpy(&(td->curr), &(rp->curr), sizeof(struct token));
+  memcpy(&(td->peek), &(rp->peek), sizeof(struct token));
+  td->line_no = rp->line_no;
+  td->depth = rp->depth;
+  memcpy(td->stack, rp->stack, sizeof(int) * (rp->depth + 1));
+  pd->skip = 0;
+  pd->nest = 0;
+  pd->open = 0;
+}
+
+int blep_reparse_matches(reparse_point *old, tokendef *td, long delta) {
+  return reparse_same_token(&(old->curr), &(td->curr), delta) &&
+      reparse_same_token(&(old->peek), &(td->peek), delta) &&
+      old->at + delta == td->at && old->depth == td->depth &&
+      !memcmp(old->stack, td->stack, sizeof(int) * td->depth);
+}
+
+// parses from the current state (with start already set), recording points from index w. old holds
+// points from before the edit, at the end of rd->points, which are matched against to stop early.
+static int reparse_loop(reparsedef *rd, int w, int statement, reparse_point *old, int old_count,
+    char *edit_end, long delta) {
+  parserdef *pd = rd->pd;
+  tokendef *td = &(pd->td);
+  int i = 0;
+
+  rd->first = statement;
+
+  for (;;) {
+    int can_save = blep_reparse_can_save(pd);
+
+    if (can_save) {
+      // skip old points which can't line up, as they're within the edit or now behind
+      while (i < old_count && (old[i].curr.vp < edit_end || old[i].curr.vp + delta < td->curr.vp)) {
+        ++i;
+      }
+
+      if (i < old_count && blep_reparse_matches(&(old[i]), td, delta)) {
+        // the rest is unchanged, so keep its points, shifted into place
+        int lines = td->curr.line_no - old[i].curr.line_no;
+        int statements = statement - old[i].statement;
+        int keep = old_count - i;
+        memmove(rd->points + w, old + i, sizeof(reparse_point) * keep);
+
+        for (reparse_point *rp = rd->points + w; rp < rd->points + w + keep; ++rp) {
+          rp->statement += statements;
+          reparse_shift_token(&(rp->curr), delta, lines);
+          reparse_shift_token(&(rp->peek), delta, lines);
+          rp->at += delta;
+          rp->line_no += lines;
+        }
+
+        rd->count = w + keep;
+        rd->removed = old[i].statement - rd->first;
+        rd->added = statement - rd->first;
+        rd->statements += statements;
+        rd->end = td->curr.p - rd->buf;
+        return 0;
+      }
+
+      // don't write over old points which haven't yet been checked
+      if (rd->points + w < old + i) {
+        blep_reparse_save(rd->points + w, td, statement);
+        ++w;
+      }
+    }
+
+    int ret = blep_parser_run(pd);
+    if (ret <= 0) {
+      rd->count = w;
+      rd->removed = rd->statements - rd->first;
+      rd->added = statement - rd->first;
+      rd->statements = statement;
+      rd->end = rd->len;
+      rd->error = ret;
+      return ret;
+    }
+    ++statement;
+  }
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_reparse_init(reparsedef *rd, parserdef *pd, reparse_point *points, int cap) {
+  bzero(rd, sizeof(reparsedef));
+  rd->pd = pd;
+  rd->points = points;
+  rd->cap = cap;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_reparse_stack(reparsedef *rd, int *arena, int size) {
+  rd->arena = arena;
+  rd->arena_size = size;
+}
+
+// moves the stack just set up (by init or a point) into the arena, if there is one
+static inline int reparse_use_stack(reparsedef *rd) {
+  return rd->arena ? blep_token_stack(&(rd->pd->td), rd->arena, rd->arena_size) : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void blep_reparse_points(reparsedef *rd, reparse_point *points, int cap) {
+  rd->points = points;
+  rd->cap = cap;
+  if (rd->count > cap) {
+    rd->count = cap;
+  }
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_reparse_run(reparsedef *rd, char *buf, int len) {
+  rd->buf = buf;
+  rd->len = len;
+  rd->count = 0;
+  rd->statements = 0;
+  rd->start = 0;
+  rd->error = 0;
+
+  int ret = blep_parser_init(rd->pd, buf, len);
+  if (ret < 0 || (ret = reparse_use_stack(rd))) {
+    return ret;
+  }
+  ret = reparse_loop(rd, 0, 0, rd->points + rd->cap, 0, NULL, 0);
+  return ret < 0 ? ret : rd->statements;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_reparse_edit(reparsedef *rd, char *buf, int len, int at, int deleted, int inserted) {
+  if (buf[len]) {
+    return ERROR__UNEXPECTED;
+  }
+
+  // points before the edit are still valid, but may need to follow buf
+  long moved = buf - rd->buf;
+  if (moved) {
+    for (reparse_point *rp = rd->points; rp < rd->points + rd->count; ++rp) {
+      reparse_shift_token(&(rp->curr), moved, 0);
+      reparse_shift_token(&(rp->peek), moved, 0);
+      rp->at += moved;
+    }
+    rd->buf = buf;
+  }
+  rd->len = len;
+
+  // find the last point whose state didn't look at the edited bytes
+  int lo = 0, hi = rd->count;
+  while (lo < hi) {
+    int mid = (lo + hi) >> 1;
+    if (rd->points[mid].at - buf + REPARSE_MARGIN < at) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  int r = lo - 1;
+
+  // move points from the restart on to the end, so new points can be written before them. if the
+  // last parse failed, parse up to the same error (or beyond) rather than lining up before it.
+  int old_count = rd->error ? 0 : rd->count - (r < 0 ? 0 : r);
+  reparse_point *old = rd->points + rd->cap - old_count;
+  memmove(old, rd->points + rd->count - old_count, sizeof(reparse_point) * old_count);
+
+  int statement = 0;
+  rd->start = 0;
+  if (r < 0) {
+    int ret = blep_parser_init(rd->pd, buf, len);
+    if (ret >= 0) {
+      ret = reparse_use_stack(rd);
+    }
+    if (ret < 0) {
+      rd->count = 0;
+      rd->end = len;
+      rd->error = ret;
+      return ret;
+    }
+    r = 0;
+  } else {
+    reparse_point *from = old_count ? old : rd->points + r;
+    blep_reparse_load(from, rd->pd, buf + len);
+    reparse_use_stack(rd);  // can't fail, as points are shallow
+    statement = from->statement;
+    rd->start = from->curr.p - buf;
+  }
+
+  return reparse_loop(rd, r, statement, old, old_count, buf + at + deleted, inserted - deleted);
+}
@@ -0,0 +1,73 @@
+#ifndef __BLEP_REPARSE_H
+#define __BLEP_REPARSE_H
+
+#include "parser.h"
+
+#define REPARSE_STACK  8
+
+// Tokenizer state at the start of a top-level statement, enough to parse again from there. Only
+// recorded where no lookahead is pending and the stack is shallow, so not every statement has one.
+typedef struct {
+  int statement;  // index of the statement starting here
+  struct token curr;
+  struct token peek;
+  char *at;
+  int line_no;
+  int depth;
+  int stack[REPARSE_STACK];
+} reparse_point;
+
+// Parses input once, then again after each edit, but only from the statement before the edit up to
+// where the statements line up with those parsed before. Callbacks are made just for the parsed
+// statements. The caller owns both the input and storage for points.
+typedef struct {
+  parserdef *pd;
+  char *buf;
+  int len;
+  reparse_point *points;
+  int cap;
+  int count;
+  int statements;
+  int error;  // from the last parse, which stopped there
+
+  // after blep_reparse_edit, what was parsed again: callbacks covered tokens from start up to end
+  // in the new input, replacing those between the same offsets before (shifted by the edit if after
+  // it). on error, end is len, as nothing after start is known.
+  int first;    // index of the first statement parsed
+  int removed;  // number of old statements replaced
+  int added;    // number of new statements in their place
+  int start;
+  int end;
+
+  int *arena;  // if set, see blep_reparse_stack
+  int arena_size;
+} reparsedef;
+
+void blep_reparse_init(reparsedef *, parserdef *, reparse_point *, int);
+
+// gives every parse a bigger stack, as per blep_token_stack (so arena holds 2 * size ints), both
+// from the start and from a point. call after init. points are still only saved while shallow.
+void blep_reparse_stack(reparsedef *, int *arena, int size);
+
+// the points have been moved or resized, e.g. via realloc(), and must hold the same contents
+void blep_reparse_points(reparsedef *, reparse_point *, int);
+
+// whether the parser is between top-level statements, and its state can be saved as a point
+int blep_reparse_can_save(parserdef *);
+void blep_reparse_save(reparse_point *, tokendef *, int statement);
+
+// loads a point, with input ending at end (which must point to NULL), using the built-in stack
+void blep_reparse_load(reparse_point *, parserdef *, char *end);
+
+// whether the point (if shifted by delta) holds the same state as td, ignoring line numbers
+int blep_reparse_matches(reparse_point *, tokendef *, long delta);
+
+// parses all of buf (which must have a NULL at buf[len]), returning the number of statements or
+// ERROR__... on error
+int blep_reparse_run(reparsedef *, char *, int);
+
+// buf now holds the input with deleted bytes at offset at replaced by inserted bytes, and may have
+// moved. returns 0 or ERROR__... on error
+int blep_reparse_edit(reparsedef *, char *, int, int at, int deleted, int inserted);
+
+#endif//__BLEP_REPARSE_H
@@ -0,0 +1,71 @@
+#include "rewrite.h"
+#include "unescape.h"
+#include <string.h>
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+void blep_rewrite_init(rewritedef *rd, char *buf, int len, rewrite_span *spans, int cap, char *values) {
+  rd->buf = buf;
+  rd->len = len;
+  rd->spans = spans;
+  rd->count = 0;
+  rd->cap = cap;
+  rd->values = values;
+  rd->values_len = 0;
+}
+
+int blep_rewrite_token(rewritedef *rd, struct token *t) {
+  if (t->type != TOKEN_STRING || t->special != SPECIAL__EXTERNAL) {
+    return 0;
+  }
+  if (rd->count == rd->cap) {
+    return ERROR__INTERNAL;
+  }
+
+  rewrite_span *s = rd->spans + rd->count++;
+  s->at = t->p - rd->buf;
+  s->len = t->len;
+  s->replace = 0;
+  s->replace_len = -1;
+
+  char *out = rd->values + rd->values_len;
+  int ret = blep_unescape(t->p, t->len, out);
+  if (ret == UNESCAPE__RAW) {
+    ret = t->len - 2;
+    memcpy(out, t->p + 1, ret);
+  } else if (ret < 0) {
+    s->value = -1;
+    s->value_len = 0;
+    return 0;
+  }
+
+  s->value = rd->values_len;
+  s->value_len = ret;
+  rd->values_len += ret;
+  return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_rewrite_emit(rewritedef *rd, char *replacements, char *out) {
+  char *start = out;
+  int from = 0;
+
+  for (rewrite_span *s = rd->spans; s < rd->spans + rd->count; ++s) {
+    if (s->replace_len < 0) {
+      continue;
+    }
+    memcpy(out, rd->buf + from, s->at - from);
+    out += s->at - from;
+    memcpy(out, replacements + s->replace, s->replace_len);
+    out += s->replace_len;
+    from = s->at + s->len;
+  }
+
+  memcpy(out, rd->buf + from, rd->len - from);
+  out += rd->len - from;
+  return out - start;
+}
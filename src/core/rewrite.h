@@ -0,0 +1,42 @@
+
+#ifndef __BLEP_REWRITE_H
+#define __BLEP_REWRITE_H
+
+#include "token.h"
+#include "def.h"
+
+// every external string follows its own "from" or "import", so a source of len bytes has at most
+// len / REWRITE_SPAN_BYTES + 1 of them
+#define REWRITE_SPAN_BYTES  6
+
+// an external string found during a parse: the caller fills in replace and replace_len
+typedef struct {
+  int at;           // of the token (including quotes), relative to buf
+  int len;
+  int value;        // decoded value relative to values, or -1 if it isn't valid UTF-8
+  int value_len;
+  int replace;      // replacement relative to the buffer passed to emit, used if replace_len >= 0
+  int replace_len;
+} rewrite_span;
+
+typedef struct {
+  char *buf;
+  int len;
+  rewrite_span *spans;
+  int count;
+  int cap;
+  char *values;     // needs room for len bytes, as values are never longer than their tokens
+  int values_len;
+} rewritedef;
+
+void blep_rewrite_init(rewritedef *, char *buf, int len, rewrite_span *spans, int cap, char *values);
+
+// records the current token if it's an external string (call from blep_parser_callback), returning
+// ERROR__INTERNAL if spans are full
+int blep_rewrite_token(rewritedef *, struct token *);
+
+// writes buf to out with every replacement made, in one pass, returning the length written. out
+// needs room for len plus the replacements, less the tokens they replace.
+int blep_rewrite_emit(rewritedef *, char *replacements, char *out);
+
+#endif//__BLEP_REWRITE_H
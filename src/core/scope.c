@@ -0,0 +1,267 @@
+#include "scope.h"
+#include "../tokens/helper.h"
+#include "../tokens/lit.h"
+#include <string.h>
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+#define SCOPE_RECORD_SIZE \
+  (sizeof(scope_entry) + sizeof(scope_binding) + sizeof(scope_global) + sizeof(scope_ref))
+
+static inline int *scope_bucket(scopedef *sd, int scope, unsigned hash) {
+  return sd->bindings_table + ((hash ^ (scope * 2654435761u)) & (SCOPE_TABLE_SIZE - 1));
+}
+
+static int scope_lookup(scopedef *sd, int scope, char *p, int len, unsigned hash) {
+  int b = *scope_bucket(sd, scope, hash);
+  while (b >= 0) {
+    scope_binding *sb = sd->bindings + b;
+    if (sb->scope == scope && sb->len == len && !memcmp(sd->buf + sb->at, p, len)) {
+      return b;
+    }
+    b = sb->next;
+  }
+  return -1;
+}
+
+void blep_scope_init(scopedef *sd, char *buf, int len, void *arena, int size) {
+  int cap = size / SCOPE_RECORD_SIZE;
+  char *at = arena;
+
+  sd->buf = buf;
+  sd->scopes = (scope_entry *) at;
+  at += sizeof(scope_entry) * cap;
+  sd->bindings = (scope_binding *) at;
+  at += sizeof(scope_binding) * cap;
+  sd->globals = (scope_global *) at;
+  at += sizeof(scope_global) * cap;
+  sd->refs = (scope_ref *) at;
+  sd->cap = cap;
+
+  sd->bindings_count = 0;
+  sd->globals_count = 0;
+  sd->refs_count = 0;
+  sd->len = len;
+  sd->current = 0;
+  sd->module = 0;
+  sd->last = 0;
+  sd->error = cap ? 0 : SCOPE__FULL;
+  memset(sd->bindings_table, 0xff, sizeof(sd->bindings_table));
+  memset(sd->globals_table, 0xff, sizeof(sd->globals_table));
+
+  // while open, a scope's end holds the first reference made within it
+  sd->scopes_count = cap ? 1 : 0;
+  if (cap) {
+    scope_entry *s = sd->scopes;
+    s->parent = -1;
+    s->kind = SCOPE_KIND_MODULE;
+    s->start = 0;
+    s->end = 0;
+  }
+}
+
+static void scope_declare(scopedef *sd, struct token *t) {
+  int scope = sd->current;
+  if (t->special & SPECIAL__TOP) {
+    while (sd->scopes[scope].kind == SCOPE_KIND_BLOCK) {
+      scope = sd->scopes[scope].parent;
+    }
+  }
+
+  int special = t->special;
+  if (sd->module) {
+    special |= SCOPE__IMPORT;
+  } else if (special & (SPECIAL__EXTERNAL | SPECIAL__DEFAULT)) {
+    special |= SCOPE__EXPORT;
+  }
+
+  unsigned hash = t->hash;
+  int b = scope_lookup(sd, scope, t->p, t->len, hash);
+  if (b >= 0) {
+    sd->bindings[b].special |= special;  // declared again, e.g. "var x; var x;"
+    return;
+  } else if (sd->bindings_count == sd->cap) {
+    sd->error = SCOPE__FULL;
+    return;
+  }
+
+  int *bucket = scope_bucket(sd, scope, hash);
+  scope_binding *sb = sd->bindings + sd->bindings_count;
+  sb->at = t->p - sd->buf;
+  sb->len = t->len;
+  sb->scope = scope;
+  sb->special = special;
+  sb->refs = 0;
+  sb->next = *bucket;
+  *bucket = sd->bindings_count++;
+}
+
+// the parser passes these as symbols, but they never name a binding
+static int scope_reserved(struct token *t) {
+  uint32_t lit = 0;
+  if (consume_known_lit(t->p, &lit) != t->len) {
+    return 0;
+  }
+  switch (lit) {
+    case LIT_THIS:
+    case LIT_SUPER:
+    case LIT_NULL:
+    case LIT_TRUE:
+    case LIT_FALSE:
+    case LIT_NEW:     // "new.target"
+    case LIT_IMPORT:  // "import.meta"
+      return 1;
+  }
+  return 0;
+}
+
+void blep_scope_token(scopedef *sd, struct token *t) {
+  sd->last = t->p + t->len - sd->buf;
+  if (t->type != TOKEN_SYMBOL || sd->error) {
+    return;
+  }
+
+  if (t->special & SPECIAL__DECLARE) {
+    scope_declare(sd, t);
+    return;
+  } else if (scope_reserved(t)) {
+    return;
+  } else if (sd->refs_count == sd->cap) {
+    sd->error = SCOPE__FULL;
+    return;
+  }
+
+  scope_ref *r = sd->refs + sd->refs_count++;
+  r->at = t->p - sd->buf;
+  r->len = t->len;
+  r->hash = t->hash;
+  r->special = sd->module ? SCOPE__EXPORT : 0;
+}
+
+void blep_scope_open(scopedef *sd, int type, struct token *t) {
+  int kind;
+  switch (type) {
+    case STACK__MODULE:
+      ++sd->module;
+      return;
+
+    case STACK__INNER:
+      kind = SCOPE_KIND_FUNCTION;
+      break;
+
+    case STACK__BLOCK:
+    case STACK__CONTROL:
+      kind = SCOPE_KIND_BLOCK;
+      break;
+
+    default:
+      return;
+  }
+
+  if (sd->error) {
+    return;
+  } else if (sd->scopes_count == sd->cap) {
+    sd->error = SCOPE__FULL;
+    return;
+  }
+
+  scope_entry *s = sd->scopes + sd->scopes_count;
+  s->parent = sd->current;
+  s->kind = kind;
+  s->start = t->p - sd->buf;
+  s->end = sd->refs_count;
+  sd->current = sd->scopes_count++;
+}
+
+// resolves references made within the current scope against its bindings, leaving the rest
+static void scope_resolve(scopedef *sd) {
+  int scope = sd->current;
+  int w = sd->scopes[scope].end;
+
+  for (int i = w; i < sd->refs_count; ++i) {
+    scope_ref *r = sd->refs + i;
+    int b = scope_lookup(sd, scope, sd->buf + r->at, r->len, r->hash);
+    if (b < 0) {
+      sd->refs[w++] = *r;
+      continue;
+    }
+    ++sd->bindings[b].refs;
+    sd->bindings[b].special |= r->special;
+  }
+
+  sd->refs_count = w;
+}
+
+void blep_scope_close(scopedef *sd, int type) {
+  switch (type) {
+    case STACK__MODULE:
+      --sd->module;
+      return;
+
+    case STACK__INNER:
+    case STACK__BLOCK:
+    case STACK__CONTROL:
+      break;
+
+    default:
+      return;
+  }
+
+  if (sd->error) {
+    return;
+  }
+  scope_resolve(sd);
+
+  scope_entry *s = sd->scopes + sd->current;
+  s->end = sd->last;
+  sd->current = s->parent;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_scope_finish(scopedef *sd) {
+  if (sd->error) {
+    return sd->error;
+  }
+
+  // scopes left open by an error are closed where it stopped
+  while (sd->current) {
+    scope_resolve(sd);
+    sd->scopes[sd->current].end = sd->last;
+    sd->current = sd->scopes[sd->current].parent;
+  }
+  scope_resolve(sd);
+  sd->scopes[0].end = sd->len;
+
+  for (int i = 0; i < sd->refs_count; ++i) {
+    scope_ref *r = sd->refs + i;
+    int *bucket = sd->globals_table + (r->hash & (SCOPE_TABLE_SIZE - 1));
+
+    int g = *bucket;
+    while (g >= 0) {
+      scope_global *sg = sd->globals + g;
+      if (sg->len == r->len && !memcmp(sd->buf + sg->at, sd->buf + r->at, r->len)) {
+        break;
+      }
+      g = sg->next;
+    }
+
+    if (g >= 0) {
+      ++sd->globals[g].refs;
+      continue;
+    }
+
+    // nb. can't fill, as there are at most as many globals as references
+    scope_global *sg = sd->globals + sd->globals_count;
+    sg->at = r->at;
+    sg->len = r->len;
+    sg->refs = 1;
+    sg->next = *bucket;
+    *bucket = sd->globals_count++;
+  }
+  sd->refs_count = 0;
+  return 0;
+}
@@ -0,0 +1,93 @@
+
+#ifndef __BLEP_SCOPE_H
+#define __BLEP_SCOPE_H
+
+#include "token.h"
+#include "def.h"
+
+// Builds a table of scopes and their bindings from a full parse (nothing skipped), via calls from
+// blep_parser_callback, blep_parser_open and blep_parser_close. Everything is placed in a flat arena
+// passed to init, and names are offsets into the source.
+
+#define SCOPE_KIND_MODULE    0  // always scope zero
+#define SCOPE_KIND_FUNCTION  1  // STACK__INNER, holding params and var-like declarations
+#define SCOPE_KIND_BLOCK     2  // STACK__BLOCK or STACK__CONTROL
+
+// added to a binding's special, as import and export bindings both have SPECIAL__EXTERNAL
+#define SCOPE__IMPORT  (1 << 28)
+#define SCOPE__EXPORT  (1 << 29)  // declared by export, or exported later via "export {...}"
+
+#define SCOPE__FULL  -7  // the arena is full, so everything after this point is missing
+
+// chains in both tables are walked per lookup, so this should be larger for huge files
+#define SCOPE_TABLE_BITS  12
+#define SCOPE_TABLE_SIZE  (1 << SCOPE_TABLE_BITS)
+
+typedef struct {
+  int parent;  // -1 for the module
+  int kind;
+  int start;   // byte range, from the token opening the stack to the end of the last within it
+  int end;
+} scope_entry;
+
+typedef struct {
+  int at;       // name
+  int len;
+  int scope;
+  int special;  // all specials the name was declared with, plus SCOPE__IMPORT or SCOPE__EXPORT
+  int refs;     // references resolved to this binding
+  int next;     // next binding in its table bucket, or -1
+} scope_binding;
+
+// a name referenced but never declared, interned by hash
+typedef struct {
+  int at;  // first reference
+  int len;
+  int refs;
+  int next;
+} scope_global;
+
+// a reference not yet resolved, as later declarations may be hoisted or lexical (for scopes
+// further out)
+typedef struct {
+  int at;
+  int len;
+  unsigned hash;
+  int special;  // SCOPE__EXPORT if part of "export {...}"
+} scope_ref;
+
+typedef struct {
+  char *buf;
+
+  scope_entry *scopes;
+  int scopes_count;
+  scope_binding *bindings;
+  int bindings_count;
+  scope_global *globals;
+  int globals_count;
+  scope_ref *refs;
+  int refs_count;
+  int cap;  // of each of the above
+
+  int len;
+  int current;  // innermost open scope
+  int module;   // nonzero within STACK__MODULE
+  int last;     // end of the last token
+  int error;
+
+  int bindings_table[SCOPE_TABLE_SIZE];
+  int globals_table[SCOPE_TABLE_SIZE];
+} scopedef;
+
+// splits arena (size bytes, 4-byte aligned) into equal counts of each record
+void blep_scope_init(scopedef *, char *buf, int len, void *arena, int size);
+
+void blep_scope_token(scopedef *, struct token *);
+void blep_scope_open(scopedef *, int type, struct token *);
+void blep_scope_close(scopedef *, int type);
+
+// closes the module scope, interning references left over as globals. returns SCOPE__FULL if the
+// arena filled at any point, or zero.
+int blep_scope_finish(scopedef *);
+
+#endif//__BLEP_SCOPE_H
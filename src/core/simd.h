@@ -0,0 +1,100 @@
+
+#ifndef __BLEP_SIMD_H
+#define __BLEP_SIMD_H
+
+#include <stdint.h>
+
+// Minimal 16-byte vector helpers for the tokenizer's scanning loops. Build with -DSCALAR to use
+// the byte-at-a-time paths only.
+//
+// Loads are 16-byte aligned, or unaligned only where they can't cross a 4k boundary. Neither can
+// straddle a page (or the end of Web Assembly memory), so reading the whole block holding the
+// trailing NUL is always safe, although bytes beyond it may be garbage and must be ignored. The
+// same goes for the 16-byte probe in consume_known_lit (tokens/helper.c). AddressSanitizer still
+// reports these reads as overflows, so building with it implies SCALAR.
+//
+// Masks have 1 << VEC_SHIFT bits per byte, as NEON has no cheap single-bit movemask.
+
+#if defined(__SANITIZE_ADDRESS__) && !defined(SCALAR)
+#define SCALAR
+#elif defined(__has_feature) && !defined(SCALAR)
+#if __has_feature(address_sanitizer)
+#define SCALAR
+#endif
+#endif
+
+#if !defined(SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#define BLEP_SIMD
+#define VEC_SHIFT 0
+typedef __m128i vec_t;
+
+#define vec_load(p)   _mm_load_si128((const __m128i *) (p))
+#define vec_loadu(p)  _mm_loadu_si128((const __m128i *) (p))
+#define vec_eq(v, c)  _mm_cmpeq_epi8((v), _mm_set1_epi8(c))
+#define vec_or(a, b)  _mm_or_si128((a), (b))
+#define vec_mask(v)   ((uint64_t) _mm_movemask_epi8(v))
+
+// bytes where lo <= v <= hi (unsigned), via v - lo <= hi - lo
+static inline vec_t vec_range(vec_t v, unsigned char lo, unsigned char hi) {
+  vec_t x = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(hi - lo)), x);
+}
+
+#elif !defined(SCALAR) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BLEP_SIMD
+#define VEC_SHIFT 2
+typedef uint8x16_t vec_t;
+
+#define vec_load(p)   vld1q_u8((const uint8_t *) (p))
+#define vec_loadu(p)  vec_load(p)
+#define vec_eq(v, c)  vceqq_u8((v), vdupq_n_u8(c))
+#define vec_or(a, b)  vorrq_u8((a), (b))
+#define vec_range(v, lo, hi) \
+    vcleq_u8(vsubq_u8((v), vdupq_n_u8(lo)), vdupq_n_u8((hi) - (lo)))
+
+// narrows each 0x00/0xff byte to a nibble
+static inline uint64_t vec_mask(vec_t v) {
+  uint8x8_t res = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(res), 0);
+}
+
+#elif !defined(SCALAR) && defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define BLEP_SIMD
+#define VEC_SHIFT 0
+typedef v128_t vec_t;
+
+#define vec_load(p)   wasm_v128_load(p)
+#define vec_loadu(p)  vec_load(p)
+#define vec_eq(v, c)  wasm_i8x16_eq((v), wasm_i8x16_splat(c))
+#define vec_or(a, b)  wasm_v128_or((a), (b))
+#define vec_range(v, lo, hi) \
+    wasm_u8x16_le(wasm_i8x16_sub((v), wasm_i8x16_splat(lo)), wasm_i8x16_splat((hi) - (lo)))
+#define vec_mask(v)   ((uint64_t) wasm_i8x16_bitmask(v))
+
+#endif
+
+#ifdef BLEP_SIMD
+
+#define VEC_SIZE  16
+#define VEC_FULL  (VEC_SHIFT ? ~(uint64_t) 0 : (uint64_t) 0xffff)
+
+#define vec_align(p)  ((char *) ((uintptr_t) (p) & ~(uintptr_t) (VEC_SIZE - 1)))
+#define vec_index(m)  (__builtin_ctzll(m) >> VEC_SHIFT)
+#define vec_count(m)  (__builtin_popcountll(m) >> VEC_SHIFT)
+
+// mask of the first n bytes of a block
+static inline uint64_t vec_before(long n) {
+  if (n <= 0) {
+    return 0;
+  } else if (n >= VEC_SIZE) {
+    return VEC_FULL;
+  }
+  return ((uint64_t) 1 << (n << VEC_SHIFT)) - 1;
+}
+
+#endif
+
+#endif//__BLEP_SIMD_H
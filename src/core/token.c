@@ -3,15 +3,12 @@
 #include <strings.h>
 #include <ctype.h>
 #include "token.h"
+#include "simd.h"
 
 #include "../tokens/helper.c"
 
 #include "token-tables.h"
 
-#ifndef EMSCRIPTEN
-tokendef _td;
-#endif
-
 #ifndef NULL
 #define NULL ((char*)0)
 #endif
@@ -24,13 +21,16 @@ tokendef _td;
 #endif
 
 
-int blep_token_init(char *p, int len) {
-  bzero(td, sizeof(tokendef));
+int blep_token_init(tokendef *td, char *p, int len) {
+  bzero(td, __builtin_offsetof(tokendef, ring));  // the ring is only read once written
 
   td->at = p;
   td->end = p + len;
   td->line_no = 1;
   td->depth = 1;
+  td->stack_size = STACK_SIZE;
+  td->stack = td->stack__inline;
+  td->open_at = td->open_at__inline;
 
   // sanity-check td->end is NULL
   if (len < 0 || td->end[0]) {
@@ -41,8 +41,171 @@ int blep_token_init(char *p, int len) {
   return 0;
 }
 
+// With BLEP_NO_LINES, newlines aren't counted, just whether there were any in each void or block:
+// line_no then only tells tokens on different lines apart, which is all the parser needs. Find
+// real lines with blep_lines_index instead.
+#ifdef BLEP_NO_LINES
+#define vec_lines(m)    ((m) != 0)
+#define void_lines(n)   ((n) != 0)
+#else
+#define vec_lines(m)    vec_count(m)
+#define void_lines(n)   (n)
+#endif
+
+#ifdef BLEP_SIMD
+
+// finds the first of a, b, c, d or NUL at or after p, counting any newlines before it
+static inline char *blepi_scan(char *p, char a, char b, char c, char d, int *line_no) {
+  // most bodies are short: check a few bytes before setting up vectors
+  for (char *short_end = p + 8; p < short_end; ++p) {
+    char x = *p;
+    if (x == a || x == b || x == c || x == d || !x) {
+      return p;
+    } else if (line_no && x == '\n') {
+      ++(*line_no);
+    }
+  }
+
+  // if it can't cross a page, first look at the 16 bytes from p directly
+  char *block = p;
+  uint64_t valid = VEC_FULL;
+  if (((uintptr_t) p & 4095) > 4096 - VEC_SIZE) {
+    block = vec_align(p);
+    valid = ~vec_before(p - block);
+  }
+
+  for (;;) {
+    vec_t v = vec_loadu(block);
+    vec_t found = vec_or(vec_or(vec_eq(v, a), vec_eq(v, b)), vec_or(vec_eq(v, c), vec_eq(v, d)));
+    uint64_t stop = vec_mask(vec_or(found, vec_eq(v, 0))) & valid;
+    uint64_t newline = line_no ? vec_mask(vec_eq(v, '\n')) & valid : 0;
+
+    if (stop) {
+      int i = vec_index(stop);
+      if (line_no) {
+        *line_no += vec_lines(newline & vec_before(i));
+      }
+      return block + i;
+    }
+    if (line_no) {
+      *line_no += vec_lines(newline);
+    }
+    // continue aligned, ignoring anything the unaligned first look already covered
+    char *next = vec_align(block) + VEC_SIZE;
+    valid = ~vec_before(block + VEC_SIZE - next);
+    block = next;
+  }
+}
+
+// skips whitespace from p, counting newlines (the trailing NUL always stops this)
+static inline char *blepi_skip_space(char *p, int *line_no_delta) {
+  // most void is a single space or newline, don't bother with vectors for it
+  unsigned char next = p[1];
+  if (next != ' ' && (unsigned char) (next - '\t') > '\r' - '\t') {
+    *line_no_delta += (p[0] == '\n');
+    return p + 1;
+  }
+
+  char *b = vec_align(p);
+  uint64_t skip = vec_before(p - b);  // treat bytes before p as whitespace
+
+  for (;;) {
+    vec_t v = vec_load(b);
+    uint64_t newline = vec_mask(vec_eq(v, '\n')) & ~skip;
+    uint64_t stop = ~(vec_mask(vec_or(vec_eq(v, ' '), vec_range(v, '\t', '\r'))) | skip) & VEC_FULL;
+
+    if (stop) {
+      int i = vec_index(stop);
+      *line_no_delta += vec_lines(newline & vec_before(i));
+      return b + i;
+    }
+    *line_no_delta += vec_lines(newline);
+    skip = 0;
+    b += VEC_SIZE;
+  }
+}
+
+// skips the inside of a multiline comment (after "/*"), counting newlines
+static inline char *blepi_skip_multiline(char *p, char *end, int *line_no_delta) {
+  char *b = vec_align(p);
+  uint64_t valid = ~vec_before(p - b);
+
+  for (;;) {
+    valid &= vec_before(end - b);  // ignore anything from the trailing NUL onwards
+    vec_t v = vec_load(b);
+    uint64_t star = vec_mask(vec_eq(v, '*')) & valid;
+    uint64_t newline = vec_mask(vec_eq(v, '\n')) & valid;
+
+    while (star) {
+      int i = vec_index(star);
+      if (b[i + 1] == '/') {
+        *line_no_delta += vec_lines(newline & vec_before(i));
+        return b + i + 2;
+      }
+      star &= ~vec_before(i + 1);
+    }
+
+    *line_no_delta += vec_lines(newline);
+    b += VEC_SIZE;
+    if (b >= end) {
+      return end;
+    }
+    valid = VEC_FULL;
+  }
+}
+
+#else
+
+static inline char *blepi_scan(char *p, char a, char b, char c, char d, int *line_no) {
+  for (;; ++p) {
+    char x = *p;
+    if (x == a || x == b || x == c || x == d || !x) {
+      return p;
+    } else if (line_no && x == '\n') {
+      ++(*line_no);
+    }
+  }
+}
+
+static inline char *blepi_skip_space(char *p, int *line_no_delta) {
+  for (;;) {
+    switch (*p) {
+      case '\n':   // 10
+        ++(*line_no_delta);
+        // fall-through
+
+      case ' ':    // 32
+      case '\t':   //  9
+      case '\v':   // 11
+      case '\f':   // 12
+      case '\r':   // 13
+        ++p;
+        continue;
+    }
+    return p;
+  }
+}
+
+static inline char *blepi_skip_multiline(char *p, char *end, int *line_no_delta) {
+  // nb. this can't use memchr because it's looking for both * and \n
+  while (p < end) {
+    char c = *p;
+    if (c == '*') {
+      if (p[1] == '/') {
+        return p + 2;
+      }
+    } else if (c == '\n') {
+      ++(*line_no_delta);
+    }
+    ++p;
+  }
+  return end;
+}
+
+#endif
+
 // consume regexp "/foobar/"
-static inline int blepi_consume_slash_regexp(char *p) {
+static inline int blepi_consume_slash_regexp(tokendef *td, char *p) {
 #ifdef DEBUG
   if (p[0] != '/') {
     debugf("failed to consume slash_regexp, no slash");
@@ -52,14 +215,22 @@ static inline int blepi_consume_slash_regexp(char *p) {
   char *start = p;
   int is_charexpr = 0;
 
-  while (++p < td->end) {
+  for (;;) {
+    if (is_charexpr) {
+      // nb. already known not to be a comment `//`
+      p = blepi_scan(p + 1, ']', '\\', '\n', '\n', NULL);
+    } else {
+      p = blepi_scan(p + 1, '/', '\\', '[', '\n', NULL);
+    }
+
     switch (*p) {
-      case '/':
-        // nb. already known not to be a comment `//`
-        if (is_charexpr) {
-          continue;
+      case '\0':
+        if (p >= td->end) {
+          return p - start;
         }
+        continue;
 
+      case '/':
         // eat trailing flags
         do {
           ++p;
@@ -84,8 +255,6 @@ static inline int blepi_consume_slash_regexp(char *p) {
         continue;
     }
   }
-
-  return p - start;
 }
 
 static inline int blepi_maybe_consume_alnum_group(char *p) {
@@ -106,7 +275,7 @@ static inline int blepi_maybe_consume_alnum_group(char *p) {
   }
 }
 
-static inline int blepi_consume_basic_string(char *p, int *line_no) {
+static inline int blepi_consume_basic_string(tokendef *td, char *p, int *line_no) {
 #ifdef DEBUG
   if (p[0] != '\'' && p[0] != '"') {
     debugf("got bad string starter");
@@ -114,9 +283,12 @@ static inline int blepi_consume_basic_string(char *p, int *line_no) {
   }
 #endif
   char *start = p;
+  const char quote = *start;
 
   for (;;) {
-    ++p;
+    // nb. newlines are not valid here, but count them anyway
+    p = blepi_scan(p + 1, quote, '\\', '\\', '\\', line_no);
+
     switch (*p) {
       case '\0':
         if (td->end == p) {
@@ -124,29 +296,20 @@ static inline int blepi_consume_basic_string(char *p, int *line_no) {
         }
         continue;
 
-      case '\n':
-        // nb. not valid here
-        ++(*line_no);
-        continue;
-
       case '\\':
-        if (p[1] == *start || p[1] == '\\') {
+        if (p[1] == quote || p[1] == '\\') {
           ++p;  // the only things we care about escaping
         }
         continue;
-
-      case '"':
-      case '\'':
-        if (*p == *start) {
-          ++p;
-          return p - start;
-        }
-        // do nothing, we found the other one
     }
+
+    // we found our quote
+    ++p;
+    return p - start;
   }
 }
 
-static inline int blepi_consume_template(char *p, int *line_no) {
+static inline int blepi_consume_template(tokendef *td, char *p, int *line_no) {
   // p[0] will be ` or }
 #ifdef DEBUG
   if (p[0] != '`' && p[0] != '}') {
@@ -157,7 +320,8 @@ static inline int blepi_consume_template(char *p, int *line_no) {
   char *start = p;
 
   for (;;) {
-    ++p;
+    p = blepi_scan(p + 1, '`', '\\', '$', '$', line_no);
+
     switch (*p) {
       case '\0':
         if (td->end == p) {
@@ -165,10 +329,6 @@ static inline int blepi_consume_template(char *p, int *line_no) {
         }
         continue;
 
-      case '\n':
-        ++(*line_no);
-        continue;
-
       case '\\':
         if (p[1] == '$' || p[1] == '`' || p[1] == '\\') {
           ++p;  // we can only escape these
@@ -188,7 +348,7 @@ static inline int blepi_consume_template(char *p, int *line_no) {
 }
 
 // consumes spaces/comments between tokens
-static inline int blepi_consume_void(char *p, int *line_no) {
+static inline int blepi_consume_void(tokendef *td, char *p, int *line_no) {
   int line_no_delta = 0;
   char *start = p;
 
@@ -196,15 +356,11 @@ static inline int blepi_consume_void(char *p, int *line_no) {
     switch (*p) {
       case ' ':    // 32
       case '\t':   //  9
+      case '\n':   // 10
       case '\v':   // 11
       case '\f':   // 12
       case '\r':   // 13
-        ++p;
-        continue;
-
-      case '\n':   // 10
-        ++p;
-        ++line_no_delta;
+        p = blepi_skip_space(p, &line_no_delta);
         continue;
 
       case '/': {  // 47
@@ -220,19 +376,7 @@ static inline int blepi_consume_void(char *p, int *line_no) {
         }
 
         // consuming multiline
-        // nb. this can't use memchr because it's looking for both * and \n
-        p += 2;
-        do {
-          char c = *p;
-          if (c == '*') {
-            if (p[1] == '/') {
-              p += 2;
-              break;
-            }
-          } else if (c == '\n') {
-            ++line_no_delta;
-          }
-        } while (++p < td->end);
+        p = blepi_skip_multiline(p + 2, td->end, &line_no_delta);
         continue;
       }
     }
@@ -240,7 +384,7 @@ static inline int blepi_consume_void(char *p, int *line_no) {
     break;  // unhandled, break below
   }
 
-  (*line_no) += line_no_delta;
+  (*line_no) += void_lines(line_no_delta);
   return p - start;
 }
 
@@ -263,18 +407,29 @@ static inline int blepi_consume_number(char *p) {
   return len;
 }
 
-static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
-#define _ret(_len, _type) {t->special = 0; t->type = _type; t->len = _len; return;};
-#define _reth(_len, _type, _hash) {t->special = _hash; t->type = _type; t->len = _len; return;};
+static inline void blepi_consume_token(tokendef *td, struct token *t, char *p, int *line_no) {
+#define _ret(_len, _type) {t->special = 0; t->type = _type; t->len = _len; t->hash = 0; return;};
+#define _reth(_len, _type, _hash) {t->special = _hash; t->type = _type; t->len = _len; t->hash = 0; return;};
+// once lookahead outgrows the ring, a restore lexes again from the restore point, so the stack
+// below it must be left alone
 #define _inc_stack(_type) { \
       td->stack[td->depth] = _type; \
-      if (td->depth < td->restore__depth) { \
+      if (td->brackets) { \
+        td->open_at[td->depth] = p - td->brackets_base; \
+      } \
+      if (td->ring__full && td->depth < td->restore__depth) { \
         debugf("got stack increment below restore depth: was=%d, depth=%d", td->depth, td->restore__depth); \
         _ret(0, TOKEN_EOF); \
-      } else if (++td->depth == STACK_SIZE) { \
+      } else if (++td->depth == td->stack_size) { \
         debugf("hit stack upper limit"); \
         _ret(0, TOKEN_EOF); \
       } \
+      blep_stat_max(td, depth_max, td->depth); \
+    }
+#define _record_close(_depth) { \
+      if (td->brackets) { \
+        td->brackets[td->open_at[_depth]] = p - td->brackets_base; \
+      } \
     }
 
   struct token *prev = &(td->curr);
@@ -364,7 +519,7 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
       _ret(blepi_consume_number(p), TOKEN_NUMBER);
 
     case _LOOKUP__STRING:
-      _ret(blepi_consume_basic_string(p, line_no), TOKEN_STRING);
+      _ret(blepi_consume_basic_string(td, p, line_no), TOKEN_STRING);
 
     case _LOOKUP__SLASH:
       // js is dumb: slashes are ambiguous, so guess here. we're almost always right, but callers
@@ -396,7 +551,7 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
           _ret(1, TOKEN_OP);
       }
 
-      _ret(blepi_consume_slash_regexp(p), TOKEN_REGEXP);
+      _ret(blepi_consume_slash_regexp(td, p), TOKEN_REGEXP);
 
     case _LOOKUP__LIT: {
       // don't hash if this is a property
@@ -408,6 +563,7 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
         if (!lookup_symbol[c]) {
           t->type = TOKEN_LIT;
           t->len = len;
+          t->hash = blep_token_hash(p, len);
           return;
         }
       }
@@ -436,7 +592,14 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
         c = p[len];
       } while (lookup_symbol[c]);
 
-      _ret(len, TOKEN_LIT);
+      if (!len) {
+        _ret(0, TOKEN_EOF);  // a lone "\", which can't start anything
+      }
+      t->special = 0;
+      t->type = TOKEN_LIT;
+      t->len = len;
+      t->hash = blep_token_hash(p, len);
+      return;
     }
 
     case TOKEN_BRACE:
@@ -451,6 +614,7 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
       }
       // inside ternary stack, close it
       --td->depth;
+      _record_close(td->depth);
       _reth(1, TOKEN_CLOSE, TOKEN_TERNARY);
 
     case TOKEN_CLOSE: {
@@ -462,17 +626,21 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
 
       // normal non-string, close and record
       int prev = td->stack[update];
+      _record_close(update);
       if (prev != TOKEN_STRING) {
         td->depth = update;
         _reth(1, TOKEN_CLOSE, prev);
       }
 
       // restore into template stack
-      int len = blepi_consume_template(p, line_no);
+      int len = blepi_consume_template(td, p, line_no);
       int more = (p[len - 1] == '{');
       if (more) {
         // this was a template part like: }...${
-        // so don't muck with the stack
+        // so don't muck with the stack, but this is now what's open
+        if (td->brackets) {
+          td->open_at[update] = p - td->brackets_base;
+        }
         _ret(len, TOKEN_STRING);
       }
       td->depth = update;
@@ -480,7 +648,7 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
     }
 
     case _LOOKUP__TEMPLATE: {
-      int len = blepi_consume_template(p, line_no);
+      int len = blepi_consume_template(td, p, line_no);
       int more = (p[len - 1] == '{');
       if (more) {
         _inc_stack(TOKEN_STRING);
@@ -512,9 +680,108 @@ static inline void blepi_consume_token(struct token *t, char *p, int *line_no) {
 #undef _ret
 #undef _reth
 #undef _inc_stack
+#undef _record_close
 }
 
-int blep_token_update(int type) {
+// state at head just after ring[i - 1], or before the ring if i is zero
+static inline struct token_ahead *blepi_ring_state(tokendef *td, int i) {
+  return i ? &(td->ring[i - 1]) : &(td->ring__base);
+}
+
+// drops ring[to] onwards, undoing their writes to the stack in reverse order
+static void blepi_ring_unwind(tokendef *td, int to) {
+  for (int i = td->ring__len - 1; i >= to; --i) {
+    td->stack[td->ring[i].undo_depth] = td->ring[i].undo_stack;
+    td->open_at[td->ring[i].undo_depth] = td->ring[i].undo_open;
+  }
+  td->ring__len = to;
+}
+
+// appends the just-lexed token t to the ring while a restore point is set
+static inline void blepi_ring_record(tokendef *td, struct token *t, int undo_depth, int undo_stack,
+    int undo_open) {
+  if (td->ring__len == RING_SIZE && td->restore__ring) {
+    // nothing before the restore point can be replayed again, so make room
+    int drop = td->restore__ring;
+    memcpy(&(td->ring__base), &(td->ring[drop - 1]), sizeof(struct token_ahead));
+    memmove(td->ring, td->ring + drop, sizeof(struct token_ahead) * (RING_SIZE - drop));
+    td->ring__len -= drop;
+    td->restore__ring = 0;
+  }
+  if (td->ring__len == RING_SIZE) {
+    td->ring__full = 1;
+    return;
+  }
+
+  struct token_ahead *ahead = &(td->ring[td->ring__len++]);
+  memcpy(&(ahead->t), t, sizeof(struct token));
+  ahead->at = td->at;
+  ahead->line_no = td->line_no;
+  ahead->depth = td->depth;
+  ahead->undo_depth = undo_depth;
+  ahead->undo_stack = undo_stack;
+  ahead->undo_open = undo_open;
+  td->ring__pos = td->ring__len;
+}
+
+// moves the next token into t, either from the ring or by lexing at head
+static inline void blepi_advance(tokendef *td, struct token *t) {
+  if (td->ring__pos < td->ring__len) {
+    struct token_ahead *ahead = &(td->ring[td->ring__pos++]);
+    memcpy(t, &(ahead->t), sizeof(struct token));
+    td->at = ahead->at;
+    td->line_no = ahead->line_no;
+    td->depth = ahead->depth;
+    blep_stat(td, replayed, 1);
+    return;
+  } else if (!td->restore__at) {
+    // replay is done (or was never needed)
+    td->ring__len = td->ring__pos = 0;
+  }
+
+  // remember the one stack slot this token might push over
+  int undo_depth = td->depth < td->stack_size ? td->depth : 0;
+  int undo_stack = td->stack[undo_depth];
+  int undo_open = td->open_at[undo_depth];
+
+  int void_len = blepi_consume_void(td, td->at, &(td->line_no));
+  t->vp = td->at;
+  td->at += void_len;
+
+  // save as we can't yet write p/line_no to `t`, which may be `td->curr`
+  char *p = td->at;
+  int line_no = td->line_no;
+
+  blepi_consume_token(td, t, td->at, &(td->line_no));
+  td->at += t->len;
+
+  t->p = p;
+  t->line_no = line_no;
+
+#ifdef BLEP_STATS
+  blep_stat(td, tokens[t->type], 1);
+  blep_stat(td, void_bytes, void_len);
+  if (t->type == TOKEN_STRING) {
+    if (p[0] == '`' || p[0] == '}') {
+      blep_stat(td, template_bytes, t->len);
+    } else {
+      blep_stat(td, string_bytes, t->len);
+    }
+  } else if (t->type == TOKEN_REGEXP) {
+    blep_stat(td, regexp_bytes, t->len);
+  }
+#endif
+
+  // ops look up to three bytes past their start, e.g. ".." may yet become "..."
+  if (td->end - td->at <= 3) {
+    td->reached_end = 1;
+  }
+  if (td->restore__at && !td->ring__full) {
+    blepi_ring_record(td, t, undo_depth, undo_stack, undo_open);
+  }
+}
+
+int blep_token_update(tokendef *td, int type) {
 #ifdef DEBUG
   if (td->peek.p) {
     debugf("can't update once already peeked, request: %d", type);
@@ -526,6 +793,18 @@ int blep_token_update(int type) {
     return 0;
   }
 
+  blep_stat(td, updates, 1);
+
+  // anything in the ring after the cursor was lexed assuming its old type, so drop it
+  struct token_ahead *state = NULL;
+  if (td->ring__len && !td->ring__full) {
+    blepi_ring_unwind(td, td->ring__pos);
+    state = blepi_ring_state(td, td->ring__pos);
+    td->at = state->at;
+    td->line_no = state->line_no;
+    td->depth = state->depth;
+  }
+
   switch (type) {
     case TOKEN_REGEXP: {
 #ifdef DEBUG
@@ -534,11 +813,15 @@ int blep_token_update(int type) {
         return ERROR__INTERNAL;
       }
 #endif
-      int len = blepi_consume_slash_regexp(td->curr.p);
+      int len = blepi_consume_slash_regexp(td, td->curr.p);
+      blep_stat(td, regexp_bytes, len);
       td->at += (len - 1);
+      if (td->at >= td->end) {
+        td->reached_end = 1;
+      }
       td->curr.len = len;
       td->curr.type = TOKEN_REGEXP;
-      return 0;
+      break;
     }
 
     case TOKEN_OP: {
@@ -552,39 +835,38 @@ int blep_token_update(int type) {
       td->at -= (td->curr.len - 1);
       td->curr.len = 1;
       td->curr.type = TOKEN_OP;
-      return 0;
+      break;
     }
+
+    default:
+      debugf("got bad blep_token_update");
+      return ERROR__INTERNAL;
   }
 
-  debugf("got bad blep_token_update");
-  return ERROR__INTERNAL;
+  if (state) {
+    state->at = td->at;
+    if (td->ring__pos) {
+      // replays must see the updated token, but not the client's other changes to it
+      state->t.len = td->curr.len;
+      state->t.type = td->curr.type;
+    }
+  }
+  return 0;
 }
 
-int blep_token_next() {
+int blep_token_next(tokendef *td) {
   if (td->peek.p) {
     memcpy(&td->curr, &td->peek, sizeof(struct token));
     td->peek.p = 0;
   } else {
-    int void_len = blepi_consume_void(td->at, &(td->line_no));
-    td->curr.vp = td->at;
-    td->at += void_len;
-
-    // save as we can't yet write p/line_no to `td->curr`
-    char *p = td->at;
-    int line_no = td->line_no;
-
-    blepi_consume_token(&(td->curr), td->at, &(td->line_no));
-    td->at += td->curr.len;
-
-    td->curr.p = p;
-    td->curr.line_no = line_no;
+    blepi_advance(td, &(td->curr));
   }
 
   if (!td->curr.len) {
     if (td->at >= td->end) {
       return 0;
     }
-    if (!td->depth || td->depth == STACK_SIZE) {
+    if (!td->depth || td->depth == td->stack_size) {
       debugf("stack err: %c (depth=%d)\n", td->at[0], td->depth);
       return ERROR__STACK;
     }
@@ -595,66 +877,90 @@ int blep_token_next() {
   return td->curr.type;
 }
 
-int blep_token_peek() {
+int blep_token_peek(tokendef *td) {
   if (td->peek.p) {
     // we need to allow duplicate peeks for a few cases
     return td->peek.type;
   }
 
-  int void_len = blepi_consume_void(td->at, &(td->line_no));
-  td->peek.vp = td->at;
-  td->at += void_len;
-
-  td->peek.p = td->at;
-  td->peek.line_no = td->line_no;
-  blepi_consume_token(&(td->peek), td->at, &(td->line_no));
-  td->at += td->peek.len;
-
+  blepi_advance(td, &(td->peek));
   return td->peek.type;
 }
 
-int blep_token_set_restore() {
+int blep_token_set_restore(tokendef *td) {
   if (td->restore__at) {
     return 0;
   }
 
-  // clear peek and reset its contribution
-  if (td->peek.p) {
-    switch (td->peek.type) {
-      case TOKEN_CLOSE:
-        ++td->depth;
-        break;
-
-      case TOKEN_BRACE:
-      case TOKEN_ARRAY:
-      case TOKEN_PAREN:
-      case TOKEN_TERNARY:
-        --td->depth;
-        break;
-    }
+  if (!td->ring__len) {
+    // start a new ring just after the cursor
+    struct token_ahead *base = &(td->ring__base);
+    base->at = td->at;
+    base->line_no = td->line_no;
+    base->depth = td->depth;
 
-    td->at = td->peek.vp;  // the cursor has been moved forward
-    td->peek.p = 0;
+    if (td->peek.p) {
+      // the peek becomes the first token in the ring, so find the head state before it
+      switch (td->peek.type) {
+        case TOKEN_CLOSE:
+          ++base->depth;
+          break;
+
+        case TOKEN_BRACE:
+        case TOKEN_ARRAY:
+        case TOKEN_PAREN:
+        case TOKEN_TERNARY:
+          --base->depth;
+          break;
+      }
+      base->at = td->peek.vp;
+#ifdef BLEP_NO_LINES
+      base->line_no -= (memchr(td->peek.vp, '\n', td->peek.p - td->peek.vp) != 0);
+#else
+      for (char *p = td->peek.vp; p < td->peek.p; ++p) {
+        base->line_no -= (*p == '\n');
+      }
+#endif
+
+      int undo_depth = base->depth < td->stack_size ? base->depth : 0;
+      td->restore__at = td->at;  // allow recording
+      blepi_ring_record(td, &(td->peek), undo_depth, td->stack[undo_depth], td->open_at[undo_depth]);
+      td->ring__pos = 0;
+    }
+  } else if (td->peek.p) {
+    // the peek was the last token replayed or recorded, so give it back
+    --td->ring__pos;
   }
+  td->peek.p = 0;
 
   memcpy(&(td->restore__curr), &(td->curr), sizeof(struct token));
+  blep_stat(td, set_restores, 1);
 
-  td->restore__line_no = td->line_no;
-  td->restore__at = td->at;
-  td->restore__depth = td->depth;
+  struct token_ahead *state = blepi_ring_state(td, td->ring__pos);
+  td->restore__line_no = td->line_no = state->line_no;
+  td->restore__at = td->at = state->at;
+  td->restore__depth = td->depth = state->depth;
+  td->restore__ring = td->ring__pos;
   return td->depth;
 }
 
-int blep_token_restore() {
+int blep_token_restore(tokendef *td) {
   if (!td->restore__at) {
     return 0;
   }
 
-  // TODO: set_restore and restore currently just move the top token back
-  // but we could/should store a ring buffer of ~256 tokens for re-parsing
-  // challenges are with looping again/overflows: we enact tokens in consume 
-
   memcpy(&(td->curr), &(td->restore__curr), sizeof(struct token));
+  blep_stat(td, restores, 1);
+
+  if (td->ring__full) {
+    // lookahead was too long to replay: put the stack back and lex again from the restore point
+    blep_stat(td, relexed_bytes, td->at - td->restore__at);
+    blepi_ring_unwind(td, td->restore__ring);
+    td->ring__len = td->ring__pos = 0;
+    td->ring__full = 0;
+  } else {
+    td->ring__pos = td->restore__ring;
+  }
 
   td->line_no = td->restore__line_no;
   td->at = td->restore__at;
@@ -666,3 +972,51 @@ int blep_token_restore() {
 
   return td->depth;
 }
+
+int blep_token_checkpoint_size(tokendef *td) {
+  return __builtin_offsetof(tokendef, ring) + sizeof(struct token_ahead) * td->ring__len;
+}
+
+void blep_token_shift(tokendef *td, long delta) {
+#define _shift(_p) if (_p) { _p += delta; }
+  _shift(td->curr.vp);
+  _shift(td->curr.p);
+  _shift(td->peek.vp);
+  _shift(td->peek.p);
+  _shift(td->at);
+  _shift(td->end);
+  _shift(td->restore__curr.vp);
+  _shift(td->restore__curr.p);
+  _shift(td->restore__at);
+  _shift(td->ring__base.at);
+  _shift(td->brackets_base);
+  for (int i = 0; i < td->ring__len; ++i) {
+    _shift(td->ring[i].t.vp);
+    _shift(td->ring[i].t.p);
+    _shift(td->ring[i].at);
+  }
+#undef _shift
+}
+
+int blep_token_stack(tokendef *td, int *arena, int size) {
+  if (size <= td->depth) {
+    return ERROR__STACK;
+  }
+  memcpy(arena, td->stack, sizeof(int) * (td->depth + 1));
+  memcpy(arena + size, td->open_at, sizeof(int) * (td->depth + 1));
+
+  td->stack_size = size;
+  td->stack = arena;
+  td->open_at = arena + size;
+  return 0;
+}
+
+void blep_token_brackets(tokendef *td, int *index, char *base) {
+  td->brackets = index;
+  td->brackets_base = base;
+
+  // the cursor may already be an open
+  if (td->depth > 1 && td->curr.p) {
+    td->open_at[td->depth - 1] = td->curr.p - base;
+  }
+}
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <string.h>
 
 #ifndef __BLEP_TOKEN_H
 #define __BLEP_TOKEN_H
@@ -12,20 +13,81 @@ struct token {
   int line_no;
   int type;
   uint32_t special;
+  uint32_t hash;  // of the bytes of TOKEN_LIT (so also TOKEN_SYMBOL), or zero
 };
 
+#define _TOKEN_HASH_MUL  0x9e3779b97f4a7c15ull
+
+// hashes names as the tokenizer does, over raw bytes (so escapes like "\u0061" don't match "a").
+// reads a word at a time, but never outside the name.
+static inline uint32_t blep_token_hash(char *p, int len) {
+  uint64_t h = (uint64_t) len * _TOKEN_HASH_MUL;
+  uint64_t w;
+
+  if (len >= 8) {
+    for (int i = 0; i + 8 < len; i += 8) {
+      memcpy(&w, p + i, 8);
+      h = (h ^ w) * _TOKEN_HASH_MUL;
+    }
+    memcpy(&w, p + len - 8, 8);
+  } else if (len >= 4) {
+    uint32_t a, b;
+    memcpy(&a, p, 4);
+    memcpy(&b, p + len - 4, 4);
+    w = ((uint64_t) a << 32) | b;
+  } else {
+    w = len ? (uint8_t) p[0] | ((uint8_t) p[len >> 1] << 8) | ((uint8_t) p[len - 1] << 16) : 0;
+  }
+
+  h = (h ^ w) * _TOKEN_HASH_MUL;
+  uint32_t out = h >> 32;
+  return out ? out : 1;
+}
+
+
+#define STACK_SIZE    256  // built-in, see blep_token_stack for more
+#define RING_SIZE     256
+
+
+// a token lexed during lookahead, along with the head state just after it
+struct token_ahead {
+  struct token t;
+  char *at;
+  int line_no;
+  int depth;
+  int undo_depth;  // stack[undo_depth] was undo_stack before this token was lexed
+  int undo_stack;
+  int undo_open;   // ... and open_at[undo_depth] was undo_open
+};
 
-int blep_token_init(char *, int);
-int blep_token_update(int);
-int blep_token_next();
-int blep_token_peek();
-
-int blep_token_set_restore();
-int blep_token_restore();
-
-
-#define STACK_SIZE    256
 
+// counters for what drives cost, only kept when built with -DBLEP_STATS (see blep_stats). all are
+// ints, so the harness can read them as an Int32Array.
+typedef struct {
+  int tokens[_TOKEN_MAX + 1];  // lexed by type, before the parser retypes them (not replays)
+  int replayed;        // tokens replayed from the ring rather than lexed again
+  int void_bytes;      // whitespace and comments
+  int string_bytes;
+  int template_bytes;  // including parts after "}"
+  int regexp_bytes;
+  int set_restores;    // blep_token_set_restore calls which started lookahead
+  int restores;        // blep_token_restore calls which rewound
+  int relexed_bytes;   // lexed again after a restore, as lookahead outgrew the ring
+  int updates;         // regexp/slash flips via blep_token_update
+  int depth_max;
+  int callbacks;       // crossings into blep_parser_callback, open and close
+  int opens;
+  int closes;
+} statsdef;
+
+#ifdef BLEP_STATS
+#define blep_stat(_td, _field, _n)  ((_td)->stats._field += (_n))
+#define blep_stat_max(_td, _field, _v) \
+    ((_td)->stats._field = (_v) > (_td)->stats._field ? (_v) : (_td)->stats._field)
+#else
+#define blep_stat(_td, _field, _n)  ((void) 0)
+#define blep_stat_max(_td, _field, _v)  ((void) 0)
+#endif
 
 
 typedef struct {
@@ -36,22 +98,68 @@ typedef struct {
   char *at;     // head pointer
   char *end;    // end of input (must point to NULL)
 
-  // depth/stack at head (just used for balancing)
+  // depth/stack at head (just used for balancing), with room for stack_size entries
   int depth;
-  int stack[STACK_SIZE];
+  int stack_size;
+  int *stack;
 
   struct token restore__curr;
   int restore__line_no;
   char *restore__at;
   int restore__depth;
-} tokendef;
+  int restore__ring;  // index in ring of the first token after restore__curr
 
-// global
-#ifdef EMSCRIPTEN
-#define td ((tokendef *) 20)
-#else
-extern tokendef _td;
-#define td (&_td)
+  // set whenever lexing gets close to end, as the last token may be incomplete (or have been lexed
+  // differently) if more input follows
+  int reached_end;
+
+  // if set, brackets[i] is set to the offset of the matching close for each open at offset i, with
+  // offsets from brackets_base (see blep_token_brackets)
+  int *brackets;
+  char *brackets_base;
+  int *open_at;  // offset of each open on the stack, only kept while recording brackets
+
+  // storage for stack and open_at unless replaced via blep_token_stack
+  int stack__inline[STACK_SIZE];
+  int open_at__inline[STACK_SIZE];
+
+#ifdef BLEP_STATS
+  statsdef stats;  // reset by init, and part of a checkpoint
 #endif
 
+  // tokens lexed since the restore point, replayed rather than lexed again after a restore
+  struct token_ahead ring__base;  // head state before ring[0], token unused
+  int ring__len;
+  int ring__pos;   // next token to replay, lexing happens once this hits ring__len
+  int ring__full;  // lookahead outgrew the ring, so restore must lex again
+  struct token_ahead ring[RING_SIZE];  // must be last, see blep_token_checkpoint_size
+} tokendef;
+
+
+// all state is held in the passed tokendef, so any number of these can be in use at once
+int blep_token_init(tokendef *, char *, int);
+int blep_token_update(tokendef *, int);
+int blep_token_next(tokendef *);
+int blep_token_peek(tokendef *);
+
+int blep_token_set_restore(tokendef *);
+int blep_token_restore(tokendef *);
+
+// bytes at the start of tokendef which hold all of its state, for copying as a checkpoint
+int blep_token_checkpoint_size(tokendef *);
+
+// moves every pointer held by tokendef by delta, used once its input has been moved
+void blep_token_shift(tokendef *, long delta);
+
+// replaces the stack with arena, which holds 2 * size ints, allowing nesting up to size deep. this
+// must be called after init (which reverts to the built-in STACK_SIZE), and size must be more than
+// the current depth. returns 0 or ERROR__STACK.
+int blep_token_stack(tokendef *, int *arena, int size);
+
+// records matching brackets into index, which needs a slot for every byte of input from base: for
+// each open "{", "[", "(", "?" or template string ending "${" at offset i, index[i] is set to the
+// offset of its close. other slots aren't written. must be called once just after init (of the
+// tokenizer or parser), before anything else is lexed.
+void blep_token_brackets(tokendef *, int *index, char *base);
+
 #endif//__BLEP_TOKEN_H
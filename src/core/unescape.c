@@ -0,0 +1,200 @@
+#include "unescape.h"
+#include <string.h>
+
+#ifdef EMSCRIPTEN
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+static inline int unescape_hex(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 32;
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// reads count hex digits at p, or -1 if they aren't all hex
+static inline int unescape_hex_run(char *p, int count) {
+  int out = 0;
+  for (int i = 0; i < count; ++i) {
+    int v = unescape_hex(p[i]);
+    if (v < 0) {
+      return -1;
+    }
+    out = (out << 4) | v;
+  }
+  return out;
+}
+
+static inline char *unescape_utf8(char *out, int cp) {
+  if (cp < 0x80) {
+    *out++ = cp;
+  } else if (cp < 0x800) {
+    *out++ = 0xc0 | (cp >> 6);
+    *out++ = 0x80 | (cp & 0x3f);
+  } else if (cp < 0x10000) {
+    *out++ = 0xe0 | (cp >> 12);
+    *out++ = 0x80 | ((cp >> 6) & 0x3f);
+    *out++ = 0x80 | (cp & 0x3f);
+  } else {
+    *out++ = 0xf0 | (cp >> 18);
+    *out++ = 0x80 | ((cp >> 12) & 0x3f);
+    *out++ = 0x80 | ((cp >> 6) & 0x3f);
+    *out++ = 0x80 | (cp & 0x3f);
+  }
+  return out;
+}
+
+// reads a \u escape just after its "u", moving p past it. returns the code unit or point, or -1
+static inline int unescape_u(char **p, char *end) {
+  char *at = *p;
+  if (*at != '{') {
+    if (end - at < 4) {
+      return -1;
+    }
+    *p = at + 4;
+    return unescape_hex_run(at, 4);
+  }
+
+  int cp = 0;
+  for (++at; at < end && *at != '}'; ++at) {
+    int v = unescape_hex(*at);
+    if (v < 0 || (cp = (cp << 4) | v) > 0x10ffff) {
+      return -1;
+    }
+  }
+  if (at == end || at == *p + 1) {
+    return -1;  // unclosed or empty
+  }
+  *p = at + 1;
+  return cp;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int blep_unescape(char *p, int len, char *out) {
+  if (len < 2) {
+    return ERROR__UNEXPECTED;
+  }
+  const char quote = p[0];
+  const int is_template = (quote == '`');
+  if ((quote != '\'' && quote != '"' && !is_template) || p[len - 1] != quote) {
+    return ERROR__UNEXPECTED;
+  }
+
+  char *at = p + 1;
+  char *end = p + len - 1;
+
+  // most strings have nothing to change
+  char *next = memchr(at, '\\', end - at);
+  if (!next && (!is_template || !memchr(at, '\r', end - at))) {
+    return UNESCAPE__RAW;
+  }
+
+  char *start = out;
+  while (at < end) {
+    char c = *at;
+
+    if (c == '\r' && is_template) {
+      // template strings normalize CR and CRLF to LF
+      *out++ = '\n';
+      at += (at + 1 < end && at[1] == '\n') ? 2 : 1;
+      continue;
+    } else if (c != '\\') {
+      *out++ = c;
+      ++at;
+      continue;
+    }
+
+    if (++at == end) {
+      return ERROR__UNEXPECTED;
+    }
+    c = *at++;
+
+    int cp;
+    switch (c) {
+      case 'b':
+        *out++ = '\b';
+        continue;
+      case 'f':
+        *out++ = '\f';
+        continue;
+      case 'n':
+        *out++ = '\n';
+        continue;
+      case 'r':
+        *out++ = '\r';
+        continue;
+      case 't':
+        *out++ = '\t';
+        continue;
+      case 'v':
+        *out++ = '\v';
+        continue;
+
+      case '0':
+        if (at < end && *at >= '0' && *at <= '9') {
+          return ERROR__UNEXPECTED;  // legacy octal isn't allowed in strict mode
+        }
+        *out++ = 0;
+        continue;
+
+      case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+        return ERROR__UNEXPECTED;
+
+      case '\r':
+        if (at < end && *at == '\n') {
+          ++at;
+        }
+        // fall-through
+
+      case '\n':
+        continue;  // line continuation
+
+      case 'x':
+        if (end - at < 2 || (cp = unescape_hex_run(at, 2)) < 0) {
+          return ERROR__UNEXPECTED;
+        }
+        at += 2;
+        out = unescape_utf8(out, cp);
+        continue;
+
+      case 'u':
+        if ((cp = unescape_u(&at, end)) < 0) {
+          return ERROR__UNEXPECTED;
+        }
+        if (cp >= 0xd800 && cp <= 0xdbff && end - at >= 6 && at[0] == '\\' && at[1] == 'u') {
+          // join a surrogate pair written as two escapes
+          char *low_at = at + 2;
+          int low = unescape_u(&low_at, end);
+          if (low >= 0xdc00 && low <= 0xdfff) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            at = low_at;
+          }
+        }
+        if (cp >= 0xd800 && cp <= 0xdfff) {
+          return UNESCAPE__SURROGATE;
+        }
+        out = unescape_utf8(out, cp);
+        continue;
+
+      case (char) 0xe2:
+        // U+2028 and U+2029 are line continuations, just like \n
+        if (end - at >= 2 && at[0] == (char) 0x80 && (at[1] == (char) 0xa8 || at[1] == (char) 0xa9)) {
+          at += 2;
+          continue;
+        }
+        // fall-through
+
+      default:
+        *out++ = c;  // includes the first byte of any other UTF-8 character
+        continue;
+    }
+  }
+
+  return out - start;
+}
@@ -0,0 +1,15 @@
+#ifndef __BLEP_UNESCAPE_H
+#define __BLEP_UNESCAPE_H
+
+#include "def.h"
+
+#define UNESCAPE__RAW        -5  // no escapes: the value is just the bytes inside the quotes
+#define UNESCAPE__SURROGATE  -6  // the value has an unpaired surrogate, which UTF-8 can't hold
+
+// Writes the value of the string token at p (including its quotes) to out as UTF-8, which needs
+// room for len bytes. Template strings must not have holes, and also have their newlines
+// normalized. returns the length written, UNESCAPE__RAW if nothing was written as the value needs
+// no changes, UNESCAPE__SURROGATE, or ERROR__UNEXPECTED for invalid tokens or escapes.
+int blep_unescape(char *p, int len, char *out);
+
+#endif//__BLEP_UNESCAPE_H
@@ -7,6 +7,7 @@
 #include "read.c"
 
 static int depth = 0;
+static parserdef pd;
 static struct token *t;
 
 static const char *stack_names[] = {
@@ -44,7 +45,7 @@ static const char *token_names[] = {
   "block",
 };
 
-void blep_parser_callback() {
+void blep_parser_callback(parserdef *pd) {
   if (t->type < 0 || t->type > _TOKEN_MAX) {
     exit(1);
   }
@@ -90,7 +91,7 @@ void blep_parser_callback() {
   printf("\n");
 }
 
-int blep_parser_open(int type) {
+int blep_parser_open(parserdef *pd, int type) {
   ++depth;
   if (type > _STACK_MAX) {
     exit(1);
@@ -99,7 +100,7 @@ int blep_parser_open(int type) {
   return 0;
 }
 
-void blep_parser_close(int type) {
+void blep_parser_close(parserdef *pd, int type) {
   --depth;
   printf("%-11s<\n", stack_names[type]);
 }
@@ -111,15 +112,15 @@ int main() {
     return -1;
   }
 
-  int ret = blep_parser_init(buf, len);
+  int ret = blep_parser_init(&pd, buf, len);
   if (ret) {
     return ret;
   }
-  t = blep_parser_cursor();
-  fprintf(stderr, "sizeof(tokendef)=%lu sizeof(struct token)=%lu (%p)\n", sizeof(tokendef), sizeof(struct token), t);
+  t = blep_parser_cursor(&pd);
+  fprintf(stderr, "sizeof(parserdef)=%lu sizeof(struct token)=%lu (%p)\n", sizeof(parserdef), sizeof(struct token), t);
 
   for (;;) {
-    int ret = blep_parser_run();
+    int ret = blep_parser_run(&pd);
     if (ret < 0) {
       fprintf(stderr, "!! err=%d\n", ret);
       return ret;
@@ -3,16 +3,31 @@
 set -eu
 
 FLAGS="-O1 -g4"
+SIMD_FLAGS="${FLAGS}"
 export EMCC_DEBUG=1
 if [[ "${1-}" == "release" ]]; then
   export EMCC_DEBUG=0
   FLAGS="-O2 -DSPEED"
-  echo "Release mode (\"${FLAGS}\")" >&2
+  SIMD_FLAGS="-O3 -flto -DSPEED"
+  echo "Release mode (\"${FLAGS}\", or \"${SIMD_FLAGS}\" with SIMD)" >&2
 elif [[ "${1-}" != "" ]]; then
   echo "Unknown mode: $1" >&2
   exit 1
 fi
 
+# set STATS=1 to count what drives cost during a parse, read via harness.stats()
+if [[ "${STATS-}" == "1" ]]; then
+  FLAGS="${FLAGS} -DBLEP_STATS"
+  SIMD_FLAGS="${SIMD_FLAGS} -DBLEP_STATS"
+fi
+
+# set LINES=0 to not count lines as tokens are lexed, so lineNo() only changes across newlines (see
+# harness.position() for real lines and columns)
+if [[ "${LINES-}" == "0" ]]; then
+  FLAGS="${FLAGS} -DBLEP_NO_LINES"
+  SIMD_FLAGS="${SIMD_FLAGS} -DBLEP_NO_LINES"
+fi
+
 # With Homebrew on Mac as of 2020-06, this generates a warning like:
 #
 # > emcc: warning: the fastomp compiler is deprecated.  Please switch to the upstream llvm backend as soon as possible and open issues if you have trouble doing so [-Wfastcomp]
@@ -27,19 +42,38 @@ fi
 # (Emscripten is dumb and stack would go forever otherwise) and this lets us pass as much memory as
 # we like on creation inside JS.
 
-# use two pages (65536 * 2) for memory, random number for stack
+# use two pages (65536 * 2) for memory. statics and the stack share the second page (before the
+# input at WRITE_AT), and a stack overflow silently writes over statics. only locals whose address
+# is taken are kept here, so a parse uses under 32 bytes of it however deep it nests (as measured
+# by filling STACK with a pattern and nesting each kind of bracket and statement 1000 deep).
 MEMORY=65536
-STACK=2048
-
-emcc $FLAGS \
-  -s SIDE_MODULE=2 \
-  -s ALLOW_MEMORY_GROWTH=0 \
-  -s SUPPORT_LONGJMP=0 \
-  -s ERROR_ON_UNDEFINED_SYMBOLS=0 \
-  -s INITIAL_MEMORY=${MEMORY} \
-  -s TOTAL_STACK=${STACK} \
-  -o runner.wasm \
-  *.c ../core/*.c
-
-chmod -x runner.wasm
-echo "Ok! => runner.wasm"
+STACK=${STACK:-16384}
+
+# how deep statements and expressions can nest before ERROR__STACK, see PARSER_NEST_MAX. this is
+# bounded by the engine's call stack rather than STACK: it throws a RangeError when exhausted, and
+# with Node's default, the worst case (arrow functions of blocks, at -O1) gets about 2300 deep
+NEST_MAX=${NEST_MAX:-1024}
+
+# builds $1 with the remaining flags
+function build() {
+  OUT=$1
+  shift
+  emcc "$@" -DPARSER_NEST_MAX=${NEST_MAX} \
+    -s SIDE_MODULE=2 \
+    -s ALLOW_MEMORY_GROWTH=0 \
+    -s SUPPORT_LONGJMP=0 \
+    -s ERROR_ON_UNDEFINED_SYMBOLS=0 \
+    -s INITIAL_MEMORY=${MEMORY} \
+    -s TOTAL_STACK=${STACK} \
+    -o $OUT \
+    *.c ../core/*.c
+  chmod -x $OUT
+  echo "Ok! => $OUT"
+}
+
+# the baseline runs anywhere, importing memchr and friends from JS
+build runner.wasm $FLAGS
+
+# this uses SIMD128 for the tokenizer's scanning loops and for memchr, and bulk memory for memset
+# and memcpy, so none are imported (see mem.c): harness.runnerFile() picks it where supported
+build runner-simd.wasm $SIMD_FLAGS -msimd128 -mbulk-memory
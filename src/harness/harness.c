@@ -1,17 +1,255 @@
 #include "../core/token.h"
+#include "../core/parser.h"
+#include "../core/feed.h"
+#include "../core/reparse.h"
+#include "../core/rewrite.h"
+#include "../core/scope.h"
+#include "../core/intern.h"
+#include "../core/recover.h"
 
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>  // just for types
+#include <emscripten.h>
 
 // Confirm struct padding as the JS uses it to read values directly.
-static_assert(sizeof(struct token) == 24, "`struct token` should be 24 bytes");
+static_assert(sizeof(struct token) == 28, "`struct token` should be 28 bytes");
 static_assert(__builtin_offsetof(struct token, vp) == 0, "vp=0");
 static_assert(__builtin_offsetof(struct token, p) == 4, "p=4");
 static_assert(__builtin_offsetof(struct token, len) == 8, "len=8");
 static_assert(__builtin_offsetof(struct token, line_no) == 12, "line_no=12");
 static_assert(__builtin_offsetof(struct token, type) == 16, "type=16");
 static_assert(__builtin_offsetof(struct token, special) == 20, "special=20");
+static_assert(__builtin_offsetof(struct token, hash) == 24, "hash=24");
+
+// The JS places the parserdef in the otherwise unused first page of memory, at PARSER_AT.
+static_assert(sizeof(parserdef) <= 32768 - 64, "`parserdef` should fit before FEED_AT");
+
+// For chunked runs, the feeddef follows at FEED_AT, and the JS reads its window directly.
+static_assert(sizeof(feeddef) <= 16384, "`feeddef` should fit before REPARSE_AT");
+static_assert(__builtin_offsetof(feeddef, len) == 12, "len=12");
+static_assert(__builtin_offsetof(feeddef, offset) == 16, "offset=16");
+static_assert(__builtin_offsetof(feeddef, started) == 24, "started=24");
+
+// For edits, the reparsedef follows at REPARSE_AT, and its points after the input.
+static_assert(sizeof(reparse_point) == 104, "`reparse_point` should be 104 bytes");
+static_assert(__builtin_offsetof(reparsedef, first) == 32, "first=32");
+static_assert(__builtin_offsetof(reparsedef, end) == 48, "end=48");
+
+// For rewrites, the JS reads the count of spans found and then fills in their replacements.
+static_assert(sizeof(rewrite_span) == 24, "`rewrite_span` should be 24 bytes");
+static_assert(__builtin_offsetof(rewritedef, count) == 12, "count=12");
+
+// For scopes, the JS places the scopedef past the input, and reads its arrays and counts.
+static_assert(sizeof(scope_entry) == 16, "`scope_entry` should be 16 bytes");
+static_assert(sizeof(scope_binding) == 24, "`scope_binding` should be 24 bytes");
+static_assert(sizeof(scope_global) == 16, "`scope_global` should be 16 bytes");
+static_assert(sizeof(scopedef) == 60 + SCOPE_TABLE_SIZE * 8, "`scopedef` should be 60 bytes before tables");
+
+// For recovery, the recoverdef follows at RECOVER_AT with its errors just after, and the JS reads
+// them directly.
+static_assert(sizeof(reparsedef) <= 4096, "`reparsedef` should fit before RECOVER_AT");
+static_assert(sizeof(recoverdef) <= 64, "`recoverdef` should fit before its errors");
+static_assert(sizeof(recover_error) == 16, "`recover_error` should be 16 bytes");
+static_assert(__builtin_offsetof(recoverdef, count) == 16, "count=16");
+
+// For ids, the interndef sits at the end of the first page, with its table placed past the input.
+static_assert(sizeof(interndef) <= 64, "`interndef` should fit at INTERN_AT");
+static_assert(sizeof(intern_slot) == 16, "`intern_slot` should be 16 bytes");
+
+// The JS reads statsdef as words, with a count per token type first.
+static_assert(sizeof(statsdef) == (_TOKEN_MAX + 1 + 13) * 4, "`statsdef` should be all ints");
+
+// Provided by JS, called per-token or per-stack unless batching.
+void blep_harness_callback(parserdef *);
+int blep_harness_open(parserdef *, int);
+void blep_harness_close(parserdef *, int);
+
+// Provided by JS, passed a run of count records at buf.
+void blep_harness_flush(parserdef *, void *buf, int count);
+
+// In batch mode, tokens and stack events are appended here and only handed to JS when the buffer
+// fills or batching is changed. Offsets are relative to base, and events have p=-1.
+typedef struct {
+  int vp;
+  int p;
+  int len;
+  int line_no;
+  int type;     // token type, or stack type for events
+  int special;  // token special, or 1 for open and 0 for close
+  int hash;     // token hash, or zero for events
+} harness_record;
+
+static_assert(sizeof(harness_record) == sizeof(struct token), "records should match `struct token`");
+
+static struct {
+  harness_record *buf;
+  int len;
+  int cap;
+  char *base;
+} batch;
+
+// In rewrite mode, external strings are recorded here and there are no calls to JS at all.
+static rewritedef rewrite;
+
+// In scope mode, this points to a scopedef placed by JS, and again there are no calls to JS.
+static scopedef *scope;
+
+static void harness_flush(parserdef *pd) {
+  if (batch.len) {
+    blep_harness_flush(pd, batch.buf, batch.len);
+    batch.len = 0;
+  }
+}
+
+static inline harness_record *harness_record_next(parserdef *pd) {
+  if (batch.len == batch.cap) {
+    harness_flush(pd);
+  }
+  return batch.buf + batch.len++;
+}
+
+static inline void harness_record_stack(parserdef *pd, int type, int open) {
+  harness_record *r = harness_record_next(pd);
+  r->vp = 0;
+  r->p = -1;
+  r->len = 0;
+  r->line_no = pd->td.curr.line_no;
+  r->type = type;
+  r->special = open;
+  r->hash = 0;
+}
+
+// Flushes any pending records, then batches into buf (which holds cap records) or, if cap is zero,
+// goes back to calling out per-token.
+EMSCRIPTEN_KEEPALIVE
+void blep_harness_batch(parserdef *pd, harness_record *buf, int cap, char *base) {
+  if (pd->arg == &batch) {
+    harness_flush(pd);
+  }
+  batch.buf = buf;
+  batch.len = 0;
+  batch.cap = cap;
+  batch.base = base;
+  pd->arg = cap ? &batch : NULL;
+}
+
+// Records external strings into spans (which hold cap), decoding their values into values, for
+// the buffer at base. Only import/export statements are parsed, and everything else is scanned. If
+// spans is NULL, goes back to calling out per-token, but keeps what was found for emit.
+EMSCRIPTEN_KEEPALIVE
+rewritedef *blep_harness_rewrite(parserdef *pd, rewrite_span *spans, int cap, char *values, char *base, int len) {
+  if (spans) {
+    blep_rewrite_init(&rewrite, base, len, spans, cap, values);
+  }
+  pd->arg = spans ? &rewrite : NULL;
+  return &rewrite;
+}
+
+// Builds scopes into sd for the buffer at base, with its records in arena. If sd is NULL, goes back
+// to calling out per-token. See blep_scope_finish, which the JS calls once the parse is done.
+EMSCRIPTEN_KEEPALIVE
+void blep_harness_scope(parserdef *pd, scopedef *sd, void *arena, int size, char *base, int len) {
+  if (sd) {
+    blep_scope_init(sd, base, len, arena, size);
+  }
+  scope = sd;
+  pd->arg = sd;
+}
+
+void blep_parser_callback(parserdef *pd) {
+  if (!pd->arg) {
+    blep_harness_callback(pd);
+    return;
+  } else if (pd->arg == &rewrite) {
+    blep_rewrite_token(&rewrite, &(pd->td.curr));  // can't fill, see REWRITE_SPAN_BYTES
+    return;
+  } else if (pd->arg == scope) {
+    blep_scope_token(scope, &(pd->td.curr));
+    return;
+  }
+  struct token *t = &(pd->td.curr);
+  harness_record *r = harness_record_next(pd);
+  r->vp = t->vp - batch.base;
+  r->p = t->p - batch.base;
+  r->len = t->len;
+  r->line_no = t->line_no;
+  r->type = t->type;
+  r->special = t->special;
+  r->hash = t->hash;
+}
+
+int blep_parser_open(parserdef *pd, int type) {
+  if (!pd->arg) {
+    return blep_harness_open(pd, type);
+  } else if (pd->arg == &rewrite) {
+    return type == STACK__MODULE ? 0 : PARSER_SKIP_SCAN;
+  } else if (pd->arg == scope) {
+    blep_scope_open(scope, type, &(pd->td.curr));
+    return 0;
+  }
+  harness_record_stack(pd, type, 1);
+  return 0;  // batching can't skip stacks
+}
+
+void blep_parser_close(parserdef *pd, int type) {
+  if (!pd->arg) {
+    blep_harness_close(pd, type);
+    return;
+  } else if (pd->arg == &rewrite) {
+    return;
+  } else if (pd->arg == scope) {
+    blep_scope_close(scope, type);
+    return;
+  }
+  harness_record_stack(pd, type, 0);
+}
+
+// Records matching brackets into index for the parse just started, see blep_token_brackets.
+EMSCRIPTEN_KEEPALIVE
+void blep_harness_brackets(parserdef *pd, int *index, char *base) {
+  blep_token_brackets(&(pd->td), index, base);
+}
+
+// Brackets can nest as deep as the parser allows, rather than just the built-in stack. Chunked runs
+// need twice this, as they keep a copy to roll back to.
+static int stack_arena[PARSER_NEST_MAX * 4];
+
+// Gives the parse just started a bigger stack, see blep_token_stack.
+EMSCRIPTEN_KEEPALIVE
+int blep_harness_stack(parserdef *pd) {
+  return blep_token_stack(&(pd->td), stack_arena, PARSER_NEST_MAX);
+}
+
+// ... or the same for a chunked run, see blep_feed_stack.
+EMSCRIPTEN_KEEPALIVE
+void blep_harness_feed_stack(feeddef *fd) {
+  blep_feed_stack(fd, stack_arena, PARSER_NEST_MAX);
+}
+
+// ... or an incremental one, see blep_reparse_stack.
+EMSCRIPTEN_KEEPALIVE
+void blep_harness_reparse_stack(reparsedef *rd) {
+  blep_reparse_stack(rd, stack_arena, PARSER_NEST_MAX);
+}
+
+// Only tokenizes the input, without the parser's hints (so regexps may be guessed wrong), as does
+// bench.c. Returns the number of tokens, or ERROR__...
+EMSCRIPTEN_KEEPALIVE
+int blep_harness_tokenize(parserdef *pd, char *base, int len) {
+  tokendef *td = &(pd->td);
+  int ret = blep_token_init(td, base, len);
+  if (ret < 0) {
+    return ret;
+  }
+  blep_token_stack(td, stack_arena, PARSER_NEST_MAX);
+
+  int count = 0;
+  while ((ret = blep_token_next(td)) > 0) {
+    ++count;
+  }
+  return ret ? ret : count;
+}
 
 int isdigit(int c) {
   return (c >= '0' && c <= '9');
@@ -22,8 +22,27 @@ import * as blep from './types/index.js';
 
 const PAGE_SIZE = 65536;
 const WRITE_AT = PAGE_SIZE * 2;
+const PARSER_AT = 64;  // parserdef lives in the first page, which is otherwise unused
+const FEED_AT = PAGE_SIZE / 2;  // ... as does the feeddef, for chunked runs
+const FEED_WINDOW = PAGE_SIZE * 16;  // initial window for chunked runs, doubled as needed
+const REPARSE_AT = FEED_AT + PAGE_SIZE / 4;  // ... and the reparsedef, for edits
+const REPARSE_POINT_COUNT = 8192;  // statements past this are parsed again from the last point
+const REPARSE_POINT_SIZE = 104;
+const RECOVER_AT = REPARSE_AT + PAGE_SIZE / 16;  // ... and the recoverdef, then its errors
+const RECOVER_ERROR_COUNT = 256;  // errors past this are recovered from, but not listed
+const INTERN_AT = PAGE_SIZE - 64;  // ... and the interndef, for token ids
+const INTERN_TABLE_SIZE = PAGE_SIZE;  // initial table for ids, doubled as needed
 const ERROR_CONTEXT_MAX = 256;  // display this much text on either side
-const TOKEN_WORD_COUNT = 6;
+const TOKEN_WORD_COUNT = 7;
+const BATCH_RECORD_COUNT = 4096;  // records are the same size as tokens
+const REWRITE_SPAN_BYTES = 6;  // source bytes per external string, at least
+const REWRITE_SPAN_WORDS = 6;
+const SCOPE_SIZE = 60 + 4096 * 8;  // scopedef, including its tables
+const SCOPE_RECORD_SIZE = 16 + 24 + 16 + 16;  // a scope, binding, global and reference
+const SCOPE_FULL = -7;
+const INTERN_FULL = -8;
+const STATS_TOKEN_TYPES = 17;  // statsdef starts with a count per token type
+const STATS_WORD_COUNT = STATS_TOKEN_TYPES + 13;
 
 const safeEval = eval;  // try to avoid global side-effects with rename
 
@@ -31,7 +50,33 @@ export const noop = () => {};
 /** @type {blep.Handlers} */
 const defaultHandlers = {callback: noop, open: noop, close: noop};
 
+/** @type {blep.BatchHandler} */
+const defaultBatch = noop;
+
+// tiny modules using i8x16.popcnt and memory.copy, to check what the engine supports
+const SIMD_PROBE = [
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15,
+  253, 98, 11,
+];
+const BULK_MEMORY_PROBE = [
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 4, 1, 96, 0, 0, 3, 2, 1, 0, 5, 3, 1, 0, 1, 10, 14, 1, 12, 0, 65,
+  0, 65, 0, 65, 0, 252, 10, 0, 0, 11,
+];
+
+/**
+ * Returns the name of the runner to load: "runner-simd.wasm" if this engine supports SIMD128 and
+ * bulk memory (so scanning is vectorized and memchr and friends don't call out to JS), otherwise
+ * "runner.wasm", which runs anywhere. Both are built by "build.sh".
+ *
+ * @return {string}
+ */
+export function runnerFile() {
+  const supported = (/** @type {number[]} */ probe) => WebAssembly.validate(new Uint8Array(probe));
+  return supported(SIMD_PROBE) && supported(BULK_MEMORY_PROBE) ? 'runner-simd.wasm' : 'runner.wasm';
+}
+
 const decoder = new TextDecoder('utf-8');
+const encoder = new TextEncoder();
 
 const errorMap = new Map();
 errorMap.set(-1, 'unexpected');
@@ -39,10 +84,18 @@ errorMap.set(-2, 'stack');
 errorMap.set(-3, 'internal');
 Object.freeze(errorMap);
 
+const UNESCAPE_RAW = -5;
+const UNESCAPE_SURROGATE = -6;
+
+const FEED_DONE = 0;
+const FEED_STATEMENT = 1;
+const FEED_MORE = 2;
+const PARSER_SKIP_SCAN = 2;
+
 import {string as stringType} from './types/v-types.js';
 
 /**
- * @param {Promise<BufferSource>|BufferSource} modulePromise
+ * @param {Promise<BufferSource|WebAssembly.Module>|BufferSource|WebAssembly.Module} modulePromise
  * @param {blep.InternalImports} imports
  * @return {Promise<{
  *   instance: WebAssembly.Instance,
@@ -62,7 +115,10 @@ async function initialize(modulePromise, imports) {
 
   const module = await modulePromise;
   const instantiatedSource = await WebAssembly.instantiate(module, importObject);
-  const {instance} = instantiatedSource;
+
+  // An already compiled module instantiates to just its instance.
+  const instance = instantiatedSource instanceof WebAssembly.Instance ?
+      instantiatedSource : instantiatedSource.instance;
 
   // In the browser, the exports appear on instantiatedSource; in Node, they're on instance.
   // @ts-ignore
@@ -75,11 +131,14 @@ async function initialize(modulePromise, imports) {
 }
 
 /**
- * @param {Promise<BufferSource>|BufferSource} modulePromise
+ * Builds a harness with its own memory. Pass a compiled module to build many harnesses cheaply.
+ *
+ * @param {Promise<BufferSource|WebAssembly.Module>|BufferSource|WebAssembly.Module} modulePromise
  * @return {Promise<blep.Harness>}
  */
 export default async function build(modulePromise) {
   let {callback, open, close} = defaultHandlers;
+  let batch = defaultBatch;
 
   // These views need to be mutable as they'll point to a new WebAssembly.Memory when it gets
   // resized for a new run.
@@ -93,6 +152,16 @@ export default async function build(modulePromise) {
       return s;
     },
 
+    memcpy(dest, src, n) {
+      view.copyWithin(dest, src, src + n);
+      return dest;
+    },
+
+    memmove(dest, src, n) {
+      view.copyWithin(dest, src, src + n);
+      return dest;
+    },
+
     memchr(ptr, char, len) {
       const index = view.subarray(ptr, ptr + len).indexOf(char);
       if (index === -1) {
@@ -101,18 +170,23 @@ export default async function build(modulePromise) {
       return ptr + index;
     },
 
-    blep_parser_callback() {
+    blep_harness_callback() {
       callback();
     },
 
-    blep_parser_open(type) {
-      // if specifically returns false, skip this stack
-      return open(type) === false ? 1 : 0;
+    blep_harness_open(pd, type) {
+      // if specifically returns false, skip this stack (or "scan" to skim through it)
+      const ret = open(type);
+      return ret === false ? 1 : (ret === 'scan' ? PARSER_SKIP_SCAN : 0);
     },
 
-    blep_parser_close(type) {
+    blep_harness_close(pd, type) {
       close(type);
     },
+
+    blep_harness_flush(pd, at, count) {
+      batch(new Int32Array(memory.buffer, at, count * TOKEN_WORD_COUNT));
+    },
   };
 
   const {memory, calls} = await initialize(modulePromise, imports);
@@ -121,23 +195,63 @@ export default async function build(modulePromise) {
     blep_parser_init: parser_init,
     blep_parser_run: parser_run,
     blep_parser_cursor: parser_cursor,
+    blep_stats: parser_stats,
+    blep_unescape: unescape,
+    blep_harness_batch: harness_batch,
+    blep_harness_brackets: harness_brackets,
+    blep_harness_stack: harness_stack,
+    blep_harness_feed_stack: harness_feed_stack,
+    blep_harness_reparse_stack: harness_reparse_stack,
+    blep_harness_tokenize: harness_tokenize,
+    blep_harness_rewrite: harness_rewrite,
+    blep_rewrite_emit: rewrite_emit,
+    blep_harness_scope: harness_scope,
+    blep_scope_finish: scope_finish,
+    blep_intern_init: intern_init,
+    blep_intern_grow: intern_grow,
+    blep_intern_token: intern_token,
+    blep_lines_index: lines_index,
+    blep_lines_find: lines_find,
+    blep_recover_init: recover_init,
+    blep_recover_run: recover_run,
+    blep_feed_init: feed_init,
+    blep_feed_buffer: feed_buffer,
+    blep_feed_space: feed_space,
+    blep_feed_push: feed_push,
+    blep_feed_run: feed_run,
+    blep_reparse_init: reparse_init,
+    blep_reparse_points: reparse_points,
+    blep_reparse_run: reparse_run,
+    blep_reparse_edit: reparse_edit,
   } = calls;
 
-  const tokenAt = parser_cursor();
+  const tokenAt = parser_cursor(PARSER_AT);
   if (tokenAt >= WRITE_AT) {
     throw new Error(`token in invalid location`);
   }
 
   let tokenView = new Int32Array(memory.buffer, tokenAt, TOKEN_WORD_COUNT);
   let inputSize = 0;
+  let batchAt = 0;
+  let inputAt = WRITE_AT;  // where offset zero of the input is, behind WRITE_AT for chunked runs
+  let pointsAt = 0;  // reparse points, placed after the input with space for it to grow
+  let bracketsAt = 0;  // bracket index, placed after batch records if wanted
+  let memoryUsed = WRITE_AT;  // past everything placed so far, where string values are written
+  let stringReserve = 0;  // room kept after memoryUsed, as a string value can't grow memory mid-run
+  let lazyAt = 0;  // past tables built on demand for this input, or zero if there are none yet
+  let internAt = 0;  // table for token ids, placed on first use (-1 if chunked)
+  let internSize = 0;
+  let internReady = false;  // whether the table has been started for this run
+  let linesAt = 0;  // newline offsets, found on first use until the input changes (-1 if chunked)
+  let linesCount = 0;
 
   const token = /** @type {blep.Token} */ ({
     void() {
-      return tokenView[0] - WRITE_AT;
+      return tokenView[0] - inputAt;
     },
 
     at() {
-      return tokenView[1] - WRITE_AT;
+      return tokenView[1] - inputAt;
     },
 
     length() {
@@ -156,6 +270,33 @@ export default async function build(modulePromise) {
       return tokenView[5];
     },
 
+    hash() {
+      return tokenView[6] >>> 0;
+    },
+
+    id() {
+      if (!tokenView[6]) {
+        return -1;
+      } else if (internAt < 0) {
+        throw new Error('Can\'t id() during runChunked()');
+      } else if (!internAt) {
+        internSize = INTERN_TABLE_SIZE;
+        internAt = placeLazy(internSize);
+      }
+      if (!internReady) {
+        intern_init(INTERN_AT, inputAt, internAt, internSize);
+        internReady = true;
+      }
+
+      let ret;
+      while ((ret = intern_token(INTERN_AT, tokenAt)) === INTERN_FULL) {
+        internSize *= 2;
+        internAt = placeLazy(internSize);
+        intern_grow(INTERN_AT, internAt, internSize);
+      }
+      return ret;
+    },
+
     view() {
       return view.subarray(tokenView[1], tokenView[1] + tokenView[2]);
     },
@@ -168,11 +309,12 @@ export default async function build(modulePromise) {
       if (tokenView[4] !== stringType) {
         throw new TypeError('Can\'t stringValue() on non-string');
       }
-      const target = view.subarray(tokenView[1], tokenView[1] + tokenView[2]);
+      const at = tokenView[1];
+      const length = tokenView[2];
 
-      switch (target[0]) {
+      switch (view[at]) {
         case 96:
-          if (target[target.length - 1] == 96) {
+          if (length > 1 && view[at + length - 1] == 96) {
             break;
           }
           // fall-through
@@ -181,7 +323,18 @@ export default async function build(modulePromise) {
           throw new TypeError('Can\'t stringValue() on template string with holes');
       }
 
-      return safeEval(decoder.decode(target));
+      // the value is never longer than the token, so write it just past everything else, in room
+      // already kept for it (see ensureMemory)
+      const scratchAt = memoryUsed;
+      const ret = unescape(at, length, scratchAt);
+      if (ret >= 0) {
+        return decoder.decode(view.subarray(scratchAt, scratchAt + ret));
+      } else if (ret === UNESCAPE_RAW) {
+        return decoder.decode(view.subarray(at + 1, at + length - 1));
+      } else if (ret === UNESCAPE_SURROGATE) {
+        return safeEval(decoder.decode(view.subarray(at, at + length)));  // rare, and not UTF-8
+      }
+      throw new TypeError('Can\'t stringValue() on invalid string');
     },
   });
 
@@ -193,19 +346,63 @@ export default async function build(modulePromise) {
      * @return {Uint8Array}
      */
     prepare(size) {
-      const memoryNeeded = WRITE_AT + size + 1;
-      if (memory.buffer.byteLength < memoryNeeded) {
-        memory.grow(Math.ceil((memoryNeeded - memory.buffer.byteLength) / PAGE_SIZE));
-      }
+      stringReserve = size;
 
-      tokenView = new Int32Array(memory.buffer, tokenAt, TOKEN_WORD_COUNT);  // in 32-bit
-      view = new Uint8Array(memory.buffer);
+      // batch records go after the input and its NULL
+      batchAt = (WRITE_AT + size + 1 + 7) & ~7;
+      ensureMemory(batchAt + BATCH_RECORD_COUNT * TOKEN_WORD_COUNT * 4);
       view[WRITE_AT + size] = 0;  // null-terminate
       inputSize = size;
+      pointsAt = 0;
+      bracketsAt = 0;
+      resetLazy();
 
       return new Uint8Array(memory.buffer, WRITE_AT, size);
     },
 
+    brackets() {
+      bracketsAt = batchAt + BATCH_RECORD_COUNT * TOKEN_WORD_COUNT * 4;
+      ensureMemory(bracketsAt + inputSize * 4);
+      resetLazy();
+      const index = new Int32Array(memory.buffer, bracketsAt, inputSize);
+      index.fill(-1);
+      return index;
+    },
+
+    /**
+     * @param {number} at
+     * @return {blep.Position}
+     */
+    position(at) {
+      if (linesAt < 0) {
+        throw new Error('Can\'t position() during runChunked()');
+      } else if (!(at >= 0 && at <= inputSize)) {
+        throw new RangeError(`invalid offset: ${at} of ${inputSize}`);
+      }
+      return positionOf(at);
+    },
+
+    memorySize() {
+      return memory.buffer.byteLength;
+    },
+
+    stats() {
+      const at = parser_stats(PARSER_AT);
+      if (!at) {
+        return null;
+      }
+      const words = new Int32Array(memory.buffer, at, STATS_WORD_COUNT);
+      const [
+        replayed, voidBytes, stringBytes, templateBytes, regexpBytes, setRestores, restores,
+        relexedBytes, updates, depthMax, callbacks, opens, closes,
+      ] = words.subarray(STATS_TOKEN_TYPES);
+      return {
+        tokens: Array.from(words.subarray(0, STATS_TOKEN_TYPES)),
+        replayed, voidBytes, stringBytes, templateBytes, regexpBytes, setRestores, restores,
+        relexedBytes, updates, depthMax, callbacks, opens, closes,
+      };
+    },
+
     /**
      * @param {Partial<blep.Handlers>} handlers
      */
@@ -214,37 +411,424 @@ export default async function build(modulePromise) {
     },
 
     run() {
+      try {
+        return runParser();
+      } finally {
+        // reset handlers
+        ({callback, open, close} = defaultHandlers);
+      }
+    },
+
+    tokenize() {
+      const ret = harness_tokenize(PARSER_AT, WRITE_AT, inputSize);
+      if (ret < 0) {
+        throwError(ret);
+      }
+      return ret;
+    },
+
+    /**
+     * @return {blep.RecoverResult}
+     */
+    runRecover() {
+      try {
+        const statements = runParser(noop, true);
+        const count = new Int32Array(memory.buffer, RECOVER_AT + 16, 1)[0];
+        const records = new Int32Array(memory.buffer, RECOVER_AT + 64, Math.min(count, RECOVER_ERROR_COUNT) * 4);
+
+        /** @type {blep.RecoverError[]} */
+        const errors = [];
+        for (let i = 0; i < records.length; i += 4) {
+          const type = errorMap.get(records[i]) || `(? ${records[i]})`;
+          errors.push({type, at: records[i + 1], stack: records[i + 2], depth: records[i + 3]});
+        }
+        return {statements, errors, count};
+      } finally {
+        ({callback, open, close} = defaultHandlers);
+      }
+    },
+
+    /**
+     * @param {blep.BatchHandler} handler
+     * @param {() => boolean=} cancelled
+     */
+    runBatch(handler, cancelled) {
+      batch = handler;
+      harness_batch(PARSER_AT, batchAt, BATCH_RECORD_COUNT, WRITE_AT);
+      try {
+        return runParser(() => harness_batch(PARSER_AT, 0, 0, 0), false, cancelled);
+      } finally {
+        harness_batch(PARSER_AT, 0, 0, 0);
+        batch = defaultBatch;
+      }
+    },
+
+    /**
+     * @param {blep.RewriteResolver} resolve
+     * @param {(number|string|Uint8Array|undefined)[]=} edits
+     * @return {Uint8Array}
+     */
+    runRewrite(resolve, edits) {
+      // spans and values go past everything else, as they're only needed until this returns
+      const cap = Math.floor(inputSize / REWRITE_SPAN_BYTES) + 1;
+      const spansAt = (memoryUsed + 7) & ~7;
+      const valuesAt = spansAt + cap * REWRITE_SPAN_WORDS * 4;
+      growMemory(valuesAt + inputSize);
+
+      const rewriteAt = harness_rewrite(PARSER_AT, spansAt, cap, valuesAt, WRITE_AT, inputSize);
+      try {
+        runParser(() => harness_rewrite(PARSER_AT, 0, 0, 0, 0, 0));
+      } finally {
+        harness_rewrite(PARSER_AT, 0, 0, 0, 0, 0);
+      }
+
+      const count = new Int32Array(memory.buffer, rewriteAt, 4)[3];
+      let spans = new Int32Array(memory.buffer, spansAt, count * REWRITE_SPAN_WORDS);
+
+      /** @type {(string|undefined)[]} */
+      const values = [];
+      for (let i = 0; i < spans.length; i += REWRITE_SPAN_WORDS) {
+        const at = valuesAt + spans[i + 2];
+        values.push(spans[i + 2] < 0 ? undefined : decoder.decode(view.subarray(at, at + spans[i + 3])));
+      }
+
+      // replacements are quoted, and written together after the values
+      const quoted = resolve(values).map((value, i) => {
+        return typeof value === 'string' && value !== values[i] ? JSON.stringify(value) : undefined;
+      });
+      const replaceAt = valuesAt + inputSize;
+      const replaceMax = quoted.reduce((max, q) => max + (q === undefined ? 0 : q.length * 3), 0);
+      growMemory(replaceAt + replaceMax * 2 + inputSize);
+      spans = new Int32Array(memory.buffer, spansAt, count * REWRITE_SPAN_WORDS);
+
+      let replaceLength = 0;
+      let size = inputSize;
+      quoted.forEach((q, i) => {
+        if (edits) {
+          const at = spans[i * REWRITE_SPAN_WORDS];
+          edits.push(at, at + spans[i * REWRITE_SPAN_WORDS + 1], q);
+        }
+        if (q === undefined) {
+          return;
+        }
+        const target = view.subarray(replaceAt + replaceLength, replaceAt + replaceMax);
+        const {written = 0} = encoder.encodeInto(q, target);
+        spans[i * REWRITE_SPAN_WORDS + 4] = replaceLength;
+        spans[i * REWRITE_SPAN_WORDS + 5] = written;
+        replaceLength += written;
+        size += written - spans[i * REWRITE_SPAN_WORDS + 1];
+      });
+
+      const outAt = replaceAt + replaceLength;
+      const length = rewrite_emit(rewriteAt, replaceAt, outAt);
+      if (length !== size) {
+        throw new Error(`rewrite mismatch: ${length}/${size}`);
+      }
+      return view.subarray(outAt, outAt + length);
+    },
+
+    /**
+     * @return {blep.ScopeResult}
+     */
+    runScope() {
+      // start with room for a record per 8 bytes, doubled until everything fits
+      const scopeAt = (memoryUsed + 7) & ~7;
+      const arenaAt = scopeAt + SCOPE_SIZE;
+      let records = (inputSize >> 3) + 64;
+
+      for (;;) {
+        growMemory(arenaAt + records * SCOPE_RECORD_SIZE);
+        harness_scope(PARSER_AT, scopeAt, arenaAt, records * SCOPE_RECORD_SIZE, WRITE_AT, inputSize);
+        try {
+          runParser(() => harness_scope(PARSER_AT, 0, 0, 0, 0, 0));
+        } finally {
+          harness_scope(PARSER_AT, 0, 0, 0, 0, 0);
+        }
+
+        const ret = scope_finish(scopeAt);
+        if (ret !== SCOPE_FULL) {
+          break;
+        }
+        records *= 2;
+      }
+
+      const [, scopesAt, scopesCount, bindingsAt, bindingsCount, globalsAt, globalsCount] =
+          new Int32Array(memory.buffer, scopeAt, 7);
+      return {
+        scopes: new Int32Array(memory.buffer, scopesAt, scopesCount * 4),
+        bindings: new Int32Array(memory.buffer, bindingsAt, bindingsCount * 6),
+        globals: new Int32Array(memory.buffer, globalsAt, globalsCount * 4),
+      };
+    },
+
+    /**
+     * @param {blep.ChunkedSource} source
+     */
+    runChunked({read, release = noop, statement = noop, rewind = noop}) {
+      resetLazy();
+      internAt = linesAt = -1;  // input is dropped as it's parsed, so nothing can refer back to it
+      let capacity = FEED_WINDOW;
+      stringReserve = capacity;
+      ensureMemory(WRITE_AT + capacity);
+      feed_init(FEED_AT, PARSER_AT, WRITE_AT, capacity);
+      harness_feed_stack(FEED_AT);
+
       let statements = 0;
-      let ret = parser_init(WRITE_AT, inputSize);
-      if (ret >= 0) {
-        do {
-          ret = parser_run();
-          ++statements;
-        } while (ret > 0);
+      try {
+        for (;;) {
+          const ret = feed_run(FEED_AT);
+          if (ret === FEED_STATEMENT) {
+            ++statements;
+            statement();
+            continue;
+          } else if (ret !== FEED_MORE) {
+            if (ret === FEED_DONE) {
+              return statements + 1;  // counts the final run, as run() does
+            }
+            throwError(ret);
+          }
+          rewind();
+
+          // everything before the statement in progress is about to be dropped
+          let feedView = new Int32Array(memory.buffer, FEED_AT, 7);
+          if (feedView[6]) {
+            release(tokenView[0] - inputAt);
+          }
+
+          let space = feed_space(FEED_AT);
+          if (space === 0) {
+            // a single statement fills the window, so it has to grow
+            capacity *= 2;
+            stringReserve = capacity;
+            ensureMemory(WRITE_AT + capacity);
+            feed_buffer(FEED_AT, WRITE_AT, capacity);
+            space = feed_space(FEED_AT);
+            feedView = new Int32Array(memory.buffer, FEED_AT, 7);
+          }
+          inputAt = WRITE_AT - feedView[4];
+
+          const at = WRITE_AT + feedView[3];
+          const length = read(new Uint8Array(memory.buffer, at, space));
+          if (!(length >= 0 && length <= space)) {
+            throw new RangeError(`read() returned invalid length: ${length}`);
+          }
+          feed_push(FEED_AT, length, length === 0 ? 1 : 0);
+        }
+      } finally {
+        inputAt = WRITE_AT;
+        internAt = linesAt = 0;
+        ({callback, open, close} = defaultHandlers);
       }
+    },
 
-      // reset handlers
-      ({callback, open, close} = defaultHandlers);
+    runIncremental() {
+      internReady = false;
+      placePoints();
+      reparse_init(REPARSE_AT, PARSER_AT, pointsAt, REPARSE_POINT_COUNT);
+      harness_reparse_stack(REPARSE_AT);
+      try {
+        const ret = reparse_run(REPARSE_AT, WRITE_AT, inputSize);
+        if (ret < 0) {
+          throwError(ret);
+        }
+        return ret;
+      } finally {
+        ({callback, open, close} = defaultHandlers);
+      }
+    },
 
-      if (ret === 0) {
-        return statements;
+    /**
+     * @param {number} at
+     * @param {number} deleted
+     * @param {Uint8Array|string} inserted
+     * @return {blep.EditResult}
+     */
+    edit(at, deleted, inserted) {
+      if (!pointsAt) {
+        throw new Error(`edit() requires runIncremental()`);
       }
-      const at = tokenView[1];
-      const view = new Uint8Array(memory.buffer);
+      if (!(at >= 0 && deleted >= 0 && at + deleted <= inputSize)) {
+        throw new RangeError(`invalid edit: ${at}+${deleted} of ${inputSize}`);
+      }
+      const bytes = typeof inserted === 'string' ? encoder.encode(inserted) : inserted;
+
+      const size = inputSize + bytes.length - deleted;
+      stringReserve = Math.max(stringReserve, size);
+      ensureMemory(memoryUsed);
+      if (WRITE_AT + size + 1 > pointsAt) {
+        // the input has outgrown its space, so move the points
+        const prev = pointsAt;
+        placePoints(size);
+        view.copyWithin(pointsAt, prev, prev + REPARSE_POINT_COUNT * REPARSE_POINT_SIZE);
+        reparse_points(REPARSE_AT, pointsAt, REPARSE_POINT_COUNT);
+      }
+
+      // includes the trailing NULL
+      view.copyWithin(WRITE_AT + at + bytes.length, WRITE_AT + at + deleted, WRITE_AT + inputSize + 1);
+      view.set(bytes, WRITE_AT + at);
+      inputSize = size;
 
-      // Special-case crash on a NULL byte. There was no more input.
-      if (view[at] === 0) {
-        throw new TypeError(`Unexpected end of input`);
+      resetLazy();
+      try {
+        const ret = reparse_edit(REPARSE_AT, WRITE_AT, size, at, deleted, bytes.length);
+        if (ret < 0) {
+          throwError(ret);
+        }
+        const [first, removed, added, start, end] = new Int32Array(memory.buffer, REPARSE_AT + 32, 5);
+        return {first, removed, added, start, end};
+      } finally {
+        ({callback, open, close} = defaultHandlers);
       }
+    },
 
-      // Otherwise, generate a sane error.
-      const lineNo = tokenView[3];
-      const {line, pos, offset} = lineAround(view, at, WRITE_AT);
-      const errorType = errorMap.get(ret) || `(? ${ret})`;
-      throw new TypeError(`[${lineNo}:${pos}] ${errorType}:\n${line}\n${'^'.padStart(offset + 1)}`);
+    /**
+     * @param {number} start
+     * @param {number} end
+     * @return {Uint8Array}
+     */
+    input(start, end) {
+      return view.subarray(inputAt + start, inputAt + end);
     },
 
   };
+
+  /**
+   * Places reparse points after the input, leaving as much space again for it to grow, with batch
+   * records after them.
+   *
+   * @param {number} size
+   */
+  function placePoints(size = inputSize) {
+    bracketsAt = 0;  // would be in the way
+    pointsAt = (WRITE_AT + size * 2 + PAGE_SIZE) & ~7;
+    batchAt = pointsAt + REPARSE_POINT_COUNT * REPARSE_POINT_SIZE;
+    ensureMemory(batchAt + BATCH_RECORD_COUNT * TOKEN_WORD_COUNT * 4);
+    resetLazy();
+  }
+
+  /**
+   * Finds the line and column of this offset into the input, indexing its newlines on first use.
+   *
+   * @param {number} at
+   * @return {blep.Position}
+   */
+  function positionOf(at) {
+    if (!linesAt) {
+      linesCount = lines_index(WRITE_AT, inputSize, 0, 0);
+      linesAt = placeLazy(linesCount * 4);
+      lines_index(WRITE_AT, inputSize, linesAt, linesCount);
+    }
+    const line = lines_find(linesAt, linesCount, at);
+    const start = line ? new Int32Array(memory.buffer, linesAt, linesCount)[line - 1] + 1 : 0;
+    return {line: line + 1, column: at - start};
+  }
+
+  /**
+   * Drops tables built on demand, as what they were placed after (or built from) has changed.
+   */
+  function resetLazy() {
+    lazyAt = internAt = linesAt = 0;
+    internReady = false;
+  }
+
+  /**
+   * Places a table built on demand after everything else for this input, growing memory for it.
+   *
+   * @param {number} size
+   * @return {number}
+   */
+  function placeLazy(size) {
+    if (!lazyAt) {
+      lazyAt = bracketsAt ?
+          bracketsAt + inputSize * 4 : batchAt + BATCH_RECORD_COUNT * TOKEN_WORD_COUNT * 4;
+    }
+    const at = (lazyAt + 15) & ~15;
+    lazyAt = at + size;
+    ensureMemory(lazyAt);
+    return at;
+  }
+
+  /**
+   * Grows memory to at least this size for data placed within it, plus room for a string value
+   * after it. Growing detaches views of memory that callers may hold, so that must happen here,
+   * before a run, rather than from stringValue during one.
+   *
+   * @param {number} memoryNeeded
+   */
+  function ensureMemory(memoryNeeded) {
+    memoryUsed = Math.max(memoryUsed, memoryNeeded);
+    growMemory(memoryUsed + stringReserve);
+  }
+
+  /**
+   * Grows memory to at least this size, updating views.
+   *
+   * @param {number} memoryNeeded
+   */
+  function growMemory(memoryNeeded) {
+    if (memory.buffer.byteLength < memoryNeeded) {
+      memory.grow(Math.ceil((memoryNeeded - memory.buffer.byteLength) / PAGE_SIZE));
+    }
+    tokenView = new Int32Array(memory.buffer, tokenAt, TOKEN_WORD_COUNT);  // in 32-bit
+    view = new Uint8Array(memory.buffer);
+  }
+
+  /**
+   * @param {() => void} done called once the parse has stopped, before any error is thrown
+   * @param {boolean} recover whether to keep going past errors, see runRecover
+   * @param {() => boolean=} cancelled checked between statements, throwing an AbortError if true
+   * @return {number} statements
+   */
+  function runParser(done = noop, recover = false, cancelled) {
+    internReady = false;
+    let statements = 0;
+    let ret = parser_init(PARSER_AT, WRITE_AT, inputSize);
+    if (ret >= 0) {
+      harness_stack(PARSER_AT);
+      if (bracketsAt) {
+        harness_brackets(PARSER_AT, bracketsAt, WRITE_AT);
+      }
+      if (recover) {
+        recover_init(RECOVER_AT, PARSER_AT, WRITE_AT, RECOVER_AT + 64, RECOVER_ERROR_COUNT);
+      }
+      do {
+        ret = recover ? recover_run(RECOVER_AT) : parser_run(PARSER_AT);
+        ++statements;
+      } while (ret > 0 && !(cancelled && cancelled()));
+    }
+    done();
+
+    if (ret > 0) {
+      const error = new Error('parse cancelled');
+      error.name = 'AbortError';
+      throw error;
+    }
+
+    if (ret === 0) {
+      return statements;
+    }
+    throwError(ret);
+  }
+
+  /**
+   * @param {number} ret
+   * @return {never}
+   */
+  function throwError(ret) {
+    const at = tokenView[1];
+    const view = new Uint8Array(memory.buffer);
+
+    // Special-case crash on a NULL byte. There was no more input.
+    if (view[at] === 0) {
+      throw new TypeError(`Unexpected end of input`);
+    }
+
+    // Otherwise, generate a sane error. Chunked input isn't all there, so can't be indexed.
+    const lineNo = linesAt >= 0 ? positionOf(at - WRITE_AT).line : tokenView[3];
+    const {line, pos, offset} = lineAround(new Uint8Array(memory.buffer), at, WRITE_AT);
+    const errorType = errorMap.get(ret) || `(? ${ret})`;
+    throw new TypeError(`[${lineNo}:${pos}] ${errorType}:\n${line}\n${'^'.padStart(offset + 1)}`);
+  }
 }
 
 /**
@@ -0,0 +1,44 @@
+#include "../core/simd.h"
+
+#include <string.h>  // just for types
+
+// With bulk memory and SIMD128 (the runner-simd.wasm variant, see build.sh), the memory functions
+// the core calls are built in, rather than imported from JS. Otherwise this is empty.
+#if defined(__wasm_bulk_memory__) && defined(__wasm_simd128__) && defined(BLEP_SIMD)
+
+// these lower to memory.fill and memory.copy with bulk memory, rather than calling back here
+
+void *memset(void *s, int c, size_t n) {
+  __builtin_memset(s, c, n);
+  return s;
+}
+
+void *memcpy(void *dest, const void *src, size_t n) {
+  __builtin_memmove(dest, src, n);  // memory.copy allows overlap anyway
+  return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t n) {
+  __builtin_memmove(dest, src, n);
+  return dest;
+}
+
+// aligned loads never cross a page (or the end of memory), so the first and last blocks can be
+// read whole, as per blep_lines_index
+void *memchr(const void *s, int c, size_t n) {
+  char *p = (char *) s;
+  char *end = p + n;
+  char *b = vec_align(p);
+  uint64_t valid = ~vec_before(p - b);
+
+  for (; b < end; b += VEC_SIZE) {
+    uint64_t found = vec_mask(vec_eq(vec_load(b), (char) c)) & valid & vec_before(end - b);
+    if (found) {
+      return b + vec_index(found);
+    }
+    valid = VEC_FULL;
+  }
+  return NULL;
+}
+
+#endif
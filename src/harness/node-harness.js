@@ -22,14 +22,42 @@
 import * as blep from './types/index.js';
 
 export * from './harness.js';
-import build from './harness.js';
+import build, {runnerFile} from './harness.js';
+import buildPoolFrom from './pool.js';
 
 import * as fs from 'fs';
 
+/** @type {Promise<WebAssembly.Module>=} */
+let compiled;
+
+/**
+ * Compiles the runner wasm once per process, as every harness can share the module. This is the
+ * SIMD variant where supported, see runnerFile.
+ *
+ * @return {Promise<WebAssembly.Module>}
+ */
+const compile = () => {
+  if (compiled === undefined) {
+    let {pathname} = new URL(`./${runnerFile()}`, import.meta.url);
+    if (!fs.existsSync(pathname)) {
+      ({pathname} = new URL('./runner.wasm', import.meta.url));  // not built, or not published
+    }
+    compiled = WebAssembly.compile(fs.readFileSync(pathname));
+  }
+  return compiled;
+};
+
 /**
  * @return {!Promise<blep.Harness>}
  */
 export default async function wrapper() {
-  const {pathname} = new URL('./runner.wasm', import.meta.url);
-  return build(fs.readFileSync(pathname));
+  return build(compile());
+}
+
+/**
+ * @param {Partial<blep.PoolOptions>=} options
+ * @return {!Promise<blep.Pool>}
+ */
+export async function buildPool(options) {
+  return buildPoolFrom(compile(), options);
 }
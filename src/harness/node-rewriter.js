@@ -24,9 +24,12 @@
 import * as blep from './types/index.js';
 import * as fs from 'fs';
 import {noop} from './harness.js';
+import * as common from './common.js';
+import {buildSourceMap} from './source-map.js';
 
 
 const PENDING_BUFFER_MAX = 1024 * 16;
+const CHUNKED_SIZE_MIN = 1024 * 1024 * 16;  // larger files aren't read into memory at once
 const encoder = new TextEncoder();
 
 
@@ -35,18 +38,135 @@ const encoder = new TextEncoder();
  * @return {blep.RewriterReturn}
  */
 export default function wrapper(harness) {
-  const {prepare, token, run: internalRun, handle} = harness;
+  const {prepare, token, run: internalRun, handle, runChunked, runRewrite, input} = harness;
+
+  /**
+   * @param {string|Uint8Array} update
+   * @return {Uint8Array}
+   */
+  const encode = (update) => typeof update === 'string' ? encoder.encode(update) : update;
+
+  /**
+   * Writes are held until each statement completes, as a statement cut short by the end of a chunk
+   * is parsed again. Source is copied out as the window it's in will be reused.
+   *
+   * @param {number} fd
+   * @param {blep.RewriterArgs} args
+   */
+  const runFile = (fd, {callback, stack, write, sourceMap}) => {
+    if (sourceMap) {
+      throw new Error(`can't build a source map for files over ${CHUNKED_SIZE_MIN} bytes`);
+    }
+    let total = 0;
+    let sent = 0;
+    let committed = 0;  // everything before this has been written
+
+    /** @type {(number|Uint8Array)[]} */
+    let pending = [];  // triples of start, end and update
+
+    const flush = () => {
+      for (let i = 0; i < pending.length; i += 3) {
+        const start = /** @type {number} */ (pending[i]);
+        const end = /** @type {number} */ (pending[i + 1]);
+        const update = /** @type {Uint8Array} */ (pending[i + 2]);
+        if (start !== end) {
+          write(input(start, end).slice());
+        }
+        if (update.length) {
+          write(update);
+        }
+      }
+      pending = [];
+      committed = sent;
+    };
+
+    handle({
+      callback() {
+        const p = token.at();
+        const update = callback();
+        if (update !== undefined) {
+          pending.push(sent, p, encode(update));
+          sent = p + token.length();
+        }
+      },
+
+      open: stack,
+
+      close(type) {
+        stack(0);
+      },
+    });
+
+    runChunked({
+      read(buffer) {
+        const length = fs.readSync(fd, buffer, 0, buffer.length, null);
+        total += length;
+        return length;
+      },
+
+      release(offset) {
+        if (offset > committed) {
+          write(input(committed, offset).slice());
+          committed = sent = offset;
+        }
+      },
+
+      statement: flush,
+
+      rewind() {
+        pending = [];
+        sent = committed;
+      },
+    });
+
+    flush();
+    if (committed !== total) {
+      write(input(committed, total).slice());
+    }
+  };
 
   /**
    * @param {string} f
    * @param {Partial<blep.RewriterArgs>} args
    */
-  const run = (f, {callback = noop, stack = noop, write = noop}) => {
+  const run = (f, {callback = noop, stack = noop, write = noop, writev, sourceMap}) => {
+    /** @type {(number|string|Uint8Array)[]|undefined} */
+    const edits = sourceMap && [];
+    let size = 0;
+    if (writev) {
+      // collect views rather than writing as we go, and pass them on at once
+      /** @type {Uint8Array[]} */
+      const parts = [];
+      size = runParts(f, callback, stack, (part) => parts.push(part), Infinity, edits, sourceMap);
+      writev(parts);
+    } else {
+      size = runParts(f, callback, stack, write, PENDING_BUFFER_MAX, edits, sourceMap);
+    }
+    if (sourceMap && edits) {
+      sourceMap(buildSourceMap(harness, size, edits, f));
+    }
+  };
+
+  /**
+   * @param {string} f
+   * @param {blep.RewriterArgs['callback']} callback
+   * @param {blep.RewriterArgs['stack']} stack
+   * @param {blep.RewriterArgs['write']} write
+   * @param {number} pendingMax
+   * @param {(number|string|Uint8Array)[]|undefined} edits filled with each update, if passed
+   * @param {blep.RewriterArgs['sourceMap']|undefined} sourceMap
+   * @return {number} the size of the file
+   */
+  const runParts = (f, callback, stack, write, pendingMax, edits, sourceMap) => {
     const fd = fs.openSync(f, 'r');
     /** @type {Uint8Array} */
     let buffer;
     try {
       const stat = fs.fstatSync(fd);
+      if (stat.size > CHUNKED_SIZE_MIN) {
+        runFile(fd, {callback, stack, write, sourceMap});
+        return stat.size;
+      }
 
       buffer = prepare(stat.size);
       const read = fs.readSync(fd, buffer, 0, stat.size, 0);
@@ -65,7 +185,7 @@ export default function wrapper(harness) {
 
         const update = callback();
         if (update === undefined) {
-          if (p - sent > PENDING_BUFFER_MAX) {
+          if (p - sent > pendingMax) {
             // send some data, we've gone through a lot
             write(buffer.subarray(sent, p));
             sent = p;
@@ -80,11 +200,10 @@ export default function wrapper(harness) {
 
         // write update
         if (update.length) {
-          if (typeof update === 'string') {
-            write(encoder.encode(update));
-          } else {
-            write(update);
-          }
+          write(encode(update));
+        }
+        if (edits) {
+          edits.push(p, p + token.length(), update);
         }
 
         // move past the "original" string
@@ -103,10 +222,98 @@ export default function wrapper(harness) {
     if (sent !== buffer.length) {
       write(buffer.subarray(sent, buffer.length));
     }
+    return buffer.length;
+  };
+
+  /**
+   * Replaces external strings with values from resolve, called once with all of them, in C.
+   *
+   * @param {string} f
+   * @param {blep.RewriteResolver} resolve
+   * @param {Partial<blep.RewriterArgs>} args only write, writev and sourceMap are used
+   */
+  const rewrite = (f, resolve, {write = noop, writev, sourceMap} = {}) => {
+    const fd = fs.openSync(f, 'r');
+    /** @type {Uint8Array} */
+    let buffer;
+    try {
+      const stat = fs.fstatSync(fd);
+      if (stat.size <= CHUNKED_SIZE_MIN) {
+        buffer = prepare(stat.size);
+        const read = fs.readSync(fd, buffer, 0, stat.size, 0);
+        if (read !== stat.size) {
+          throw new Error(`did not read all bytes at once: ${read}/${stat.size}`);
+        }
+      }
+    } finally {
+      fs.closeSync(fd);
+    }
+
+    // @ts-ignore: assigned unless chunked
+    if (buffer === undefined) {
+      // too large to hold at once, so resolve each external string as it's found
+      const callback = () => {
+        if (token.special() === common.specials.external && token.type() === common.types.string) {
+          const [value] = resolve([token.stringValue()]);
+          return typeof value === 'string' ? JSON.stringify(value) : undefined;
+        }
+      };
+      const stack = (/** @type {number} */ type) => type === common.stacks.module || 'scan';
+      return run(f, {callback, stack, write, writev, sourceMap});
+    }
+
+    /** @type {(number|string|Uint8Array|undefined)[]|undefined} */
+    const edits = sourceMap && [];
+    const out = runRewrite(resolve, edits);
+    writev ? writev([out]) : write(out);
+    if (sourceMap && edits) {
+      sourceMap(buildSourceMap(harness, buffer.length, edits, f));
+    }
+  };
+
+  /**
+   * @param {string} f
+   * @param {number|NodeJS.WritableStream} target
+   * @param {Partial<blep.PipeArgs>} args
+   * @return {number}
+   */
+  const pipe = (f, target, args = {}) => {
+    let length = 0;
+
+    /** @type {(parts: Uint8Array[]) => void} */
+    const writev = (parts) => {
+      for (const part of parts) {
+        length += part.length;
+      }
+
+      if (typeof target !== 'number') {
+        // streams write later, after harness memory may be reused, so copy just once
+        target.write(Buffer.concat(parts, length));
+        return;
+      }
+
+      // writes directly from harness memory, completing any short write (e.g., to a socket)
+      let written = fs.writevSync(target, parts);
+      for (const part of parts) {
+        if (written >= part.length) {
+          written -= part.length;
+          continue;
+        }
+        for (let at = written; at < part.length; ) {
+          at += fs.writeSync(target, part, at);
+        }
+        written = 0;
+      }
+    };
+
+    args.resolve ? rewrite(f, args.resolve, {writev, sourceMap: args.sourceMap}) : run(f, {...args, writev});
+    return length;
   };
 
   return {
     run,
+    rewrite,
+    pipe,
     token,
   };
 }
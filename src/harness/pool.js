@@ -0,0 +1,106 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @fileoverview Pool of harnesses sharing one compiled module. Does not use Node-specific APIs.
+ */
+
+import * as blep from './types/index.js';
+import build from './harness.js';
+
+const POOL_MEMORY_MAX = 64 * 1024 * 1024;
+
+/**
+ * @param {Promise<BufferSource|WebAssembly.Module>|BufferSource|WebAssembly.Module} modulePromise
+ * @param {Partial<blep.PoolOptions>} options
+ * @return {Promise<blep.Pool>}
+ */
+export default async function buildPool(modulePromise, {size = 1, max = Infinity, memoryMax = POOL_MEMORY_MAX} = {}) {
+  const source = await modulePromise;
+  const module = source instanceof WebAssembly.Module ? source : await WebAssembly.compile(source);
+
+  /** @type {blep.Harness[]} */
+  const idle = [];
+
+  /** @type {((harness: blep.Harness|Promise<blep.Harness>) => void)[]} */
+  const waiting = [];
+
+  let leased = 0;
+
+  for (let i = 0; i < size; ++i) {
+    idle.push(await build(module));
+  }
+
+  /**
+   * @return {Promise<blep.Harness>}
+   */
+  const lease = async () => {
+    const harness = idle.pop();
+    if (harness) {
+      ++leased;
+      return harness;
+    } else if (leased < max) {
+      ++leased;
+      try {
+        return await build(module);
+      } catch (e) {
+        --leased;
+        throw e;
+      }
+    }
+    return new Promise((resolve) => waiting.push(resolve));
+  };
+
+  /**
+   * @param {blep.Harness} harness
+   */
+  const release = (harness) => {
+    // memory can't shrink, so replace harnesses which grew for a large input
+    if (harness.memorySize() > memoryMax) {
+      const next = waiting.shift();
+      if (!next) {
+        --leased;
+        return;
+      }
+      const replacement = build(module);
+      replacement.catch(() => --leased);
+      next(replacement);
+      return;
+    }
+
+    const next = waiting.shift();
+    if (next) {
+      next(harness);
+    } else {
+      --leased;
+      idle.push(harness);
+    }
+  };
+
+  return {
+    lease,
+    release,
+
+    async use(fn) {
+      const harness = await lease();
+      try {
+        return await fn(harness);
+      } finally {
+        release(harness);
+      }
+    },
+  };
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @fileoverview Builds a source map for source with only some spans replaced, as the rewriter
+ * does. Does not use Node-specific APIs.
+ */
+
+import * as blep from './types/index.js';
+
+const VLQ_CHARS = 'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/';
+const decoder = new TextDecoder();
+
+/**
+ * @param {number} value
+ * @return {string}
+ */
+function vlq(value) {
+  let v = value < 0 ? ((-value) << 1) | 1 : value << 1;
+  let out = '';
+  do {
+    const digit = v & 31;
+    v >>>= 5;
+    out += VLQ_CHARS[v ? digit | 32 : digit];
+  } while (v);
+  return out;
+}
+
+/**
+ * Builds a version 3 source map for the input held by harness, as rewritten by replacing the
+ * edits, given as flat triples of start, end and update (in order, and not overlapping, with
+ * undefined updates left alone). Only these need real work: every other line maps to itself with
+ * a single segment at its start.
+ *
+ * Lines come from {@link blep.Harness.position}, so must be called after the run but before the
+ * next {@link blep.Harness.prepare}. Columns are in UTF-16 code units, as per the spec.
+ *
+ * @param {blep.Harness} harness
+ * @param {number} size of the input
+ * @param {(number|string|Uint8Array|undefined)[]} edits
+ * @param {string} source name of the original file
+ * @return {blep.SourceMap}
+ */
+export function buildSourceMap(harness, size, edits, source) {
+  const view = harness.input(0, size);
+
+  let mappings = '';
+  let genLine = 1;  // of the output, which lines up with the input unless edits have newlines
+  let genCol = 0;
+  let lastLine = 1;
+  let lastGenCol = 0;
+  let lastSrcLine = 0;
+  let lastSrcCol = 0;
+
+  /**
+   * @param {number} srcLine from one
+   * @param {number} srcCol
+   */
+  const segment = (srcLine, srcCol) => {
+    if (lastLine !== genLine) {
+      mappings += ';'.repeat(genLine - lastLine);
+      lastLine = genLine;
+      lastGenCol = 0;
+    } else if (mappings) {
+      mappings += ',';
+    }
+    mappings += vlq(genCol - lastGenCol) + 'A';  // always the one source
+    mappings += vlq(srcLine - 1 - lastSrcLine) + vlq(srcCol - lastSrcCol);
+    lastGenCol = genCol;
+    lastSrcLine = srcLine - 1;
+    lastSrcCol = srcCol;
+  };
+
+  // the input's line and UTF-16 column at srcAt, which only moves forward
+  let srcAt = 0;
+  let srcLine = 1;
+  let srcCol = 0;
+
+  /**
+   * Moves to at in the input, returning how many lines were crossed.
+   *
+   * @param {number} at
+   */
+  const advance = (at) => {
+    const {line, column} = harness.position(at);
+    const crossed = line - srcLine;
+    let from = srcAt;
+    if (crossed) {
+      from = at - column;
+      srcLine = line;
+      srcCol = 0;
+    }
+    for (let i = from; i < at; ++i) {
+      const c = view[i];
+      srcCol += ((c & 0xc0) !== 0x80 ? 1 : 0) + (c >= 0xf0 ? 1 : 0);
+    }
+    srcAt = at;
+    return crossed;
+  };
+
+  /**
+   * Copies the input up to at, giving each line crossed its own segment.
+   *
+   * @param {number} at
+   */
+  const identity = (at) => {
+    const line = srcLine;
+    const col = srcCol;
+    const crossed = advance(at);
+    for (let i = 1; i <= crossed; ++i) {
+      ++genLine;
+      genCol = 0;
+      segment(line + i, 0);
+    }
+    genCol += crossed ? srcCol : srcCol - col;
+  };
+
+  segment(1, 0);
+  for (let i = 0; i < edits.length; i += 3) {
+    const start = /** @type {number} */ (edits[i]);
+    const end = /** @type {number} */ (edits[i + 1]);
+    const update = edits[i + 2];
+    if (update === undefined) {
+      continue;
+    }
+
+    identity(start);
+    segment(srcLine, srcCol);
+
+    const text =
+        typeof update === 'string' ? update : decoder.decode(/** @type {Uint8Array} */ (update));
+    const newline = text.lastIndexOf('\n');
+    if (newline === -1) {
+      genCol += text.length;
+    } else {
+      genLine += text.split('\n').length - 1;
+      genCol = text.length - newline - 1;
+    }
+
+    advance(end);
+    if (end !== size) {
+      segment(srcLine, srcCol);
+    }
+  }
+  identity(size);
+
+  return {version: 3, sources: [source], names: [], mappings};
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @fileoverview Writes and reads the compact token stream described in "src/stream/stream.h". Does
+ * not use Node-specific APIs.
+ */
+
+import * as blep from './types/index.js';
+
+const VERSION = 1;
+const HEADER_SIZE = 16;
+const RECORD_MAX = 2 + 5 * 5;
+
+const TAG_TYPE = 0x1f;
+const TAG_STACK = 0x1f;
+const TAG_OPEN = 0x20;
+const TAG_EXT = 0x20;
+const TAG_SPECIAL = 0xc0;
+const SPECIAL_VARINT = 0x40;
+const SPECIAL_CACHED = 0x80;
+const EXT_LINE = 1;
+const EXT_VOID = 2;
+
+const CACHE_BITS = 6;
+const CACHE_SIZE = 1 << CACHE_BITS;
+
+const MAGIC = [98, 108, 101, 112];  // "blep"
+
+/**
+ * @param {number} special
+ */
+const cacheSlot = (special) => Math.imul(special, 2654435761 | 0) >>> (32 - CACHE_BITS);
+
+/**
+ * Runs the already-prepared harness in batch mode, returning its token stream.
+ *
+ * @param {blep.Harness} harness
+ * @param {number} sourceLength as passed to prepare()
+ * @return {Uint8Array}
+ */
+export function buildStream(harness, sourceLength) {
+  let buf = new Uint8Array(HEADER_SIZE + (sourceLength >> 1) + RECORD_MAX);
+  let len = HEADER_SIZE;
+  let count = 0;
+  let end = 0;
+  let lineNo = 1;
+  const cache = new Uint32Array(CACHE_SIZE);
+
+  /**
+   * @param {number} v
+   */
+  const putVarint = (v) => {
+    v >>>= 0;
+    while (v >= 0x80) {
+      buf[len++] = (v & 0x7f) | 0x80;
+      v >>>= 7;
+    }
+    buf[len++] = v;
+  };
+  /**
+   * @param {number} v
+   */
+  const putZigzag = (v) => putVarint((v << 1) ^ (v >> 31));
+
+  harness.runBatch((records) => {
+    for (let i = 0; i < records.length; i += 7) {
+      if (buf.length - len < RECORD_MAX) {
+        const prev = buf;
+        buf = new Uint8Array(prev.length * 2);
+        buf.set(prev);
+      }
+      ++count;
+
+      const p = records[i + 1];
+      if (p === -1) {
+        buf[len++] = TAG_STACK | (records[i + 5] ? TAG_OPEN : 0);
+        buf[len++] = records[i + 4];
+        continue;
+      }
+
+      const start = len;
+      len += 2;  // tag and optional ext
+
+      const vp = records[i + 0];
+      const tokenLineNo = records[i + 3];
+      let ext = 0;
+      if (tokenLineNo !== lineNo) {
+        ext |= EXT_LINE;
+        putZigzag(tokenLineNo - lineNo);
+        lineNo = tokenLineNo;
+      }
+      if (vp !== end) {
+        ext |= EXT_VOID;
+        putZigzag(vp - end);
+      }
+      putVarint(p - vp);
+      putVarint(records[i + 2]);
+      end = p + records[i + 2];
+
+      let tag = records[i + 4] & TAG_TYPE;
+      const special = records[i + 5] >>> 0;
+      if (special) {
+        const slot = cacheSlot(special);
+        if (cache[slot] === special) {
+          tag |= SPECIAL_CACHED;
+          buf[len++] = slot;
+        } else {
+          tag |= SPECIAL_VARINT;
+          putVarint(special);
+          cache[slot] = special;
+        }
+      }
+
+      if (ext) {
+        buf[start] = tag | TAG_EXT;
+        buf[start + 1] = ext;
+      } else {
+        buf[start] = tag;
+        buf.copyWithin(start + 1, start + 2, len);
+        --len;
+      }
+    }
+  });
+
+  buf.set(MAGIC, 0);
+  buf[4] = VERSION;
+  const header = new DataView(buf.buffer, buf.byteOffset);
+  header.setUint32(8, sourceLength, true);
+  header.setUint32(12, count, true);
+
+  return buf.subarray(0, len);
+}
+
+/**
+ * Walks a token stream in-place. The returned reader's fields describe the current record and are
+ * updated on every call to next(). For stack events, at is -1, type is the stack type and special
+ * is 1 for open or 0 for close.
+ *
+ * @param {ArrayBuffer|Uint8Array} source
+ * @return {blep.StreamReader}
+ */
+export function readStream(source) {
+  const bytes = source instanceof Uint8Array ? source : new Uint8Array(source);
+  if (bytes.length < HEADER_SIZE || MAGIC.some((c, i) => bytes[i] !== c) || bytes[4] !== VERSION) {
+    throw new TypeError('Not a token stream');
+  }
+  const header = new DataView(bytes.buffer, bytes.byteOffset);
+  const cache = new Uint32Array(CACHE_SIZE);
+
+  let pos = HEADER_SIZE;
+  let remaining = header.getUint32(12, true);
+  let prevEnd = 0;
+
+  const getVarint = () => {
+    let out = 0;
+    for (let shift = 0; shift < 35; shift += 7) {
+      if (pos >= bytes.length) {
+        break;
+      }
+      const b = bytes[pos++];
+      out += (b & 0x7f) * (2 ** shift);
+      if (!(b & 0x80)) {
+        return out;
+      }
+    }
+    throw new TypeError('Corrupt token stream');
+  };
+  const getZigzag = () => {
+    const v = getVarint();
+    return (v % 2) ? -(v + 1) / 2 : v / 2;
+  };
+
+  /** @type {blep.StreamReader} */
+  const reader = {
+    sourceLength: header.getUint32(8, true),
+    count: remaining,
+
+    void: 0,
+    at: 0,
+    length: 0,
+    lineNo: 1,
+    type: 0,
+    special: 0,
+
+    next() {
+      if (!remaining) {
+        return false;
+      }
+      if (pos >= bytes.length) {
+        throw new TypeError('Corrupt token stream');
+      }
+      --remaining;
+      const tag = bytes[pos++];
+
+      if ((tag & TAG_TYPE) === TAG_STACK) {
+        reader.void = 0;
+        reader.at = -1;
+        reader.length = 0;
+        reader.type = bytes[pos++];
+        reader.special = (tag & TAG_OPEN) ? 1 : 0;
+        return true;
+      }
+
+      const ext = (tag & TAG_EXT) ? bytes[pos++] : 0;
+      if (ext & EXT_LINE) {
+        reader.lineNo += getZigzag();
+      }
+      let vp = prevEnd;
+      if (ext & EXT_VOID) {
+        vp += getZigzag();
+      }
+      reader.void = vp;
+      reader.at = vp + getVarint();
+      reader.length = getVarint();
+      reader.type = tag & TAG_TYPE;
+      prevEnd = reader.at + reader.length;
+
+      switch (tag & TAG_SPECIAL) {
+        case SPECIAL_VARINT: {
+          const special = getVarint();
+          cache[cacheSlot(special)] = special;
+          reader.special = special;
+          break;
+        }
+
+        case SPECIAL_CACHED:
+          reader.special = cache[bytes[pos++]];
+          break;
+
+        default:
+          reader.special = 0;
+      }
+      return true;
+    },
+  };
+
+  return reader;
+}
@@ -31,9 +31,45 @@ type StackValues = typeof import('./v-stacks.js')[keyof typeof import('./v-stack
 export interface InternalCalls {
   __wasm_call_ctors(): void;
 
-  blep_parser_init(at: number, len: number): number;
-  blep_parser_run(): number;
-  blep_parser_cursor(): number;
+  blep_parser_init(pd: number, at: number, len: number): number;
+  blep_parser_run(pd: number): number;
+  blep_parser_cursor(pd: number): number;
+  blep_stats(pd: number): number;
+  blep_unescape(at: number, len: number, out: number): number;
+
+  blep_harness_batch(pd: number, at: number, count: number, base: number): void;
+  blep_harness_brackets(pd: number, index: number, base: number): void;
+  blep_harness_stack(pd: number): number;
+  blep_harness_feed_stack(fd: number): void;
+  blep_harness_reparse_stack(rd: number): void;
+  blep_harness_tokenize(pd: number, at: number, len: number): number;
+  blep_harness_rewrite(pd: number, spans: number, cap: number, values: number, at: number, len: number): number;
+
+  blep_rewrite_emit(rd: number, replacements: number, out: number): number;
+
+  blep_harness_scope(pd: number, sd: number, arena: number, size: number, at: number, len: number): void;
+  blep_scope_finish(sd: number): number;
+
+  blep_intern_init(id: number, at: number, table: number, size: number): void;
+  blep_intern_grow(id: number, table: number, size: number): number;
+  blep_intern_token(id: number, token: number): number;
+
+  blep_lines_index(at: number, len: number, out: number, cap: number): number;
+  blep_lines_find(index: number, count: number, offset: number): number;
+
+  blep_recover_init(rd: number, pd: number, at: number, errors: number, cap: number): void;
+  blep_recover_run(rd: number): number;
+
+  blep_feed_init(fd: number, pd: number, at: number, cap: number): void;
+  blep_feed_buffer(fd: number, at: number, cap: number): void;
+  blep_feed_space(fd: number): number;
+  blep_feed_push(fd: number, len: number, final: 0 | 1): void;
+  blep_feed_run(fd: number): number;
+
+  blep_reparse_init(rd: number, pd: number, at: number, cap: number): void;
+  blep_reparse_points(rd: number, at: number, cap: number): void;
+  blep_reparse_run(rd: number, at: number, len: number): number;
+  blep_reparse_edit(rd: number, at: number, len: number, editAt: number, deleted: number, inserted: number): number;
 }
 
 /**
@@ -41,11 +77,14 @@ export interface InternalCalls {
  */
 export interface InternalImports {
   memset(at: number, byte: number, size: number): void;
+  memcpy(dest: number, src: number, size: number): number;
+  memmove(dest: number, src: number, size: number): number;
   memchr(at: number, byte: number, size: number): number;
 
-  blep_parser_callback(): void;
-  blep_parser_open(type: StackValues): 0 | 1;
-  blep_parser_close(type: StackValues): void;
+  blep_harness_callback(pd: number): void;
+  blep_harness_open(pd: number, type: StackValues): 0 | 1 | 2;
+  blep_harness_close(pd: number, type: StackValues): void;
+  blep_harness_flush(pd: number, at: number, count: number): void;
 }
 
 /**
@@ -61,8 +100,13 @@ export interface Handlers {
 
   /**
    * A stack is being opened. Return false if you'd like to skip it and its close.
+   *
+   * Return "scan" to skip it, and also skim over the bodies of functions and classes inside it
+   * without parsing them. This is much faster, but only dynamic `import("...")` is found within:
+   * its target is passed to callback as an external string. Lexing alone might mistake a regexp
+   * for division inside a body, so unusual code can confuse the rest of the parse.
    */
-  open: (stack: StackValues) => boolean|void;
+  open: (stack: StackValues) => boolean|'scan'|void;
 
   /**
    * A previously opened stack is being closed.
@@ -72,6 +116,112 @@ export interface Handlers {
 }
 
 
+/**
+ * Passed a run of records in batch mode, only valid during this call. Each record is seven words:
+ *
+ *   - void, at, length, lineNo, type, special, hash (as per {@link Token}) for tokens
+ *   - 0, -1, 0, lineNo, stack type, 1 for open or 0 for close, 0 for stack events
+ *
+ * Stacks can't be skipped in batch mode.
+ */
+export type BatchHandler = (records: Int32Array) => void;
+
+
+/**
+ * Supplies input to {@link Harness.runChunked}. Offsets are always within the whole input.
+ */
+export interface ChunkedSource {
+
+  /**
+   * Fill the start of buffer with more input, returning the number of bytes written. Return zero
+   * once there is no more input.
+   */
+  read(buffer: Uint8Array): number;
+
+  /**
+   * Input before this offset is complete and is about to be dropped.
+   */
+  release?(offset: number): void;
+
+  /**
+   * A top-level statement was parsed: handlers called since the last statement won't be called
+   * again.
+   */
+  statement?(): void;
+
+  /**
+   * The statement in progress ran out of input and will be parsed again, so handlers called since
+   * the last statement will be called again.
+   */
+  rewind?(): void;
+
+}
+
+
+/**
+ * What was parsed again after an edit. Handlers were called for the tokens from start up to end,
+ * which replace those previously between the same offsets (or shifted by the edit, after it).
+ */
+export interface EditResult {
+  first: number;    // index of the first statement parsed
+  removed: number;  // number of old statements replaced
+  added: number;    // number of new statements in their place
+  start: number;
+  end: number;
+}
+
+
+/**
+ * An error found by {@link Base.runRecover}.
+ */
+export interface RecoverError {
+  type: string;   // as in thrown errors, e.g. "unexpected"
+  at: number;     // offset of the token the parser stopped at
+  stack: number;  // type of the innermost stack open there, or zero if none
+  depth: number;  // brackets open before that token
+}
+
+/**
+ * What {@link Base.runRecover} found.
+ */
+export interface RecoverResult {
+  statements: number;
+  errors: RecoverError[];  // the first 256
+  count: number;           // all errors, even past those listed
+}
+
+
+/**
+ * Where an offset is in the input, see {@link Harness.position}.
+ */
+export interface Position {
+  line: number;    // from one, as per lineNo
+  column: number;  // in bytes from the start of the line, from zero
+}
+
+
+/**
+ * Counters for the last parse, from a harness built with STATS=1. Byte counts are of input lexed
+ * as each kind of token, and tokens are counted as lexed, before the parser retypes them.
+ */
+export interface Stats {
+  tokens: number[];  // indexed by token type
+  replayed: number;  // tokens replayed after lookahead, rather than lexed again
+  voidBytes: number;
+  stringBytes: number;
+  templateBytes: number;
+  regexpBytes: number;
+  setRestores: number;  // lookahead started, e.g. for arrow functions
+  restores: number;
+  relexedBytes: number;  // lexed again as lookahead was too long to replay
+  updates: number;  // regexp and slash flips
+  depthMax: number;
+  callbacks: number;
+  opens: number;
+  closes: number;
+}
+
+
 /**
  * An interface to the current token. This will change what it is pointing to, when the parser
  * moves its head as it just reflects the current token.
@@ -95,7 +245,8 @@ export interface Token {
   length(): number;
 
   /**
-   * The line number of this token (not the void).
+   * The line number of this token (not the void). In a harness built with LINES=0, this only
+   * changes when a newline is crossed: use {@link Harness.position} for the real line.
    */
   lineNo(): number;
 
@@ -111,6 +262,18 @@ export interface Token {
    */
   special(): number;
 
+  /**
+   * Hash of this token's bytes if it's a name (lit or symbol, including keywords), or zero. This is
+   * computed as it's lexed, and is the same for the same bytes.
+   */
+  hash(): number;
+
+  /**
+   * Dense id of this token if it's a name, counting up from zero in the order names are first seen
+   * during this run, or -1. Names are compared by their bytes.
+   */
+  id(): number;
+
   /**
    * Finds the current subarray for this token, based on its location and length.
    */
@@ -149,8 +312,49 @@ export interface Base {
    */
   handle(handlers: Partial<Handlers>): void;
 
+  /**
+   * Only tokenizes the entire source, without the parser. Regexps (and other tokens only the parser
+   * can tell apart) may be guessed wrong, so this is just for measuring the tokenizer alone. Does
+   * not call handlers or update {@link Token}.
+   *
+   * @returns number of tokens
+   */
+  tokenize(): number;
+
+  /**
+   * Runs the parser over the entire source as per {@link Base.run}, but keeps going past errors.
+   * After each, every open stack is closed, and tokens are passed to the callback as lexed (not
+   * retyped) up to the next statement boundary. Clears handlers on finish.
+   */
+  runRecover(): RecoverResult;
+
+  /**
+   * Runs the parser over the entire source, passing tokens and stack events in batches rather than
+   * calling any handlers or updating {@link Token}. If passed, cancelled is checked between
+   * top-level statements, and if it returns true, the run stops and throws an `AbortError` (after
+   * flushing what was found so far).
+   *
+   * @returns number of top-level statements
+   */
+  runBatch(handler: BatchHandler, cancelled?: () => boolean): number;
+
+  /**
+   * Counters for the last parse, or null unless the harness was built with STATS=1.
+   */
+  stats(): Stats|null;
+
+  /**
+   * Bytes of Web Assembly memory held. This grows to fit the largest input so far, and never
+   * shrinks.
+   */
+  memorySize(): number;
+
 }
 
+/**
+ * In every mode (including chunked and incremental runs), statements and expressions can nest up to
+ * 1024 deep, as built (see NEST_MAX in build.sh), before the run throws a "stack" error.
+ */
 export interface Harness extends Base {
 
   /**
@@ -161,16 +365,232 @@ export interface Harness extends Base {
    */
   prepare(size: number): Uint8Array;
 
+  /**
+   * Records matching brackets during the next {@link Base.run} or {@link Base.runBatch}. For each
+   * `{`, `[`, `(`, `?` or template string ending `${` at offset i, the returned index holds the
+   * offset of its close at i, or -1 if it never closed. Other slots are -1 or meaningless. Valid
+   * until the next call to {@link Harness.prepare}.
+   */
+  brackets(): Int32Array;
+
+  /**
+   * Replaces external strings (the targets of imports, reexports and dynamic `import("...")`) in
+   * one pass, without calling any handlers. Everything but import and export statements is scanned,
+   * see {@link Handlers.open}.
+   *
+   * This calls resolve once, with the values of every external string in order (or undefined if
+   * not valid UTF-8). It returns their new values, or undefined to leave them alone. If edits is
+   * passed, the start, end and quoted new value (or undefined) of every external string is appended
+   * to it, as needed to build a source map or to splice again later.
+   *
+   * @returns the rewritten source, valid until the next call to {@link Harness.prepare} or a run
+   */
+  runRewrite(resolve: RewriteResolver, edits?: (number|string|Uint8Array|undefined)[]): Uint8Array;
+
+  /**
+   * Runs the parser over the entire source without calling any handlers, building a table of
+   * scopes and the bindings declared within them in C.
+   *
+   * @returns arrays valid until the next call to {@link Harness.prepare} or a run
+   */
+  runScope(): ScopeResult;
+
+  /**
+   * Runs the parser over input read in chunks, rather than written via {@link Harness.prepare}.
+   * Only the statements in progress are held in memory. Clears handlers on finish.
+   *
+   * @returns number of top-level statements
+   */
+  runChunked(source: ChunkedSource): number;
+
+  /**
+   * Returns the input between these offsets. During {@link Harness.runChunked}, this is only valid
+   * for input that hasn't yet been released, and only until the next read.
+   */
+  input(start: number, end: number): Uint8Array;
+
+  /**
+   * Finds the line and column of an offset into the input. The first call after the input changes
+   * indexes its newlines, and each call after that is a binary search. Not available during
+   * {@link Harness.runChunked}.
+   */
+  position(at: number): Position;
+
+  /**
+   * Runs the parser over the entire source as per {@link Base.run}, but remembers where top-level
+   * statements start so that {@link Harness.edit} can parse again from there.
+   *
+   * @returns number of top-level statements
+   */
+  runIncremental(): number;
+
+  /**
+   * Replaces deleted bytes at offset at with inserted, then parses again just the statements it
+   * affects, calling handlers for only their tokens. Clears handlers on finish.
+   */
+  edit(at: number, deleted: number, inserted: Uint8Array|string): EditResult;
+
+}
+
+/**
+ * Flat tables built by {@link Harness.runScope}. Offsets are into the input, and scope zero is the
+ * module.
+ */
+export interface ScopeResult {
+
+  /**
+   * Four words per scope: parent (or -1), kind (0 for module, 1 for function, 2 for block), and
+   * its start and end offsets.
+   */
+  scopes: Int32Array;
+
+  /**
+   * Six words per binding: name offset and length, scope, special (every special it was declared
+   * with, plus 1<<28 if imported or 1<<29 if exported), count of references resolved to it, and an
+   * internal link.
+   */
+  bindings: Int32Array;
+
+  /**
+   * Four words per name referenced but never declared: offset and length of its first use, count
+   * of uses, and an internal link.
+   */
+  globals: Int32Array;
+}
+
+export type RewriteResolver = (values: (string|undefined)[]) => (string|undefined|void)[];
+
+/**
+ * Options for {@link Pool}.
+ */
+export interface PoolOptions {
+  size: number;       // harnesses built upfront, default 1
+  max: number;        // harnesses leased at once before lease() waits, default unlimited
+  memoryMax: number;  // released harnesses holding more memory than this are dropped, default 64mb
+}
+
+/**
+ * Harnesses built from one compiled module. Each parses one source at a time, so lease one per
+ * concurrent task (or per source parsed from within another's handlers).
+ */
+export interface Pool {
+  lease(): Promise<Harness>;
+  release(harness: Harness): void;
+
+  /**
+   * Leases a harness for the duration of fn, even if it fails.
+   */
+  use<T>(fn: (harness: Harness) => T|Promise<T>): Promise<T>;
+}
+
+/**
+ * The result of a run in a worker, see {@link WorkerHarness}.
+ */
+export interface WorkerResult {
+  records: Int32Array;  // as passed to {@link BatchHandler}, all at once
+  statements: number;
+  error?: string;       // if the parse failed, after records up to the error
+  input: ArrayBuffer|SharedArrayBuffer;  // given back, as it was transferred to the worker
+}
+
+/**
+ * Parses in a worker, built by "web-harness.js". Each run or cancel supersedes the last, which
+ * rejects with an `AbortError`. Without SharedArrayBuffer (unless the page is cross-origin
+ * isolated), this terminates a worker mid-run and starts another, so the superseded input (if
+ * transferred) isn't handed back.
+ */
+export interface WorkerHarness {
+
+  /**
+   * Parses the source in input, which is transferred to the worker (unless shared) and handed
+   * back with the result.
+   */
+  run(input: ArrayBuffer|SharedArrayBuffer): Promise<WorkerResult>;
+  cancel(): void;
+
+  /**
+   * Stops the worker, rejecting any run in progress. Later runs reject.
+   */
+  close(): void;
 }
 
+/**
+ * Walks a token stream produced by "src/stream" or buildStream(). Fields reflect the current
+ * record and are updated in-place by {@link StreamReader.next}.
+ */
+export interface StreamReader {
+  readonly sourceLength: number;
+  readonly count: number;
+
+  void: number;
+  at: number;  // -1 for stack events
+  length: number;
+  lineNo: number;
+  type: number;  // token type, or stack type for stack events
+  special: number;  // for stack events, 1 for open or 0 for close
+
+  /**
+   * Moves to the next record, returning false at the end of the stream.
+   */
+  next(): boolean;
+}
+
+/**
+ * Large files are read in chunks, so callback and stack may be called again for a statement that
+ * was cut short by the end of a chunk. Updates from the earlier calls are discarded.
+ */
 export interface RewriterArgs {
   callback(): Uint8Array|string|void;
-  stack(type: StackValues): boolean|void;
+  stack(type: StackValues): boolean|'scan'|void;
   write(part: Uint8Array): void;
+
+  /**
+   * If passed, called once per file with every part instead of calling write. Parts may be views
+   * of harness memory, so are only valid during this call.
+   */
+  writev(parts: Uint8Array[]): void;
+
+  /**
+   * If passed, called once per file after it's written with a source map for the rewrite, built
+   * from just the updates made. Not available for files too large to hold at once.
+   */
+  sourceMap(map: SourceMap): void;
+}
+
+/**
+ * A version 3 source map, ready for `JSON.stringify`.
+ */
+export interface SourceMap {
+  version: 3;
+  sources: string[];
+  names: string[];
+  mappings: string;
+}
+
+export interface PipeArgs extends RewriterArgs {
+
+  /**
+   * If passed, pipes via {@link RewriterReturn.rewrite} rather than calling callback.
+   */
+  resolve: RewriteResolver;
 }
 
 export interface RewriterReturn {
   run(file: string, args?: Partial<RewriterArgs>): void;
+
+  /**
+   * Replaces external strings via {@link Harness.runRewrite}, so resolve is called once for the
+   * whole file (or per string, for files too large to hold at once). Only write, writev and
+   * sourceMap are used.
+   */
+  rewrite(file: string, resolve: RewriteResolver, args?: Partial<RewriterArgs>): void;
+
+  /**
+   * Rewrites a file into a file descriptor (written directly from harness memory) or a stream (as
+   * one buffer), returning the bytes written. Any write or writev passed is ignored.
+   */
+  pipe(file: string, target: number|NodeJS.WritableStream, args?: Partial<PipeArgs>): number;
+
   token: Token;
 }
 
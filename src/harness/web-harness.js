@@ -0,0 +1,149 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @fileoverview Browser wrapper which runs the parser in a worker (see "web-worker.js"), for
+ * parsing large inputs without blocking the page. Does not use Node-specific APIs.
+ */
+
+import * as blep from './types/index.js';
+
+/**
+ * @return {Error}
+ */
+const abortError = () => {
+  const error = new Error('parse cancelled');
+  error.name = 'AbortError';
+  return error;
+};
+
+/**
+ * Builds a harness which parses in a worker. Each run supersedes the last: if the page can share
+ * memory (it's cross-origin isolated), the worker stops one in progress between top-level
+ * statements. Otherwise, a worker with a run in progress is terminated and replaced by a new one.
+ *
+ * @param {string|URL=} workerURL
+ * @return {blep.WorkerHarness}
+ */
+export default function buildWorkerHarness(workerURL = new URL('./web-worker.js', import.meta.url)) {
+  /** @type {Int32Array=} */
+  let control;
+  if (typeof SharedArrayBuffer === 'function' && globalThis.crossOriginIsolated) {
+    control = new Int32Array(new SharedArrayBuffer(4));
+  }
+
+  /**
+   * @typedef {{
+   *   id: number,
+   *   input: ArrayBuffer|SharedArrayBuffer,
+   *   resolve(result: blep.WorkerResult): void,
+   *   reject(error: any): void,
+   * }}
+   * Task
+   */
+
+  let latest = 0;
+  let closed = false;
+
+  /** @type {Map<number, Task>} */
+  const sent = new Map();
+
+  /** @type {Worker} */
+  let worker;
+
+  const spawn = () => {
+    worker = new Worker(workerURL, {type: 'module'});
+    if (control) {
+      worker.postMessage({control: control.buffer});
+    }
+
+    worker.addEventListener('message', ({data}) => {
+      const task = sent.get(data.id);
+      sent.delete(data.id);
+      if (!task) {
+        return;
+      }
+
+      const {records, statements, error, input, cancelled} = data;
+      if (cancelled || task.id !== latest) {
+        task.reject(abortError());
+      } else {
+        task.resolve({records, statements, error, input});
+      }
+    });
+
+    worker.addEventListener('error', (event) => {
+      for (const task of sent.values()) {
+        task.reject(event);
+      }
+      sent.clear();
+    });
+  };
+  spawn();
+
+  /**
+   * @param {Task} task
+   */
+  const send = (task) => {
+    sent.set(task.id, task);
+    const shared = typeof SharedArrayBuffer === 'function' && task.input instanceof SharedArrayBuffer;
+    worker.postMessage({id: task.id, input: task.input}, shared ? [] : [task.input]);
+  };
+
+  /**
+   * Stops the worker by force, failing everything sent to it.
+   */
+  const terminate = () => {
+    worker.terminate();
+    for (const task of sent.values()) {
+      task.reject(abortError());
+    }
+    sent.clear();
+  };
+
+  const supersede = () => {
+    ++latest;
+    if (control) {
+      Atomics.store(control, 0, latest);
+    } else if (sent.size) {
+      // the worker can't be told to stop, so replace it (at the cost of compiling the runner again)
+      terminate();
+      spawn();
+    }
+  };
+
+  return {
+    run(input) {
+      if (closed) {
+        return Promise.reject(new Error('harness closed'));
+      }
+      supersede();
+      return new Promise((resolve, reject) => {
+        send({id: latest, input, resolve, reject});
+      });
+    },
+
+    cancel: supersede,
+
+    close() {
+      if (!closed) {
+        closed = true;
+        ++latest;
+        terminate();
+      }
+    },
+  };
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @fileoverview Module worker which parses source sent by "web-harness.js", so that large inputs
+ * don't block the page. Does not use Node-specific APIs.
+ *
+ * Each run posts back every batch record at once, as one transferred buffer.
+ */
+
+import * as blep from './types/index.js';
+import build, {runnerFile} from './harness.js';
+
+const RECORDS_INITIAL = 4096 * 7;
+
+/**
+ * Compiles the runner named by runnerFile, or runner.wasm if that can't be loaded (e.g., the SIMD
+ * variant wasn't built or deployed).
+ *
+ * @return {Promise<WebAssembly.Module>}
+ */
+async function compileRunner() {
+  const file = runnerFile();
+  try {
+    return await WebAssembly.compileStreaming(fetch(new URL(file, import.meta.url)));
+  } catch (e) {
+    if (file === 'runner.wasm') {
+      throw e;
+    }
+    return WebAssembly.compileStreaming(fetch(new URL('runner.wasm', import.meta.url)));
+  }
+}
+
+const harnessPromise = build(compileRunner());
+
+/** @type {Int32Array=} */
+let control;  // if the page can share memory, slot 0 holds the id of its latest run
+
+/** @type {any} */
+const scope = self;
+
+scope.addEventListener('message', async (/** @type {MessageEvent} */ {data}) => {
+  if (data.control) {
+    control = new Int32Array(data.control);
+    return;
+  }
+
+  /** @type {{id: number, input: ArrayBuffer|SharedArrayBuffer}} */
+  const {id, input} = data;
+  const harness = await harnessPromise;
+  const cancelled = () => control !== undefined && Atomics.load(control, 0) !== id;
+  const shared = typeof SharedArrayBuffer === 'function' && input instanceof SharedArrayBuffer;
+
+  /** @type {Transferable[]} */
+  const transfer = shared ? [] : [/** @type {ArrayBuffer} */ (input)];
+  if (cancelled()) {
+    scope.postMessage({id, cancelled: true, input}, transfer);
+    return;
+  }
+
+  const bytes = new Uint8Array(input);
+  harness.prepare(bytes.length).set(bytes);
+
+  // batches are views of harness memory, so copy them into one growing buffer
+  let records = new Int32Array(RECORDS_INITIAL);
+  let length = 0;
+  /** @type {blep.BatchHandler} */
+  const handler = (batch) => {
+    if (length + batch.length > records.length) {
+      const grown = new Int32Array(Math.max(records.length * 2, length + batch.length));
+      grown.set(records.subarray(0, length));
+      records = grown;
+    }
+    records.set(batch, length);
+    length += batch.length;
+  };
+
+  let statements = 0;
+  /** @type {string|undefined} */
+  let error;
+  try {
+    statements = harness.runBatch(handler, cancelled);
+  } catch (e) {
+    if (e.name === 'AbortError') {
+      scope.postMessage({id, cancelled: true, input}, transfer);
+      return;
+    }
+    error = String(e.message);
+  }
+
+  transfer.push(records.buffer);
+  scope.postMessage({id, records: records.subarray(0, length), statements, error, input}, transfer);
+});
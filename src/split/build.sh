@@ -0,0 +1,4 @@
+#!/bin/bash
+
+set -eu
+clang -O2 -DSPEED -pthread split.c ../stream/stream.c ../batch/map.c ../core/*.c $@ -o _split
@@ -0,0 +1,373 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Parses one large file across a pool of threads. Usage:
+//
+//   ./_split [-j threads] <source> [<out>]
+//
+// The source is cut into chunks where a line looks like it starts a top-level statement, and each
+// chunk is parsed alone. Cuts are only guesses, so they're checked in order once all chunks are
+// done: the last statement of each chunk is parsed again over the whole source, and must end right
+// where the next chunk starts, in the same state that chunk was parsed from. If it doesn't, parsing
+// carries on sequentially until it lines up with a later chunk.
+//
+// If out is given, the tokens are written there as a token stream (see ../stream/stream.h), which
+// is identical to the one from _stream.
+
+#include "../core/token.h"
+#include "../core/parser.h"
+#include "../core/reparse.h"
+#include "../stream/stream.h"
+#include "../batch/map.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define SPLIT_CHUNK_MIN   (64 * 1024)
+#define SPLIT_SEARCH_MAX  (1024 * 1024)  // past each target for a cut
+
+// tokens and stack events, with offsets from base
+typedef struct {
+  stream_record *buf;
+  int len;
+  int cap;
+  char *base;
+} split_records;
+
+typedef struct {
+  int start;
+  int end;
+  int newlines;
+  char *copy;  // of the source between start and end, with a NULL after
+
+  split_records out;
+  int relative;  // records at the start of out with line numbers from the start of the chunk
+  int used;      // whether its records (up to relative) went into the result
+
+  int has_first;
+  reparse_point first;  // state once set up
+  reparse_point last;   // state at the last statement which didn't look near the end of the chunk
+  int last_records;
+} split_chunk;
+
+static split_chunk *chunks;
+static int chunks_count;
+static int chunks_next;
+static pthread_mutex_t chunks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static stream_record *split_record_next(parserdef *pd) {
+  split_records *r = pd->arg;
+  if (r->len == r->cap) {
+    r->cap = r->cap ? r->cap * 2 : 1024;
+    r->buf = realloc(r->buf, sizeof(stream_record) * r->cap);
+  }
+  return r->buf + r->len++;
+}
+
+void blep_parser_callback(parserdef *pd) {
+  split_records *r = pd->arg;
+  struct token *t = blep_parser_cursor(pd);
+  stream_record *rec = split_record_next(pd);
+  rec->vp = t->vp - r->base;
+  rec->p = t->p - r->base;
+  rec->len = t->len;
+  rec->line_no = t->line_no;
+  rec->type = t->type;
+  rec->special = t->special;
+}
+
+int blep_parser_open(parserdef *pd, int type) {
+  stream_record *rec = split_record_next(pd);
+  rec->vp = 0;
+  rec->p = -1;
+  rec->len = 0;
+  rec->line_no = pd->td.curr.line_no;
+  rec->type = type;
+  rec->special = 1;
+  return 0;
+}
+
+void blep_parser_close(parserdef *pd, int type) {
+  stream_record *rec = split_record_next(pd);
+  rec->vp = 0;
+  rec->p = -1;
+  rec->len = 0;
+  rec->line_no = pd->td.curr.line_no;
+  rec->type = type;
+  rec->special = 0;
+}
+
+// whether this line looks like it starts a top-level statement
+static int split_is_start(const char *p) {
+  static const char *words[] = {
+    "function", "async function", "var", "let", "const", "class", "export", "import", NULL,
+  };
+  for (const char **w = words; *w; ++w) {
+    int len = strlen(*w);
+    if (!strncmp(p, *w, len) && !(isalnum(p[len]) || p[len] == '_' || p[len] == '$')) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// finds a cut at or after at, just after a ';' or '}' which ends a line followed by one which looks
+// like it starts a statement. returns -1 if there's none before limit.
+static int split_find_cut(const char *buf, int at, int limit) {
+  const char *p = buf + at;
+  const char *end = buf + limit;
+
+  while (p < end && (p = memchr(p, '\n', end - p))) {
+    const char *next = p + 1;
+    if (split_is_start(next)) {
+      const char *q = p;
+      while (q > buf && (q[-1] == ' ' || q[-1] == '\t' || q[-1] == '\r')) {
+        --q;
+      }
+      if (q > buf && (q[-1] == ';' || q[-1] == '}')) {
+        return q - buf;
+      }
+    }
+    p = next;
+  }
+  return -1;
+}
+
+static void parse_chunk(split_chunk *c, char *source) {
+  int len = c->end - c->start;
+  c->copy = malloc(len + 1);
+  memcpy(c->copy, source + c->start, len);
+  c->copy[len] = 0;
+
+  for (char *p = c->copy; (p = memchr(p, '\n', c->copy + len - p)); ++p) {
+    ++c->newlines;
+  }
+
+  // offsets are relative to the whole source, but line numbers to the chunk
+  c->out.base = c->copy - c->start;
+  parserdef pd;
+  pd.arg = &(c->out);
+
+  if (blep_parser_init(&pd, c->copy, len) < 0) {
+    return;
+  }
+  c->has_first = blep_reparse_can_save(&pd) && !pd.td.reached_end;
+  blep_reparse_save(&(c->first), &(pd.td), 0);
+  memcpy(&(c->last), &(c->first), sizeof(reparse_point));
+
+  // everything parsed before lexing gets close to the end is what a sequential parse would see
+  for (int statement = 0; !pd.td.reached_end; ++statement) {
+    if (blep_reparse_can_save(&pd)) {
+      blep_reparse_save(&(c->last), &(pd.td), statement);
+      c->last_records = c->out.len;
+    }
+    if (blep_parser_run(&pd) <= 0) {
+      break;
+    }
+  }
+}
+
+static void *worker(void *arg) {
+  char *source = arg;
+  for (;;) {
+    pthread_mutex_lock(&chunks_lock);
+    int index = chunks_next < chunks_count ? chunks_next++ : -1;
+    pthread_mutex_unlock(&chunks_lock);
+
+    if (index < 0) {
+      return NULL;
+    }
+    parse_chunk(&chunks[index], source);
+  }
+}
+
+static void add_chunk(int start, int end) {
+  chunks = realloc(chunks, sizeof(split_chunk) * (chunks_count + 1));
+  split_chunk *c = &chunks[chunks_count++];
+  bzero(c, sizeof(split_chunk));
+  c->start = start;
+  c->end = end;
+}
+
+// loads the chunk's last point over the whole source, with the line numbers before it
+static void load_last(split_chunk *c, parserdef *pd, char *source, int len, int lines) {
+  tokendef *td = &(pd->td);
+  blep_reparse_load(&(c->last), pd, c->copy + (c->end - c->start));
+  blep_token_shift(td, (source + c->start) - c->copy);
+  td->end = source + len;
+
+  td->line_no += lines;
+  td->curr.line_no += lines;
+  if (td->peek.p) {
+    td->peek.line_no += lines;
+  }
+}
+
+// checks and stitches chunks in order, parsing again where they don't line up. returns 0 or
+// ERROR__... on error.
+static int stitch(char *source, int len, int *parsed_again) {
+  parserdef pd;
+  int lines = 0;
+  int i = 0;
+  *parsed_again = 0;
+
+  for (;;) {
+    split_chunk *c = &chunks[i];
+    c->used = 1;
+    c->relative = c->out.len = c->last_records;
+
+    // the chunk saw its end as EOF, so parse its last statement (at least) again over the source
+    load_last(c, &pd, source, len, lines);
+    c->out.base = source;
+    pd.arg = &(c->out);
+    int from = pd.td.curr.vp - source;
+
+    int j = i + 1;
+    int lines_j = lines + c->newlines;
+    for (;;) {
+      if (j < chunks_count && blep_reparse_can_save(&pd)) {
+        while (j < chunks_count && source + chunks[j].start < pd.td.curr.vp) {
+          lines_j += chunks[j++].newlines;
+        }
+
+        split_chunk *next = &chunks[j];
+        if (j < chunks_count && next->has_first && pd.td.curr.vp == source + next->start &&
+            blep_reparse_matches(&(next->first), &(pd.td), (source + next->start) - next->copy)) {
+          break;
+        }
+      }
+
+      int ret = blep_parser_run(&pd);
+      if (ret < 0) {
+        return ret;
+      } else if (ret == 0) {
+        *parsed_again += len - from;
+        return 0;
+      }
+    }
+
+    *parsed_again += chunks[j].start - from;
+    i = j;
+    lines = lines_j;
+  }
+}
+
+int main(int argc, char **argv) {
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int i = 1;
+
+  if (i + 1 < argc && !strcmp(argv[i], "-j")) {
+    threads = atoi(argv[i + 1]);
+    i += 2;
+  }
+  if ((argc - i != 1 && argc - i != 2) || threads <= 0) {
+    fprintf(stderr, "usage: %s [-j threads] <source> [<out>]\n", argv[0]);
+    return 1;
+  }
+  const char *out_path = argc - i == 2 ? argv[i + 1] : NULL;
+
+  mapped_file source;
+  if (map_file(argv[i], &source) < 0) {
+    fprintf(stderr, "could not read: %s\n", argv[i]);
+    return 1;
+  }
+  int len = source.len;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // aim for a couple of chunks per thread, so uneven ones balance out
+  int targets = threads * 2;
+  if (targets > len / SPLIT_CHUNK_MIN) {
+    targets = len / SPLIT_CHUNK_MIN;
+  }
+  int prev = 0;
+  for (int k = 1; k < targets; ++k) {
+    int target = (long) len * k / targets;
+    int limit = target + SPLIT_SEARCH_MAX < len ? target + SPLIT_SEARCH_MAX : len;
+    int cut = target > prev ? split_find_cut(source.buf, target, limit) : -1;
+    if (cut > prev) {
+      add_chunk(prev, cut);
+      prev = cut;
+    }
+  }
+  add_chunk(prev, len);
+
+  if (threads > chunks_count) {
+    threads = chunks_count;
+  }
+  pthread_t *pool = calloc(threads, sizeof(pthread_t));
+  for (i = 0; i < threads; ++i) {
+    pthread_create(&pool[i], NULL, worker, source.buf);
+  }
+  for (i = 0; i < threads; ++i) {
+    pthread_join(pool[i], NULL);
+  }
+
+  int parsed_again;
+  int ret = stitch(source.buf, len, &parsed_again);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (ret < 0) {
+    fprintf(stderr, "parse error=%d\n", ret);
+    unmap_file(&source);
+    return 1;
+  }
+
+  int used = 0;
+  stream_writer w;
+  stream_writer_init(&w, len);
+  for (int lines = 0, k = 0; k < chunks_count; lines += chunks[k++].newlines) {
+    split_chunk *c = &chunks[k];
+    if (!c->used) {
+      continue;
+    }
+    ++used;
+
+    for (int r = 0; r < c->out.len; ++r) {
+      stream_record *rec = &(c->out.buf[r]);
+      int line_no = rec->line_no + (r < c->relative ? lines : 0);
+      if (rec->p < 0) {
+        stream_write_stack(&w, rec->type, rec->special);
+      } else {
+        stream_write_token(&w, rec->vp, rec->p, rec->len, line_no, rec->type, rec->special);
+      }
+    }
+  }
+
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "%d chunks (%d lined up), %.1f%% parsed again, %.2fMB in %.3fs on %d threads, %.1fMB/s\n",
+      chunks_count, used, len ? parsed_again * 100.0 / len : 0, len / 1e6, secs, threads,
+      secs ? len / 1e6 / secs : 0);
+
+  int wlen;
+  uint8_t *buf = stream_writer_finish(&w, &wlen);
+  if (out_path) {
+    FILE *f = fopen(out_path, "wb");
+    if (!f || fwrite(buf, 1, wlen, f) != wlen || fclose(f)) {
+      fprintf(stderr, "could not write: %s\n", out_path);
+      ret = 1;
+    }
+  }
+  free(buf);
+  unmap_file(&source);
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+set -eu
+clang -O2 -DSPEED cli.c stream.c ../batch/map.c ../core/*.c $@ -o _stream
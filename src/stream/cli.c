@@ -0,0 +1,135 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Writes the token stream for a source file (see stream.h), or reads one back. Usage:
+//
+//   ./_stream <source> <out>
+//   ./_stream -d <source> <stream>
+//
+// With -d, the stream is walked in-place from its mapping and printed one record per line.
+
+#include "../core/token.h"
+#include "../core/parser.h"
+#include "stream.h"
+#include "../batch/map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static char *base;
+
+void blep_parser_callback(parserdef *pd) {
+  struct token *t = blep_parser_cursor(pd);
+  stream_write_token(pd->arg, t->vp - base, t->p - base, t->len, t->line_no, t->type, t->special);
+}
+
+int blep_parser_open(parserdef *pd, int type) {
+  stream_write_stack(pd->arg, type, 1);
+  return 0;
+}
+
+void blep_parser_close(parserdef *pd, int type) {
+  stream_write_stack(pd->arg, type, 0);
+}
+
+static int encode(mapped_file *source, const char *out_path) {
+  stream_writer w;
+  stream_writer_init(&w, source->len);
+
+  parserdef pd;
+  pd.arg = &w;
+  base = source->buf;
+
+  int ret = blep_parser_init(&pd, source->buf, source->len);
+  if (ret >= 0) {
+    do {
+      ret = blep_parser_run(&pd);
+    } while (ret > 0);
+  }
+  if (ret < 0) {
+    fprintf(stderr, "parse error=%d line=%d\n", ret, blep_parser_cursor(&pd)->line_no);
+    free(w.buf);
+    return ret;
+  }
+
+  int len;
+  uint8_t *buf = stream_writer_finish(&w, &len);
+
+  FILE *f = fopen(out_path, "wb");
+  if (!f || fwrite(buf, 1, len, f) != len || fclose(f)) {
+    fprintf(stderr, "could not write: %s\n", out_path);
+    free(buf);
+    return 1;
+  }
+  fprintf(stderr, "%d records, %d bytes (%.2f bytes/record, source=%d)\n",
+      w.count, len, w.count ? (double) len / w.count : 0, source->len);
+  free(buf);
+  return 0;
+}
+
+static int decode(mapped_file *source, const char *stream_path) {
+  mapped_file m;
+  if (map_file(stream_path, &m) < 0) {
+    fprintf(stderr, "could not read: %s\n", stream_path);
+    return 1;
+  }
+
+  stream_reader r;
+  if (stream_reader_init(&r, (uint8_t *) m.buf, m.len) || r.source_len != source->len) {
+    fprintf(stderr, "bad stream: %s\n", stream_path);
+    unmap_file(&m);
+    return 1;
+  }
+
+  stream_record rec;
+  int ret;
+  while ((ret = stream_read(&r, &rec)) > 0) {
+    if (rec.p < 0) {
+      printf("%s %d\n", rec.special ? ">" : "<", rec.type);
+    } else if (rec.vp > rec.p || rec.p + rec.len > source->len) {
+      ret = -1;
+      break;
+    } else {
+      printf("%d:%d %d %u %.*s\n", rec.line_no, rec.p, rec.type, rec.special, rec.len, source->buf + rec.p);
+    }
+  }
+
+  unmap_file(&m);
+  if (ret < 0) {
+    fprintf(stderr, "bad stream: %s\n", stream_path);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int is_decode = argc == 4 && !strcmp(argv[1], "-d");
+  if (argc != 3 && !is_decode) {
+    fprintf(stderr, "usage: %s [-d] <source> <stream>\n", argv[0]);
+    return 1;
+  }
+
+  mapped_file source;
+  if (map_file(argv[argc - 2], &source) < 0) {
+    fprintf(stderr, "could not read: %s\n", argv[argc - 2]);
+    return 1;
+  }
+
+  int ret = is_decode ? decode(&source, argv[3]) : encode(&source, argv[2]);
+  unmap_file(&source);
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include "stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+// worst case for a token: tag, ext, four varints and a special
+#define STREAM_RECORD_MAX (2 + 5 * 5)
+
+static inline uint32_t zigzag(int v) {
+  return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+}
+
+static inline int unzigzag(uint32_t v) {
+  return (int) (v >> 1) ^ -(int) (v & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *out, uint32_t v) {
+  while (v >= 0x80) {
+    *out++ = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  *out++ = v;
+  return out;
+}
+
+static inline void put_u32(uint8_t *out, uint32_t v) {
+  out[0] = v;
+  out[1] = v >> 8;
+  out[2] = v >> 16;
+  out[3] = v >> 24;
+}
+
+static inline uint32_t get_u32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+// returns the next position, or NULL if the varint runs past end or is too long
+static inline const uint8_t *get_varint(const uint8_t *in, const uint8_t *end, uint32_t *v) {
+  uint32_t out = 0;
+  for (int shift = 0; in < end && shift < 35; shift += 7) {
+    uint8_t b = *in++;
+    out |= (uint32_t) (b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *v = out;
+      return in;
+    }
+  }
+  return NULL;
+}
+
+static uint8_t *stream_reserve(stream_writer *w) {
+  if (w->len + STREAM_RECORD_MAX > w->cap) {
+    w->cap = w->cap * 2 + STREAM_RECORD_MAX;
+    w->buf = realloc(w->buf, w->cap);
+  }
+  return w->buf + w->len;
+}
+
+void stream_writer_init(stream_writer *w, int source_len) {
+  memset(w, 0, sizeof(stream_writer));
+  w->source_len = source_len;
+  w->line_no = 1;
+
+  // roughly one token per five bytes of source
+  w->cap = STREAM_HEADER_SIZE + source_len / 2 + STREAM_RECORD_MAX;
+  w->buf = malloc(w->cap);
+  w->len = STREAM_HEADER_SIZE;
+}
+
+void stream_write_token(stream_writer *w, int vp, int p, int len, int line_no, int type, uint32_t special) {
+  uint8_t *start = stream_reserve(w);
+  uint8_t *out = start + 2;  // leave space for tag and ext, ext may be unused
+
+  int ext = 0;
+  if (line_no != w->line_no) {
+    ext |= STREAM_EXT_LINE;
+    out = put_varint(out, zigzag(line_no - w->line_no));
+    w->line_no = line_no;
+  }
+  if (vp != w->end) {
+    ext |= STREAM_EXT_VOID;
+    out = put_varint(out, zigzag(vp - w->end));
+  }
+  out = put_varint(out, p - vp);
+  out = put_varint(out, len);
+  w->end = p + len;
+
+  int tag = type & STREAM_TAG_TYPE;
+  if (special) {
+    int slot = stream_cache_slot(special);
+    if (w->cache[slot] == special) {
+      tag |= STREAM_SPECIAL_CACHED;
+      *out++ = slot;
+    } else {
+      tag |= STREAM_SPECIAL_VARINT;
+      out = put_varint(out, special);
+      w->cache[slot] = special;
+    }
+  }
+
+  if (ext) {
+    start[0] = tag | STREAM_TAG_EXT;
+    start[1] = ext;
+  } else {
+    // most tokens have no ext byte, so close the gap
+    start[0] = tag;
+    memmove(start + 1, start + 2, out - (start + 2));
+    --out;
+  }
+
+  w->len = out - w->buf;
+  ++w->count;
+}
+
+void stream_write_stack(stream_writer *w, int type, int open) {
+  uint8_t *out = stream_reserve(w);
+  out[0] = STREAM_TAG_STACK | (open ? STREAM_TAG_OPEN : 0);
+  out[1] = type;
+  w->len += 2;
+  ++w->count;
+}
+
+uint8_t *stream_writer_finish(stream_writer *w, int *len) {
+  memcpy(w->buf, "blep", 4);
+  w->buf[4] = STREAM_VERSION;
+  w->buf[5] = w->buf[6] = w->buf[7] = 0;
+  put_u32(w->buf + 8, w->source_len);
+  put_u32(w->buf + 12, w->count);
+
+  *len = w->len;
+  return w->buf;
+}
+
+int stream_reader_init(stream_reader *r, const uint8_t *buf, int len) {
+  memset(r, 0, sizeof(stream_reader));
+  if (len < STREAM_HEADER_SIZE || memcmp(buf, "blep", 4) || buf[4] != STREAM_VERSION) {
+    return -1;
+  }
+  r->at = buf + STREAM_HEADER_SIZE;
+  r->end = buf + len;
+  r->source_len = get_u32(buf + 8);
+  r->remaining = get_u32(buf + 12);
+  r->line_no = 1;
+  return 0;
+}
+
+int stream_read(stream_reader *r, stream_record *out) {
+  if (!r->remaining) {
+    return 0;
+  }
+  const uint8_t *at = r->at;
+  const uint8_t *end = r->end;
+  if (at >= end) {
+    return -1;
+  }
+  int tag = *at++;
+
+  if ((tag & STREAM_TAG_TYPE) == STREAM_TAG_STACK) {
+    if (at >= end) {
+      return -1;
+    }
+    out->vp = 0;
+    out->p = -1;
+    out->len = 0;
+    out->line_no = r->line_no;
+    out->type = *at++;
+    out->special = (tag & STREAM_TAG_OPEN) ? 1 : 0;
+    r->at = at;
+    --r->remaining;
+    return 1;
+  }
+
+  int ext = 0;
+  if (tag & STREAM_TAG_EXT) {
+    if (at >= end) {
+      return -1;
+    }
+    ext = *at++;
+  }
+
+  uint32_t v;
+  if (ext & STREAM_EXT_LINE) {
+    if (!(at = get_varint(at, end, &v))) {
+      return -1;
+    }
+    r->line_no += unzigzag(v);
+  }
+  int vp = r->prev_end;
+  if (ext & STREAM_EXT_VOID) {
+    if (!(at = get_varint(at, end, &v))) {
+      return -1;
+    }
+    vp += unzigzag(v);
+  }
+  if (!(at = get_varint(at, end, &v))) {
+    return -1;
+  }
+  int p = vp + v;
+  if (!(at = get_varint(at, end, &v))) {
+    return -1;
+  }
+  int len = v;
+
+  uint32_t special = 0;
+  switch (tag & STREAM_TAG_SPECIAL) {
+    case STREAM_SPECIAL_VARINT:
+      if (!(at = get_varint(at, end, &special))) {
+        return -1;
+      }
+      r->cache[stream_cache_slot(special)] = special;
+      break;
+
+    case STREAM_SPECIAL_CACHED:
+      if (at >= end || *at >= STREAM_CACHE_SIZE) {
+        return -1;
+      }
+      special = r->cache[*at++];
+      break;
+  }
+
+  out->vp = vp;
+  out->p = p;
+  out->len = len;
+  out->line_no = r->line_no;
+  out->type = tag & STREAM_TAG_TYPE;
+  out->special = special;
+
+  r->prev_end = p + len;
+  r->at = at;
+  --r->remaining;
+  return 1;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#ifndef __BLEP_STREAM_H
+#define __BLEP_STREAM_H
+
+#include <stdint.h>
+
+// A compact encoding of the tokens and stack events from a parse, to be cached and walked again
+// without parsing. All multi-byte values are little-endian.
+//
+// The header is STREAM_HEADER_SIZE bytes: "blep", version, three zero bytes, then the source length
+// and the record count as u32s. Each record then starts with a tag byte:
+//
+//   - stack events are STREAM_TAG_STACK, plus STREAM_TAG_OPEN if opening, then the stack type
+//   - tokens have their type in the low bits, STREAM_TAG_EXT if an ext byte follows, and how their
+//     special is stored in the top two bits
+//
+// Tokens then have, in order:
+//
+//   - if ext has STREAM_EXT_LINE: zigzag varint of the change in line_no
+//   - if ext has STREAM_EXT_VOID: zigzag varint of the void's offset from the previous token's end
+//   - varint of the void's length (p - vp), then varint of the token's length
+//   - STREAM_SPECIAL_VARINT: a varint, or STREAM_SPECIAL_CACHED: a byte indexing the special cache
+//
+// The special cache holds STREAM_CACHE_SIZE recently seen specials, so that repeated ops and
+// keywords take a single byte. Both sides update it the same way, see stream_cache_slot.
+
+#define STREAM_VERSION        1
+#define STREAM_HEADER_SIZE    16
+
+#define STREAM_TAG_TYPE       0x1f
+#define STREAM_TAG_STACK      0x1f
+#define STREAM_TAG_OPEN       0x20
+#define STREAM_TAG_EXT        0x20
+#define STREAM_TAG_SPECIAL    0xc0
+
+#define STREAM_SPECIAL_NONE   0x00
+#define STREAM_SPECIAL_VARINT 0x40
+#define STREAM_SPECIAL_CACHED 0x80
+
+#define STREAM_EXT_LINE       1
+#define STREAM_EXT_VOID       2
+
+#define STREAM_CACHE_BITS     6
+#define STREAM_CACHE_SIZE     (1 << STREAM_CACHE_BITS)
+
+static inline int stream_cache_slot(uint32_t special) {
+  return (special * 2654435761u) >> (32 - STREAM_CACHE_BITS);
+}
+
+// a decoded record: offsets are relative to the start of the source
+typedef struct {
+  int vp;
+  int p;        // -1 for stack events
+  int len;
+  int line_no;
+  int type;     // token or stack type
+  uint32_t special;  // for stack events, 1 for open and 0 for close
+} stream_record;
+
+typedef struct {
+  uint8_t *buf;
+  int len;
+  int cap;
+  int count;
+  int source_len;
+
+  int end;  // of previous token
+  int line_no;
+  uint32_t cache[STREAM_CACHE_SIZE];
+} stream_writer;
+
+typedef struct {
+  const uint8_t *at;
+  const uint8_t *end;
+  int remaining;
+  int source_len;
+
+  int prev_end;
+  int line_no;
+  uint32_t cache[STREAM_CACHE_SIZE];
+} stream_reader;
+
+// the writer owns buf, which grows as needed; free it when done
+void stream_writer_init(stream_writer *, int source_len);
+void stream_write_token(stream_writer *, int vp, int p, int len, int line_no, int type, uint32_t special);
+void stream_write_stack(stream_writer *, int type, int open);
+uint8_t *stream_writer_finish(stream_writer *, int *len);
+
+// reads from buf in-place, which must be valid for the life of the reader. returns < 0 if bad.
+int stream_reader_init(stream_reader *, const uint8_t *buf, int len);
+
+// fills the next record. returns 1 if read, 0 at the end, or < 0 if the stream is corrupt.
+int stream_read(stream_reader *, stream_record *);
+
+#endif//__BLEP_STREAM_H
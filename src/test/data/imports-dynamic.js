@@ -0,0 +1,4 @@
+function load() {
+  return import('./lazy').then((m) => m.run(/[)]/));
+}
+class X { y() { import(`./other`); } }
@@ -14,15 +14,18 @@
  * the License.
  */
 
-import buildHarness from '../harness/node-harness.js';
+import buildHarness, {buildPool} from '../harness/node-harness.js';
 import buildRewriter from '../harness/node-rewriter.js';
 import {specials, types} from '../harness/common.js';
+import {buildStream, readStream} from '../harness/stream.js';
 import * as lit from '../tokens/lit.js';
 
 import test from 'ava';
+import * as fs from 'fs';
+import * as os from 'os';
 
 const harness = await buildHarness();
-const {run, token} = buildRewriter(harness);
+const {run, pipe, token} = buildRewriter(harness);
 
 test.serial('simple', (t) => {
   const expected = [
@@ -138,3 +141,473 @@ var a = async () => 123;
 let b = async();
 `);
 });
+
+test.serial('rewriter source map', (t) => {
+  const callback = () => {
+    if (token.special() === specials.external && token.type() === types.string) {
+      return '\'made_up_module\'';
+    }
+  };
+
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  /** @type {any[]} */
+  const maps = [];
+  run(pathname, {callback, sourceMap: maps.push.bind(maps)});
+
+  // every line maps to itself, with the import's line split around its new string
+  t.deepEqual(maps, [{
+    version: 3,
+    sources: [pathname],
+    names: [],
+    mappings: 'AAAA' + ';AACA'.repeat(16) + ',gBAAgB,gBAAK' + ';AACrB' + ';AACA'.repeat(7),
+  }]);
+});
+
+test.serial('batch', (t) => {
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  const source = fs.readFileSync(pathname);
+
+  const expected = [];
+  harness.prepare(source.length).set(source);
+  harness.handle({
+    callback() {
+      expected.push([token.at(), token.length(), token.type(), token.special()]);
+    },
+    open(type) {
+      expected.push([-1, 0, type, 1]);
+    },
+    close(type) {
+      expected.push([-1, 0, type, 0]);
+    },
+  });
+  const statements = harness.run();
+
+  const actual = [];
+  harness.prepare(source.length).set(source);
+  t.is(harness.runBatch((records) => {
+    for (let i = 0; i < records.length; i += 7) {
+      actual.push([records[i + 1], records[i + 2], records[i + 4], records[i + 5]]);
+    }
+  }), statements);
+
+  t.deepEqual(actual, expected);
+});
+
+test.serial('tokenize', (t) => {
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  const source = fs.readFileSync(pathname);
+
+  let tokens = 0;
+  harness.prepare(source.length).set(source);
+  harness.handle({callback() { ++tokens; }});
+  harness.run();
+
+  harness.prepare(source.length).set(source);
+  t.is(harness.tokenize(), tokens);
+
+  const bad = Buffer.from('x = 1)');
+  harness.prepare(bad.length).set(bad);
+  t.throws(() => harness.tokenize());
+});
+
+test.serial('batch cancelled', (t) => {
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  const source = fs.readFileSync(pathname);
+
+  let records = 0;
+  let checks = 0;
+  harness.prepare(source.length).set(source);
+  const error = t.throws(() => {
+    harness.runBatch((batch) => {
+      records += batch.length / 7;
+    }, () => ++checks === 2);
+  });
+
+  t.is(error.name, 'AbortError');
+  t.is(checks, 2, 'should be checked between statements');
+  t.true(records > 0, 'records so far should be flushed');
+});
+
+test.serial('chunked', (t) => {
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  const source = fs.readFileSync(pathname);
+
+  /** @type {any[]} */
+  let actual = [];
+  const handlers = {
+    callback() {
+      const at = token.at();
+      actual.push([at, token.length(), token.type(), token.special(), harness.input(at, at + 1)[0]]);
+    },
+    open(type) {
+      actual.push([-1, 0, type, 1]);
+    },
+    close(type) {
+      actual.push([-1, 0, type, 0]);
+    },
+  };
+
+  harness.prepare(source.length).set(source);
+  harness.handle(handlers);
+  const statements = harness.run();
+  const expected = actual;
+
+  actual = [];
+  let done = [];
+  let readAt = 0;
+  let released = 0;
+  harness.handle(handlers);
+  t.is(harness.runChunked({
+    read(buffer) {
+      // tiny reads to split most tokens and statements
+      const part = source.subarray(readAt, readAt + Math.min(7, buffer.length));
+      buffer.set(part);
+      readAt += part.length;
+      return part.length;
+    },
+    release(offset) {
+      t.true(offset >= released);
+      released = offset;
+    },
+    statement() {
+      done = done.concat(actual);
+      actual = [];
+    },
+    rewind() {
+      actual = [];
+    },
+  }), statements);
+
+  t.deepEqual(done.concat(actual), expected);
+  t.true(released > 0, 'input should be released');
+});
+
+test.serial('edit', (t) => {
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  const source = fs.readFileSync(pathname);
+
+  /** @type {number[][]} */
+  let tokens = [];
+  const handlers = {
+    callback() {
+      tokens.push([token.at(), token.length(), token.type()]);
+    },
+  };
+
+  /**
+   * @param {Uint8Array} text
+   */
+  const parseAll = (text) => {
+    tokens = [];
+    harness.prepare(text.length).set(text);
+    harness.handle(handlers);
+    harness.run();
+    return tokens;
+  };
+
+  // insert then remove a statement in the middle, checking against a full parse each time
+  const at = source.indexOf(10, source.length >> 1) + 1;
+  let text = source;
+  for (const [deleted, inserted] of [[0, 'x = 1\n'], [6, '']]) {
+    const previous = parseAll(text);
+    harness.prepare(text.length).set(text);
+    harness.runIncremental();
+
+    tokens = [];
+    harness.handle(handlers);
+    const result = harness.edit(at, deleted, inserted);
+    t.true(result.start <= at && result.added <= 2, 'should parse little');
+
+    const delta = inserted.length - deleted;
+    const actual = [
+      ...previous.filter(([p]) => p < result.start),
+      ...tokens,
+      ...previous.filter(([p]) => p >= result.end - delta).map(([p, ...rest]) => [p + delta, ...rest]),
+    ];
+
+    const next = new Uint8Array(text.length + delta);
+    next.set(text.subarray(0, at));
+    next.set(Buffer.from(inserted), at);
+    next.set(text.subarray(at + deleted), at + inserted.length);
+    text = next;
+
+    t.deepEqual(actual, parseAll(text));
+  }
+});
+
+test.serial('stream', (t) => {
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  const source = fs.readFileSync(pathname);
+
+  const expected = [];
+  harness.prepare(source.length).set(source);
+  harness.runBatch((records) => {
+    for (let i = 0; i < records.length; i += 7) {
+      expected.push([records[i], records[i + 1], records[i + 2], records[i + 4], records[i + 5]]);
+    }
+  });
+
+  harness.prepare(source.length).set(source);
+  const stream = buildStream(harness, source.length);
+  t.true(stream.length < expected.length * 6, 'stream should be compact');
+
+  const reader = readStream(stream.slice().buffer);
+  t.is(reader.sourceLength, source.length);
+  t.is(reader.count, expected.length);
+
+  const actual = [];
+  while (reader.next()) {
+    actual.push([reader.void, reader.at, reader.length, reader.type, reader.special]);
+  }
+  t.deepEqual(actual, expected);
+});
+
+test.serial('brackets', (t) => {
+  const source = new TextEncoder().encode('if (a) { b = [c ? d : `${e}`]; }');
+  harness.prepare(source.length).set(source);
+  const index = harness.brackets();
+  harness.run();
+
+  const at = (s, from = 0) => source.indexOf(s.charCodeAt(0), from);
+  t.is(index[at('(')], at(')'));
+  t.is(index[at('{')], source.lastIndexOf(125));
+  t.is(index[at('[')], at(']'));
+  t.is(index[at('?')], at(':'));
+  t.is(index[at('`')], at('}', at('e')));
+  t.is(index[at('a')], -1);
+});
+
+test.serial('nesting', (t) => {
+  // past the built-in stack of 256 brackets, in every mode
+  const deep = new TextEncoder().encode('['.repeat(1000) + '1' + ']'.repeat(1000));
+  harness.prepare(deep.length).set(deep);
+  const expected = harness.run();
+  t.is(harness.runIncremental(), 1);
+  t.is(harness.edit(500, 1, '[').added, 1);
+
+  let readAt = 0;
+  const statements = harness.runChunked({
+    read(buffer) {
+      const part = deep.subarray(readAt, readAt + Math.min(64, buffer.length));
+      buffer.set(part);
+      readAt += part.length;
+      return part.length;
+    },
+  });
+  t.is(statements, expected);
+
+  // ... but only up to NEST_MAX
+  const tooDeep = new TextEncoder().encode('['.repeat(1100) + '1' + ']'.repeat(1100));
+  harness.prepare(tooDeep.length).set(tooDeep);
+  const error = t.throws(() => harness.run());
+  t.true(error.message.includes('stack'));
+});
+
+test.serial('stringValue', (t) => {
+  const values = [
+    `'plain'`,
+    `"\\n\\t\\x41\\u0042\\u{1F600}\\uD83D\\uDE00\\0"`,
+    `'line\\\ncontinued'`,
+    `'café \\é'`,
+    '`template\r\nnewline`',
+    '``',
+  ];
+  const source = new TextEncoder().encode(values.join(';\n'));
+  harness.prepare(source.length).set(source);
+
+  const actual = [];
+  harness.handle({
+    callback() {
+      if (harness.token.type() === types.string) {
+        actual.push(harness.token.stringValue());
+      }
+    },
+  });
+  harness.run();
+  t.deepEqual(actual, values.map((v) => eval(v)));
+
+  // decoding a value bigger than any input so far doesn't grow memory, detaching the input
+  const big = new TextEncoder().encode(`x = '${'\\x41'.repeat(1 << 20)}';`);
+  const input = harness.prepare(big.length);
+  input.set(big);
+  let value = '';
+  harness.handle({
+    callback() {
+      if (harness.token.type() === types.string) {
+        value = harness.token.stringValue();
+      }
+    },
+  });
+  harness.run();
+  t.is(value.length, 1 << 20);
+  t.is(input.length, big.length);
+});
+
+test.serial('rewriter writev and pipe', (t) => {
+  const callback = () => {
+    if (token.special() === specials.external && token.type() === types.string) {
+      return '\'made_up_module\'';
+    }
+  };
+
+  const {pathname} = new URL('data/simple.js', import.meta.url);
+  const parts = [];
+  run(pathname, {callback, write: (part) => parts.push(part.slice())});
+  const expected = Buffer.concat(parts);
+
+  let calls = 0;
+  run(pathname, {
+    callback,
+    writev(parts) {
+      ++calls;
+      t.deepEqual(Buffer.concat(parts), expected);
+    },
+  });
+  t.is(calls, 1);
+
+  const target = `${os.tmpdir()}/gumnut-pipe-${process.pid}.js`;
+  const fd = fs.openSync(target, 'w');
+  try {
+    t.is(pipe(pathname, fd, {callback}), expected.length);
+  } finally {
+    fs.closeSync(fd);
+  }
+  t.deepEqual(fs.readFileSync(target), expected);
+  fs.unlinkSync(target);
+});
+
+test.serial('runRewrite', (t) => {
+  const source = 'import a from "x";\nfoo(() => import(\'y\\x41\'));\nexport * from \'z\';';
+  const buffer = new TextEncoder().encode(source);
+  harness.prepare(buffer.length).set(buffer);
+
+  let calls = 0;
+  const out = harness.runRewrite((values) => {
+    ++calls;
+    t.deepEqual(values, ['x', 'yA', 'z']);
+    return ['./x.js', undefined, 'z\u2603'];
+  });
+  t.is(calls, 1);
+  t.is(new TextDecoder().decode(out), 'import a from "./x.js";\nfoo(() => import(\'y\\x41\'));\nexport * from "z\u2603";');
+});
+
+test.serial('token ids', (t) => {
+  const buffer = new TextEncoder().encode('foo(bar, foo.bar); baz = 1;');
+  harness.prepare(buffer.length).set(buffer);
+
+  const names = [];
+  harness.handle({
+    callback() {
+      if (harness.token.id() !== -1) {
+        names.push([harness.token.string(), harness.token.id(), harness.token.hash()]);
+      }
+    },
+  });
+  harness.run();
+
+  t.deepEqual(names.map(([name, id]) => [name, id]), [['foo', 0], ['bar', 1], ['foo', 0], ['bar', 1], ['baz', 2]]);
+  t.is(names[0][2], names[2][2]);
+  t.not(names[0][2], names[1][2]);
+});
+
+test.serial('runRecover', (t) => {
+  const source = 'import * x from "y";\nif (x) { for (;;;) {} z(); }\nbar;';
+  const buffer = new TextEncoder().encode(source);
+
+  let tokens = 0;
+  let balance = 0;
+  harness.prepare(buffer.length).set(buffer);
+  harness.handle({
+    callback() {
+      ++tokens;
+    },
+    open() {
+      ++balance;
+    },
+    close() {
+      --balance;
+    },
+  });
+  const {errors, count} = harness.runRecover();
+
+  t.is(count, 2);
+  t.deepEqual(errors.map(({type, at, depth}) => [type, source[at], depth]), [
+    ['unexpected', 'x', 0],
+    ['unexpected', ';', 2],
+  ]);
+  t.is(balance, 0, 'stacks should close even on error');
+  t.is(tokens, 26, 'every token should be passed on');
+
+  harness.prepare(buffer.length).set(buffer);
+  t.throws(() => harness.run());
+});
+
+test.serial('position', (t) => {
+  const buffer = new TextEncoder().encode('a;\n\n  foo(\nbar);');
+  harness.prepare(buffer.length).set(buffer);
+
+  const positions = [];
+  harness.handle({
+    callback() {
+      const {line, column} = harness.position(harness.token.at());
+      positions.push([harness.token.string(), line, column, harness.token.lineNo()]);
+    },
+  });
+  harness.run();
+
+  t.deepEqual(positions.filter(([s]) => s === 'foo' || s === 'bar'), [['foo', 3, 2, 3], ['bar', 4, 0, 4]]);
+  t.deepEqual(harness.position(0), {line: 1, column: 0});
+  t.deepEqual(harness.position(buffer.length), {line: 4, column: 5});
+  t.throws(() => harness.position(buffer.length + 1));
+});
+
+test.serial('runScope', (t) => {
+  const source = 'import a from "x";\nfunction b(c) { let d = a + c + e; }\nexport {b};';
+  const buffer = new TextEncoder().encode(source);
+  harness.prepare(buffer.length).set(buffer);
+
+  const {scopes, bindings, globals} = harness.runScope();
+  t.deepEqual(Array.from(scopes.filter((_, i) => i % 4 === 0)), [-1, 0, 1]);
+
+  const names = [];
+  for (let i = 0; i < bindings.length; i += 6) {
+    names.push([source.substr(bindings[i], bindings[i + 1]), bindings[i + 2], bindings[i + 4]]);
+  }
+  t.deepEqual(names, [['a', 0, 1], ['b', 0, 1], ['c', 1, 1], ['d', 2, 0]]);
+  t.is(source.substr(globals[0], globals[1]), 'e');
+
+  const reserved = 'null; true; false; this; class B extends C { constructor() { super(); new.target; } } import.meta.url;';
+  const reservedBuffer = new TextEncoder().encode(reserved);
+  harness.prepare(reservedBuffer.length).set(reservedBuffer);
+
+  const {globals: reservedGlobals} = harness.runScope();
+  const reservedNames = [];
+  for (let i = 0; i < reservedGlobals.length; i += 4) {
+    reservedNames.push(reserved.substr(reservedGlobals[i], reservedGlobals[i + 1]));
+  }
+  t.deepEqual(reservedNames, ['C']);
+});
+
+test.serial('pool', async (t) => {
+  const pool = await buildPool({max: 2});
+  const a = await pool.lease();
+  const b = await pool.lease();
+  t.not(a, b);
+
+  // the third lease waits for a release
+  const pending = pool.lease();
+  pool.release(a);
+  t.is(await pending, a);
+  pool.release(a);
+  pool.release(b);
+
+  const tokens = await pool.use((h) => {
+    const buffer = new TextEncoder().encode('a + b;');
+    h.prepare(buffer.length).set(buffer);
+    let count = 0;
+    h.handle({callback() { ++count; }});
+    h.run();
+    return count;
+  });
+  t.is(tokens, 4);
+});
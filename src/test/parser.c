@@ -1,18 +1,29 @@
 
 #include "../core/token.h"
 #include "../core/parser.h"
+#include "../core/feed.h"
+#include "../core/reparse.h"
+#include "../core/unescape.h"
+#include "../core/rewrite.h"
+#include "../core/scope.h"
+#include "../core/intern.h"
+#include "../core/lines.h"
+#include "../core/recover.h"
 #include <stdio.h>
 #include <strings.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef struct _testdef {
   const char *name;
   const char *input;
   int *expected;  // zero-terminated token types
   int is_module;
+  int is_scan;  // skip everything but modules, and scan within them
   struct testdef *next;  // for failures
 } testdef;
 
+static parserdef pd;
 static struct token *t;
 static int render_output = 0;
 
@@ -23,7 +34,50 @@ struct {
   int error;
 } active;
 
-void blep_parser_callback() {
+// while reparsing, tokens are just recorded as offset (from recording) and type
+static char *recording;
+static int emitted[1024][2];
+static int emitted_len;
+
+// while rewriting, external strings are recorded here instead
+static rewritedef *rewriting;
+
+// ... or while scoping, everything is passed here
+static scopedef *scoping;
+
+// ... or while finding external strings, just their offsets are recorded (scanning bodies if
+// externals_scan), so that both modes can be compared
+static char *externals;
+static int externals_scan;
+static int externals_at[32];
+static int externals_len;
+
+// while recovering, stacks are counted so they can be checked to balance
+static int balancing;
+static int balance;
+
+void blep_parser_callback(parserdef *pd) {
+  if (scoping) {
+    blep_scope_token(scoping, t);
+    return;
+  }
+  if (rewriting) {
+    blep_rewrite_token(rewriting, t);
+    return;
+  }
+  if (externals) {
+    if (t->type == TOKEN_STRING && t->special == SPECIAL__EXTERNAL && externals_len < 32) {
+      externals_at[externals_len++] = t->p - externals;
+    }
+    return;
+  }
+  if (recording) {
+    emitted[emitted_len][0] = t->p - recording;
+    emitted[emitted_len][1] = t->type;
+    ++emitted_len;
+    return;
+  }
+
   int actual = t->type;
   int expected = -1;
 
@@ -44,16 +98,135 @@ void blep_parser_callback() {
   ++active.at;
 }
 
-int blep_parser_open(int type) {
+int blep_parser_open(parserdef *pd, int type) {
+  if (balancing) {
+    ++balance;
+    return 0;
+  }
+  if (scoping) {
+    blep_scope_open(scoping, type, t);
+    return 0;
+  }
+  if (externals) {
+    return externals_scan && type != STACK__MODULE ? PARSER_SKIP_SCAN : 0;
+  }
+  if ((rewriting || active.def->is_scan) && type != STACK__MODULE) {
+    return PARSER_SKIP_SCAN;
+  }
   return 0;
 }
 
-void blep_parser_close(int type) {
-  // ignore
+void blep_parser_close(parserdef *pd, int type) {
+  if (balancing) {
+    --balance;
+  }
+  if (scoping) {
+    blep_scope_close(scoping, type);
+  }
 }
 
-int run_testdef(testdef *def) {
-  t = blep_parser_cursor();
+// runs the parser over input pushed one byte at a time, rolling back expectations on each retry
+int run_feed(const char *input) {
+  static char buf[1024];
+  feeddef fd;
+  blep_feed_init(&fd, &pd, buf, sizeof(buf));
+
+  int len = strlen(input);
+  int pos = 0;
+  int at = 0;
+  int error = 0;
+
+  for (;;) {
+    int ret = blep_feed_run(&fd);
+    if (ret == FEED__STATEMENT) {
+      at = active.at;
+      error = active.error;
+      continue;
+    } else if (ret != FEED__MORE) {
+      return ret;
+    }
+
+    active.at = at;
+    active.error = error;
+    int n = (pos < len && blep_feed_space(&fd)) ? 1 : 0;
+    fd.buf[fd.len] = input[pos];
+    pos += n;
+    blep_feed_push(&fd, n, pos == len);
+  }
+}
+
+// applies an edit already made to buf, and patches tokens with those emitted by the reparse
+static int reparse_patch(reparsedef *rd, char *buf, int len, int at, int deleted, int inserted,
+    int tokens[][2], int *count) {
+  static int next[1024][2];
+  int n = 0;
+
+  emitted_len = 0;
+  int ret = blep_reparse_edit(rd, buf, len, at, deleted, inserted);
+  int delta = inserted - deleted;
+
+  for (int i = 0; i < *count && tokens[i][0] < rd->start; ++i, ++n) {
+    next[n][0] = tokens[i][0];
+    next[n][1] = tokens[i][1];
+  }
+  memcpy(next + n, emitted, sizeof(int) * 2 * emitted_len);
+  n += emitted_len;
+  for (int i = 0; ret >= 0 && i < *count; ++i) {
+    if (tokens[i][0] >= rd->end - delta) {
+      next[n][0] = tokens[i][0] + delta;
+      next[n][1] = tokens[i][1];
+      ++n;
+    }
+  }
+
+  memcpy(tokens, next, sizeof(int) * 2 * n);
+  *count = n;
+  return ret;
+}
+
+// parses once, then deletes and restores each byte in turn via reparse, patching the tokens from
+// the first parse with just those parsed again
+int run_reparse(const char *input) {
+  static char buf[1024];
+  static int tokens[1024][2];
+  static reparse_point points[16];  // few, so that they run out
+  reparsedef rd;
+  blep_reparse_init(&rd, &pd, points, 16);
+
+  int len = strlen(input);
+  memcpy(buf, input, len + 1);
+  recording = buf;
+  emitted_len = 0;
+
+  int ret = blep_reparse_run(&rd, buf, len);
+  int count = emitted_len;
+  memcpy(tokens, emitted, sizeof(int) * 2 * count);
+
+  for (int at = 0; ret >= 0 && at < len; ++at) {
+    char c = buf[at];
+    memmove(buf + at, buf + at + 1, len - at);
+    reparse_patch(&rd, buf, len - 1, at, 1, 0, tokens, &count);  // may well fail
+
+    memmove(buf + at + 1, buf + at, len - at);
+    buf[at] = c;
+    ret = reparse_patch(&rd, buf, len, at, 0, 1, tokens, &count);
+  }
+  recording = NULL;
+
+  for (int i = 0; i < count; ++i) {
+    int expected = active.at < active.len ? active.def->expected[active.at] : -1;
+    if (tokens[i][1] != expected) {
+      if (render_output) {
+        printf("%d: actual=%d expected=%d at=%d\n", active.at, tokens[i][1], expected, tokens[i][0]);
+      }
+      active.error = 1;
+    }
+    ++active.at;
+  }
+  return ret < 0 ? ret : 0;
+}
+
+int run_testdef_as(testdef *def, int mode) {
 
   active.def = def;
   active.at = 0;
@@ -66,14 +239,22 @@ int run_testdef(testdef *def) {
   }
 
   if (render_output) {
-    printf(">> %s\n", def->name);
+    const char *suffix[] = {"", " (fed)", " (reparse)"};
+    printf(">> %s%s\n", def->name, suffix[mode]);
   }
 
-  int ret = blep_parser_init((char *) def->input, strlen(def->input));
-  if (ret >= 0) {
-    do {
-      ret = blep_parser_run();
-    } while (ret > 0);
+  int ret;
+  if (mode == 1) {
+    ret = run_feed(def->input);
+  } else if (mode == 2) {
+    ret = run_reparse(def->input);
+  } else {
+    ret = blep_parser_init(&pd, (char *) def->input, strlen(def->input));
+    if (ret >= 0) {
+      do {
+        ret = blep_parser_run(&pd);
+      } while (ret > 0);
+    }
   }
 
   if (ret) {
@@ -99,6 +280,84 @@ int run_testdef(testdef *def) {
   return 0;
 }
 
+// parses depth nested brackets around a literal, with a stack arena of size if nonzero. mode is as
+// per run_testdef_as: fed input arrives in chunks, and reparsed input is edited once at its middle.
+int run_nested(const char *open, const char *close, int depth, int size, int mode) {
+  static char buf[65536];
+  static int arena[65536 * 2];
+  static int none[] = {TOKEN_EOF};
+  static testdef def = {.name = "nested", .expected = none};
+  int lo = strlen(open), lc = strlen(close);
+
+  char *p = buf;
+  for (int i = 0; i < depth; ++i, p += lo) {
+    memcpy(p, open, lo);
+  }
+  *p++ = '1';
+  for (int i = 0; i < depth; ++i, p += lc) {
+    memcpy(p, close, lc);
+  }
+  *p = 0;
+  int len = p - buf;
+
+  active.def = &def;
+  active.at = 0;
+  active.len = 0;
+
+  if (mode == 1) {
+    static char window[65536];
+    feeddef fd;
+    blep_feed_init(&fd, &pd, window, sizeof(window));
+    if (size) {
+      blep_feed_stack(&fd, arena, size);
+    }
+    int pos = 0;
+    int ret;
+    while ((ret = blep_feed_run(&fd)) == FEED__MORE || ret == FEED__STATEMENT) {
+      if (ret == FEED__MORE) {
+        int n = len - pos < 64 ? len - pos : 64;
+        memcpy(fd.buf + fd.len, buf + pos, n);
+        pos += n;
+        blep_feed_push(&fd, n, pos == len);
+      }
+    }
+    return ret;
+  } else if (mode == 2) {
+    static reparse_point points[16];
+    reparsedef rd;
+    blep_reparse_init(&rd, &pd, points, 16);
+    if (size) {
+      blep_reparse_stack(&rd, arena, size);
+    }
+    int ret = blep_reparse_run(&rd, buf, len);
+    if (ret >= 0) {
+      buf[len / 2] = buf[len / 2];  // nothing changes, but everything is parsed again
+      ret = blep_reparse_edit(&rd, buf, len, len / 2, 1, 1);
+    }
+    return ret;
+  }
+
+  int ret = blep_parser_init(&pd, buf, len);
+  if (ret >= 0 && size) {
+    ret = blep_token_stack(&(pd.td), arena, size);
+  }
+  if (ret >= 0) {
+    do {
+      ret = blep_parser_run(&pd);
+    } while (ret > 0);
+  }
+  return ret;
+}
+
+int run_testdef(testdef *def) {
+  t = blep_parser_cursor(&pd);
+  int ret = 0;
+  for (int mode = 0; mode < 3 && !ret; ++mode) {
+    ret = run_testdef_as(def, mode);
+  }
+  return ret;
+}
+
 // defines a test for prsr: args must have a trailing comma
 #define _test(_name, _input, ...) \
 { \
@@ -106,6 +365,7 @@ int run_testdef(testdef *def) {
   tdef.name = _name; \
   tdef.input = _input; \
   tdef.is_module = _name[0] == '^'; \
+  tdef.is_scan = _name[0] == '~'; \
   tdef.next = NULL; \
   int v[] = {__VA_ARGS__ TOKEN_EOF}; \
   tdef.expected = v; \
@@ -747,6 +1007,283 @@ int main() {
     TOKEN_CLOSE,     // }
   );
 
+  _test("~scan skims bodies", "import a from 'a';\nfunction f(x) { return import('b') + /}/ }\nclass X { y() { import(`c`); import(d) } }\nconst z = () => import('e', {});",
+    TOKEN_KEYWORD,   // import
+    TOKEN_SYMBOL,    // a
+    TOKEN_KEYWORD,   // from
+    TOKEN_STRING,    // 'a'
+    TOKEN_SEMICOLON, // ;
+    TOKEN_STRING,    // 'b'
+    TOKEN_STRING,    // `c`
+    TOKEN_STRING,    // 'e'
+  );
+
+  _test("~scan ignores other import", "x.import('a'); import.meta; import('b' + c); import(`${d}`)",
+  );
+
+  // brackets past the built-in stack need an arena (in every mode), and nesting is limited either way
+  t = blep_parser_cursor(&pd);
+  const char *nested_name = NULL;
+  int mode;
+  for (mode = 0; mode < 3 && !nested_name; ++mode) {
+    if (run_nested("(", ")", STACK_SIZE + 10, 0, mode) != ERROR__STACK ||
+        run_nested("[", "]", STACK_SIZE + 10, 0, mode) != ERROR__STACK) {
+      nested_name = "built-in stack overflows";
+    } else if (run_nested("(", ")", STACK_SIZE + 10, STACK_SIZE * 2, mode)) {
+      nested_name = "arena stack";
+    } else if (run_nested("[", "]", PARSER_NEST_MAX + 10, PARSER_NEST_MAX * 2, mode) != ERROR__STACK) {
+      nested_name = "nesting limit";
+    }
+  }
+  if (nested_name) {
+    printf("nested failed: %s (mode %d)\n", nested_name, mode - 1);
+    err = 1;
+    ++ecount;
+  }
+  ++count;
+
+  // string values are only written out if they differ from the raw string
+  struct {
+    const char *input;
+    int ret;
+    const char *value;
+  } unescapes[] = {
+    {"'plain'", UNESCAPE__RAW, "plain"},
+    {"\"\\n\\x41\\u0042\\u{1F600}\\uD83D\\uDE00\\0\"", 12, "\nAB\xf0\x9f\x98\x80\xf0\x9f\x98\x80"},
+    {"'a\\\nb\\\r\nc\\q'", 4, "abcq"},
+    {"`a\r\nb\rc`", 5, "a\nb\nc"},
+    {"'\\uD800'", UNESCAPE__SURROGATE, NULL},
+    {"'\\01'", ERROR__UNEXPECTED, NULL},
+    {"'\\u{110000}'", ERROR__UNEXPECTED, NULL},
+    {"'\\x4'", ERROR__UNEXPECTED, NULL},
+    {"'unclosed", ERROR__UNEXPECTED, NULL},
+  };
+  for (int i = 0; i < sizeof(unescapes) / sizeof(unescapes[0]); ++i) {
+    char out[64];
+    const char *input = unescapes[i].input;
+    int ret = blep_unescape((char *) input, strlen(input), out);
+    if (ret != unescapes[i].ret || (ret >= 0 && memcmp(out, unescapes[i].value, ret))) {
+      printf("unescape failed: %s (ret=%d)\n", input, ret);
+      err = 1;
+      ++ecount;
+    }
+    ++count;
+  }
+
+  // external strings are found (and decoded) even in scanned code, then replaced in one pass
+  do {
+    char input[] = "import a from \"x\";\nfoo(() => import('y\\x41'));\nexport * from 'z';";
+    int len = strlen(input);
+    rewrite_span spans[len / REWRITE_SPAN_BYTES + 1];
+    char values[sizeof(input)];
+    char out[sizeof(input) + 16];
+
+    rewritedef rd;
+    blep_rewrite_init(&rd, input, len, spans, len / REWRITE_SPAN_BYTES + 1, values);
+    rewriting = &rd;
+    int ret = blep_parser_init(&pd, input, len);
+    if (ret >= 0) {
+      do {
+        ret = blep_parser_run(&pd);
+      } while (ret > 0);
+    }
+    rewriting = NULL;
+
+    const char *expected = "import a from \"X1\";\nfoo(() => import('y\\x41'));\nexport * from 'zz';";
+    char *replacements = "\"X1\"'zz'";
+    int ok = ret == 0 && rd.count == 3 && rd.spans[1].value_len == 2 &&
+        !memcmp(values + rd.spans[1].value, "yA", 2);
+    if (ok) {
+      spans[0].replace = 0;
+      spans[0].replace_len = 4;
+      spans[2].replace = 4;
+      spans[2].replace_len = 4;
+      int written = blep_rewrite_emit(&rd, replacements, out);
+      ok = written == strlen(expected) && !memcmp(out, expected, written);
+    }
+    if (!ok) {
+      printf("rewrite failed (ret=%d count=%d)\n", ret, rd.count);
+      err = 1;
+      ++ecount;
+    }
+    ++count;
+  } while (0);
+
+  // a full parse marks dynamic import() targets just as scanning does
+  do {
+    char input[] = "import a from 'a';\nimport('b').then(() => import(`c`, {}));\n"
+        "function f() { return import('d') + import(e) + import('f' + g) + import(`${h}`); }\n"
+        "class X { y() { import('i'); import.meta; } }\nx.import('j');";
+    int found[2][32];
+    int found_len[2];
+
+    for (externals_scan = 0; externals_scan < 2; ++externals_scan) {
+      externals = input;
+      externals_len = 0;
+      int ret = blep_parser_init(&pd, input, strlen(input));
+      if (ret >= 0) {
+        do {
+          ret = blep_parser_run(&pd);
+        } while (ret > 0);
+      }
+      externals = NULL;
+      found_len[externals_scan] = ret ? -1 : externals_len;
+      memcpy(found[externals_scan], externals_at, sizeof(int) * externals_len);
+    }
+
+    if (found_len[0] != 5 || found_len[0] != found_len[1] ||
+        memcmp(found[0], found[1], sizeof(int) * found_len[0])) {
+      printf("dynamic import failed (full=%d scan=%d)\n", found_len[0], found_len[1]);
+      err = 1;
+      ++ecount;
+    }
+    ++count;
+  } while (0);
+
+  // bindings are placed in the scope they're declared in (or hoisted to), and references resolved
+  do {
+    char input[] = "import a from 'x';\nvar b = a + c;\nfunction d(e) { if (e) { let f = b; var g; } c = g; }\nexport {d};";
+    static int arena[4096];
+    static scopedef sd;
+    blep_scope_init(&sd, input, strlen(input), arena, sizeof(arena));
+    scoping = &sd;
+    int ret = blep_parser_init(&pd, input, strlen(input));
+    if (ret >= 0) {
+      do {
+        ret = blep_parser_run(&pd);
+      } while (ret > 0);
+    }
+    scoping = NULL;
+    ret = ret ? ret : blep_scope_finish(&sd);
+
+    // {name, scope, refs, import/export}
+    struct {
+      const char *name;
+      int scope;
+      int refs;
+      int flags;
+    } expected[] = {
+      {"a", 0, 1, SCOPE__IMPORT},
+      {"b", 0, 1, 0},
+      {"d", 0, 1, SCOPE__EXPORT},
+      {"e", 1, 1, 0},
+      {"f", 4, 0, 0},
+      {"g", 1, 1, 0},
+    };
+    int n = sizeof(expected) / sizeof(expected[0]);
+
+    int ok = !ret && sd.bindings_count == n && sd.scopes_count == 5 && sd.globals_count == 1 &&
+        sd.globals[0].refs == 2 && sd.scopes[4].parent == 3 && sd.scopes[1].kind == SCOPE_KIND_FUNCTION;
+    for (int i = 0; ok && i < n; ++i) {
+      scope_binding *b = sd.bindings + i;
+      ok = b->len == strlen(expected[i].name) && !memcmp(input + b->at, expected[i].name, b->len) &&
+          b->scope == expected[i].scope && b->refs == expected[i].refs &&
+          (b->special & (SCOPE__IMPORT | SCOPE__EXPORT)) == expected[i].flags;
+    }
+    if (!ok) {
+      printf("scope failed (ret=%d bindings=%d scopes=%d)\n", ret, sd.bindings_count, sd.scopes_count);
+      err = 1;
+      ++ecount;
+    }
+    ++count;
+  } while (0);
+
+  // names get hashes as they're lexed and dense ids by their bytes, including after growing
+  do {
+    char input[] = "foo bar.foo + \\u0066oo / baz(foo, bar, qux);";
+    int expected[] = {0, 1, -1, 0, -1, 2, -1, 3, -1, 0, -1, 1, -1, 4};
+    intern_slot small[4], large[16];
+    interndef id;
+    tokendef td;
+    blep_intern_init(&id, input, small, sizeof(small));
+    blep_token_init(&td, input, strlen(input));
+
+    int ok = 1, n = 0;
+    while (ok && blep_token_next(&td) != TOKEN_EOF && n < sizeof(expected) / sizeof(int)) {
+      int ret = blep_intern_token(&id, &(td.curr));
+      if (ret == INTERN__FULL) {
+        blep_intern_grow(&id, large, sizeof(large));
+        ret = blep_intern_token(&id, &(td.curr));
+      }
+      int is_name = td.curr.type == TOKEN_LIT;
+      ok = ret == expected[n++] && (is_name ? td.curr.hash == blep_token_hash(td.curr.p, td.curr.len) : !td.curr.hash);
+    }
+    if (!ok || n != sizeof(expected) / sizeof(int) || id.count != 5) {
+      printf("intern failed (at=%d count=%d)\n", n, id.count);
+      err = 1;
+      ++ecount;
+    }
+    ++count;
+  } while (0);
+
+  // lines and columns are found from offsets, agreeing with line_no (unless it's not counted)
+  do {
+    char input[] = "\nvar x = `a\n\nb`;\n/* long comment\n\n */ foo(1,\n    bar)\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\nqux";
+    int index[32];
+    char *buf = input + 1;  // unaligned
+    int len = strlen(buf);
+    int lines = blep_lines_index(buf, len, index, 32);
+    tokendef td;
+    blep_token_init(&td, buf, len);
+
+    int ok = lines == 24 && blep_lines_index(buf, len, index, 2) == 24 && index[1] == 11;
+    while (ok && blep_token_next(&td) != TOKEN_EOF) {
+      int at = td.curr.p - buf;
+      int line = blep_lines_find(index, lines, at);
+#ifndef BLEP_NO_LINES
+      ok = line + 1 == td.curr.line_no;
+#endif
+      if (td.curr.len == 3 && !memcmp(td.curr.p, "bar", 3)) {
+        ok = ok && line == 6 && at - (index[line - 1] + 1) == 4;
+      }
+    }
+    ok = ok && blep_lines_find(index, lines, 0) == 0 && blep_lines_find(index, lines, 10) == 0 &&
+        blep_lines_find(index, lines, len) == 24;
+    if (!ok) {
+      printf("lines failed (lines=%d)\n", lines);
+      err = 1;
+      ++ecount;
+    }
+    ++count;
+  } while (0);
+
+  // errors are recorded and parsing resumes at the next statement, with every token still emitted
+  do {
+    char input[] = "import * x from \"y\";\nif (x) { for (;;;) {} z(); }\nbar;";
+    recover_error errors[4];
+    recoverdef rd;
+    blep_parser_init(&pd, input, strlen(input));
+    blep_recover_init(&rd, &pd, input, errors, 4);
+    recording = input;
+    emitted_len = 0;
+    balancing = 1;
+    balance = 0;
+
+    int ret, statements = 0;
+    while ((ret = blep_recover_run(&rd)) > 0) {
+      ++statements;
+    }
+    recording = NULL;
+    balancing = 0;
+
+    tokendef td;
+    blep_token_init(&td, input, strlen(input));
+    int ok = ret == 0 && balance == 0 && rd.count == 2, n = 0;
+    while (ok && blep_token_next(&td) != TOKEN_EOF) {
+      ok = n < emitted_len && emitted[n][0] == td.curr.p - input;
+      ++n;
+    }
+    ok = ok && n == emitted_len;
+    ok = ok && errors[0].at == 9 && errors[0].depth == 0 && errors[0].stack == STACK__MODULE &&
+        errors[1].at == 37 && errors[1].depth == 2 && errors[1].stack == STACK__CONTROL;
+    if (!ok) {
+      printf("recover failed (ret=%d balance=%d errors=%d statements=%d)\n", ret, balance, rd.count, statements);
+      err = 1;
+      ++ecount;
+    }
+    ++count;
+  } while (0);
+
   // restate all errors
   render_output = 1;
   testdef *p = &fail;
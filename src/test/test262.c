@@ -14,39 +14,54 @@
  * the License.
  */
 
+// Validates source files, which are mapped rather than read, printing each that fails. Usage:
+//
+//   ./_test262 [file]...
+//
+// With no files, validates stdin instead. Either way, returns nonzero if anything failed.
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "../core/token.h"
-#include "../core/parser.h"
-
-#include "../demo/read.c"
 
-void blep_parser_callback() {
-  // ignore
-}
+// only validates, so needs no callbacks at all
+#define BLEP_PARSER_TOKENS 0
+#define BLEP_PARSER_STACKS 0
+#include "../core/parser-inline.h"
 
-int blep_parser_open(int type) {
-  return 0;
-}
+#include "../demo/read.c"
+#include "../batch/map.h"
 
-void blep_parser_close(int type) {
-  // ignore
-}
+static parserdef pd;
 
-int main() {
-  char *buf;
-  int len = read_stdin(&buf);
-  if (len < 0) {
-    return -1;
-  }
-
-  int ret = blep_parser_init(buf, len);
+static int validate(char *buf, int len) {
+  int ret = blep_parser_init(&pd, buf, len);
   if (ret >= 0) {
     do {
-      ret = blep_parser_run();
+      ret = blep_parser_run(&pd);
     } while (ret > 0);
   }
-
   return ret;
 }
+
+int main(int argc, char **argv) {
+  if (argc == 1) {
+    char *buf;
+    int len = read_stdin(&buf);
+    if (len < 0) {
+      return -1;
+    }
+    return validate(buf, len);
+  }
+
+  int failed = 0;
+  for (int i = 1; i < argc; ++i) {
+    mapped_file m;
+    if (map_file(argv[i], &m) < 0 || validate(m.buf, m.len)) {
+      printf("%s\n", argv[i]);
+      ++failed;
+    }
+    unmap_file(&m);
+  }
+  return failed ? 1 : 0;
+}
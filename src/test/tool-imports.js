@@ -14,9 +14,12 @@
  * the License.
  */
 
-import buildImportsRewriter from '../../src/tool/imports/lib.js';
+import buildImportsRewriter, {buildParallelImportRewriter} from '../../src/tool/imports/lib.js';
 
 import test from 'ava';
+import * as fs from 'fs';
+import * as os from 'os';
+import * as path from 'path';
 
 test.serial('imports rewriter', async (t) => {
   const run = await buildImportsRewriter((f) => {
@@ -34,3 +37,108 @@ test.serial('imports rewriter', async (t) => {
   t.is(out, 'import "lol";');
 });
 
+
+test.serial('imports rewriter scans for dynamic import', async (t) => {
+  const run = await buildImportsRewriter((f) => {
+    return () => 'lol';
+  });
+
+  const {pathname} = new URL('data/imports-dynamic.js', import.meta.url);
+
+  const decoder = new TextDecoder();
+  let out = '';
+  run(pathname, (part) => {
+    out += decoder.decode(part);
+  });
+
+  t.is(out, `function load() {
+  return import("lol").then((m) => m.run(/[)]/));
+}
+class X { y() { import("lol"); } }
+`);
+});
+
+test.serial('imports rewriter cache', async (t) => {
+  let next = 'a';
+  const run = await buildImportsRewriter((f) => {
+    return (importee) => importee === 'x' ? undefined : next;
+  });
+
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'blep-'));
+  const f = path.join(dir, 'cached.js');
+  const read = () => {
+    const decoder = new TextDecoder();
+    let out = '';
+    run(f, (part) => {
+      out += decoder.decode(part);
+    });
+    return out;
+  };
+
+  try {
+    fs.writeFileSync(f, 'import "x";\nimport "y";\nexport * from \'z\';');
+    t.is(read(), 'import "x";\nimport "a";\nexport * from "a";');
+
+    // unchanged, so resolved again without parsing
+    next = 'b';
+    t.is(read(), 'import "x";\nimport "b";\nexport * from "b";');
+
+    // changed size, so parsed again
+    fs.writeFileSync(f, 'import "y"; import "x";');
+    t.is(read(), 'import "b"; import "x";');
+  } finally {
+    fs.rmSync(dir, {recursive: true});
+  }
+});
+
+test.serial('imports rewriter cache size', async (t) => {
+  const run = await buildImportsRewriter((f) => {
+    return (importee) => importee === 'x' ? undefined : 'a';
+  }, {cacheSize: 2});
+
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'blep-'));
+  const [f1, f2, f3] = ['1.js', '2.js', '3.js'].map((f) => path.join(dir, f));
+  const read = (/** @type {string} */ f) => {
+    const decoder = new TextDecoder();
+    let out = '';
+    run(f, (part) => {
+      out += decoder.decode(part);
+    });
+    return out;
+  };
+
+  // same size and mtime, so only a file no longer cached is parsed again
+  const write = (/** @type {string} */ f, /** @type {string} */ source) => {
+    fs.writeFileSync(f, source);
+    fs.utimesSync(f, 1e9, 1e9);
+  };
+
+  try {
+    [f1, f2, f3].forEach((f) => write(f, 'import "y";'));
+    t.is(read(f1), 'import "a";');
+    t.is(read(f2), 'import "a";');
+
+    write(f1, 'import "x";');
+    t.is(read(f1), 'import "a";', 'should still be cached');
+
+    // f1 was used last, so f2 is dropped
+    read(f3);
+    write(f2, 'import "x";');
+    t.is(read(f2), 'import "x";');
+    t.is(read(f1), 'import "x";', 'f2 and f3 are cached, so f1 is dropped');
+  } finally {
+    fs.rmSync(dir, {recursive: true});
+  }
+});
+
+test.serial('parallel imports rewriter', async (t) => {
+  const {href} = new URL('data/resolver.js', import.meta.url);
+  const rewriter = buildParallelImportRewriter(href, {threads: 2});
+
+  const files = ['imports.js', 'imports.js', 'imports.js'].map((f) => new URL(`data/${f}`, import.meta.url).pathname);
+  const out = await Promise.all(files.map((f) => rewriter.run(f)));
+  await rewriter.close();
+
+  const decoder = new TextDecoder();
+  t.deepEqual(out.map((part) => decoder.decode(part)), files.map(() => 'import "lol";'));
+});
@@ -1,6 +1,9 @@
 #!/usr/bin/env node
 
 import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import {execFileSync} from 'child_process';
 const now = new Date;
 const litMaxBits = 10;
 const lengthBits = 4;
@@ -321,6 +324,197 @@ ${space}}\n`;
 }
 
 
+// Finds a minimal perfect hash over candidates, keyed by their first 8 bytes (zero past their
+// length) xor their length in the top byte. The key is multiplied by mul: the top bits pick one of
+// buckets, each with a displacement added to the middle bits, modulo the number of candidates.
+function findPerfectHash(all, buckets=16) {
+  const mask64 = (1n << 64n) - 1n;
+  const head = (s) => {
+    let out = 0n;
+    for (let i = 0; i < Math.min(s.length, 8); ++i) {
+      out |= BigInt(s.charCodeAt(i)) << BigInt(i * 8);
+    }
+    return out ^ (BigInt(s.length) << 56n);
+  };
+  const keys = all.map(head);
+  if (new Set(keys).size !== keys.length) {
+    throw new Error('candidates share a key');
+  }
+
+  // xorshift, seeded so the output is stable
+  let state = 0x9e3779b97f4a7c15n;
+  const random = () => {
+    state ^= (state << 13n) & mask64;
+    state ^= state >> 7n;
+    state ^= (state << 17n) & mask64;
+    return state;
+  };
+
+  for (let attempt = 0; attempt < 10000; ++attempt) {
+    const mul = random() | 1n;
+    const hashed = keys.map((key) => {
+      const h = (key * mul) & mask64;
+      return {bucket: Number(h >> 60n), base: Number((h >> 40n) & 0xfffffn)};
+    });
+
+    const byBucket = Array.from({length: buckets}, () => []);
+    hashed.forEach((h, i) => byBucket[h.bucket].push(i));
+    const order = byBucket.map((_, b) => b).sort((a, b) => byBucket[b].length - byBucket[a].length);
+
+    const slots = new Array(all.length).fill(-1);
+    const disp = new Array(buckets).fill(0);
+    const ok = order.every((b) => {
+      for (let d = 0; d < 256; ++d) {
+        const cand = byBucket[b].map((i) => (hashed[i].base + d) % all.length);
+        if (new Set(cand).size === cand.length && cand.every((slot) => slots[slot] === -1)) {
+          cand.forEach((slot, j) => slots[slot] = byBucket[b][j]);
+          disp[b] = d;
+          return true;
+        }
+      }
+      return false;
+    });
+    if (ok) {
+      return {mul, disp, slots: slots.map((i) => all[i])};
+    }
+  }
+  throw new Error('could not find perfect hash');
+}
+
+
+function renderPerfectHash(all) {
+  const {mul, disp, slots} = findPerfectHash(all);
+  const hex = (s) => '0x' + Array.from(s.padEnd(8, '\0')).reverse()
+      .map((c) => c.charCodeAt(0).toString(16).padStart(2, '0')).join('') + 'ull';
+
+  const rows = slots.map((s) => {
+    const tail = s.length > 8 ? hex(s.substr(s.length - 8)) : '0';
+    const d = `lit_${s}`.toUpperCase();
+    return `  {${hex(s.substr(0, 8))}, ${tail}, ${d}, ${s.length}},  // ${s}\n`;
+  });
+
+  return `#define _LIT_HASH_MUL  0x${mul.toString(16)}ull
+
+static const uint8_t lit_hash_disp[${disp.length}] = {${disp.join(', ')}};
+
+typedef struct {
+  uint64_t head;  // first 8 bytes, zero past length
+  uint64_t tail;  // last 8 bytes, if longer than 8
+  uint32_t out;
+  uint32_t len;
+} lit_hash_entry;
+
+static const lit_hash_entry lit_hash_table[${slots.length}] = {
+${rows.join('')}};
+
+// high bit of each byte which is 'a'-'z'
+static inline uint64_t lit_lower(uint64_t w) {
+  uint64_t h = w & 0x7f7f7f7f7f7f7f7full;
+  return (h + 0x1f1f1f1f1f1f1f1full) & ~(h + 0x0505050505050505ull) & ~w & 0x8080808080808080ull;
+}
+
+int consume_known_lit(char *p, uint32_t *out) {
+  // loads read 16 bytes, which is only safe if they don't cross a page (see simd.h)
+  if (((uintptr_t) p & 4095) > 4096 - 16) {
+    return consume_known_lit_trie(p, out);
+  }
+  uint64_t w, next;
+  memcpy(&w, p, 8);
+  memcpy(&next, p + 8, 8);
+
+  // length of the run of 'a'-'z', up to 15
+  uint64_t stop = ~lit_lower(w) & 0x8080808080808080ull;
+  uint64_t stop_next = (~lit_lower(next) & 0x8080808080808080ull) | 0x8000000000000000ull;
+  int len = stop ? __builtin_ctzll(stop) >> 3 : 8 + (__builtin_ctzll(stop_next) >> 3);
+
+  uint64_t head = len < 8 ? w & ((1ull << (len * 8)) - 1) : w;
+  uint64_t tail = 0;
+  if (len > 8) {
+    memcpy(&tail, p + len - 8, 8);
+  }
+
+  uint64_t h = (head ^ ((uint64_t) len << 56)) * _LIT_HASH_MUL;
+  uint32_t slot = ((uint32_t) (h >> 40) & 0xfffff) + lit_hash_disp[h >> 60];
+  const lit_hash_entry *e = &lit_hash_table[slot % ${slots.length}];
+
+  if (e->len == len && e->head == head && e->tail == tail) {
+    *out = e->out;
+  }
+  return len;
+}
+`;
+}
+
+// identifiers which aren't keywords, to time alongside them: most lits in real code aren't
+const plainWords =
+    " a b e i n t x el fn id cb err key map obj ref src val args data item list node prop self" +
+    " value index event props state length result options element callback document window" +
+    " prototype exports require module constructor toString addEventListener ";
+
+
+// Times consume_known_lit from the helper.c just written, built as the trie (-DLIT_TRIE) and as
+// the perfect hash (-DLIT_HASH), over a fixed mix of plainWords and candidates. Returns the time
+// of each in ns per word, or null if there's no C compiler ($CC, or "cc") to build with.
+function benchLit(all) {
+  const words = [...all, ...plainWords.split(/\s+/).filter(Boolean)];
+  let seed = 1;
+  const mix = Array.from({length: 4096}, () => {
+    seed = (seed * 1103515245 + 12345) % 2147483648;
+    return words[seed % words.length];
+  });
+
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'lit-'));
+  const driver = path.join(dir, 'bench.c');
+  fs.writeFileSync(driver, `#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "${path.resolve('helper.c')}"
+
+static char buf[${mix.join(' ').length + 1 + 16}] __attribute__((aligned(16))) = ${JSON.stringify(mix.join(' '))};
+
+int main() {
+  uint32_t sum = 0;
+  double best = 0;
+  for (int round = 0; round < 5; ++round) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int rep = 0; rep < 200; ++rep) {
+      for (char *p = buf; *p; ++p) {
+        uint32_t out = 0;
+        consume_known_lit(p, &out);
+        sum += out;
+        while (*p && *p != ' ') {
+          ++p;
+        }
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    if (!round || ns < best) {
+      best = ns;
+    }
+  }
+  printf("%f %u\\n", best / (200.0 * ${mix.length}), sum);
+  return 0;
+}
+`);
+
+  const run = (flag) => {
+    const out = path.join(dir, flag);
+    execFileSync(process.env.CC || 'cc', ['-O2', flag, driver, '-o', out], {stdio: 'ignore'});
+    return Number(execFileSync(out, {encoding: 'utf-8'}).split(' ')[0]);
+  };
+
+  try {
+    return {trie: run('-DLIT_TRIE'), hash: run('-DLIT_HASH')};
+  } catch (e) {
+    return null;
+  } finally {
+    fs.rmSync(dir, {recursive: true, force: true});
+  }
+}
+
+
 function renderSpecial(specials, js=false) {
   const lines = specials.map((name, i) => {
     const upper = name.replace(/[A-Z]/g, (letter) => `_${letter}`).toUpperCase();
@@ -334,26 +528,59 @@ function renderSpecial(specials, js=false) {
 }
 
 
-function main() {
-  const helperOutput = `// Generated on ${now}
+// Writes the file, unless only its "Generated on" line would change.
+function writeGenerated(file, body) {
+  let prev = '';
+  try {
+    prev = fs.readFileSync(file, 'utf-8');
+  } catch (e) {
+    // doesn't exist yet
+  }
+  if (prev.substr(prev.indexOf('\n') + 1) !== body) {
+    fs.writeFileSync(file, `// Generated on ${now}\n${body}`);
+  }
+}
+
 
+function renderHelper(useTrie) {
+  const choice = useTrie ? `
+#ifndef LIT_HASH
+#define LIT_TRIE
+#endif
+` : '';
+
+  return `
 #include "lit.h"
 #include "helper.h"
+#include <string.h>
 
 // ${litOnly.length} candidates:
 //   ${litOnly.join(' ')}
-int consume_known_lit(char *p, uint32_t *out) {
+static int consume_known_lit_trie(char *p, uint32_t *out) {
   char *start = p;
 #define _done(len, _out) {*out=_out;return len;}
 ${renderChoice(litOnly, '  ')}
 #undef _done
 }
-`;
-  fs.writeFileSync('helper.c', helperOutput);
 
+// build.js times this trie against a perfect hash of the same, and uses the faster unless built
+// with -DLIT_TRIE or -DLIT_HASH. The hash reads 16 bytes from p, so isn't used with -DSCALAR.
+${choice}#if defined(LIT_TRIE) || defined(SCALAR) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
 
-  const helperHeaderOutput = `// Generated on ${now}
+int consume_known_lit(char *p, uint32_t *out) {
+  return consume_known_lit_trie(p, out);
+}
+
+#else
+
+${renderPerfectHash(litOnly)}
+#endif
+`;
+}
 
+
+function main() {
+  const helperHeaderOutput = `
 #ifndef _HELPER_H
 #define _HELPER_H
 
@@ -363,11 +590,10 @@ int consume_known_lit(char *, uint32_t *);
 
 #endif//_HELPER_H
 `;
-  fs.writeFileSync('helper.h', helperHeaderOutput);
+  writeGenerated('helper.h', helperHeaderOutput);
 
 
-  const litOutput = `// Generated on ${now}
-
+  const litOutput = `
 #ifndef _LIT_H
 #define _LIT_H
 
@@ -376,16 +602,31 @@ ${renderDefines(litOnly, 'lit_')}
 ${renderDefines(extraDefines, 'misc_')}
 #endif//_LIT_H
 `;
-  fs.writeFileSync('lit.h', litOutput);
-
+  writeGenerated('lit.h', litOutput);
 
-  const litJSOutput = `// Generated on ${now}
 
+  const litJSOutput = `
 ${renderSpecial(specials, true)}
 ${renderDefines(litOnly, '', true)}
 ${renderDefines(extraDefines, '$', true)}
 `;
-  fs.writeFileSync('lit.js', litJSOutput);
+  writeGenerated('lit.js', litJSOutput);
+
+
+  // time both from a scratch helper.c, then put back the old one to compare against; the trie must
+  // be clearly faster to be used, so that noise doesn't flip the output
+  const helperPrev = fs.existsSync('helper.c') ? fs.readFileSync('helper.c', 'utf-8') : '';
+  fs.writeFileSync('helper.c', renderHelper(false));
+  const timing = benchLit(litOnly);
+  const useTrie = timing !== null && timing.trie < timing.hash * 0.9;
+  if (timing === null) {
+    console.warn('no C compiler to time consume_known_lit, using the perfect hash');
+  } else {
+    console.warn(`consume_known_lit: trie ${timing.trie.toFixed(2)}ns, hash ${timing.hash.toFixed(2)}ns per word`);
+  }
+  const helperBody = renderHelper(useTrie);
+  fs.writeFileSync('helper.c', helperPrev);
+  writeGenerated('helper.c', helperBody);
 }
 
 main();
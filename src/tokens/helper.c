@@ -1,11 +1,12 @@
-// Generated on Sat Jan 30 2021 16:04:39 GMT+1100 (Australian Eastern Daylight Time)
+// Generated on Wed Oct 14 2026 14:31:19 GMT+0000 (Coordinated Universal Time)
 
 #include "lit.h"
 #include "helper.h"
+#include <string.h>
 
 // 53 candidates:
 //   as async await break case catch class const continue debugger default delete do else enum export extends false finally for from function get if implements import in instanceof interface let new null of package private protected public return set static super switch this throw true try typeof undefined var void while with yield
-int consume_known_lit(char *p, uint32_t *out) {
+static int consume_known_lit_trie(char *p, uint32_t *out) {
   char *start = p;
 #define _done(len, _out) {*out=_out;return len;}
   switch (*p++) {
@@ -354,3 +355,118 @@ int consume_known_lit(char *p, uint32_t *out) {
 
 #undef _done
 }
+
+// build.js times this trie against a perfect hash of the same, and uses the faster unless built
+// with -DLIT_TRIE or -DLIT_HASH. The hash reads 16 bytes from p, so isn't used with -DSCALAR.
+#if defined(LIT_TRIE) || defined(SCALAR) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+
+int consume_known_lit(char *p, uint32_t *out) {
+  return consume_known_lit_trie(p, out);
+}
+
+#else
+
+#define _LIT_HASH_MUL  0xd0981e8c1fa7be5ull
+
+static const uint8_t lit_hash_disp[16] = {18, 2, 0, 23, 49, 33, 0, 6, 39, 23, 49, 23, 10, 2, 46, 19};
+
+typedef struct {
+  uint64_t head;  // first 8 bytes, zero past length
+  uint64_t tail;  // last 8 bytes, if longer than 8
+  uint32_t out;
+  uint32_t len;
+} lit_hash_entry;
+
+static const lit_hash_entry lit_hash_table[53] = {
+  {0x0000686374697773ull, 0, LIT_SWITCH, 6},  // switch
+  {0x0000636974617473ull, 0, LIT_STATIC, 6},  // static
+  {0x6e656d656c706d69ull, 0x73746e656d656c70ull, LIT_IMPLEMENTS, 10},  // implements
+  {0x000000656c696877ull, 0, LIT_WHILE, 5},  // while
+  {0x00006e7275746572ull, 0, LIT_RETURN, 6},  // return
+  {0x0000007373616c63ull, 0, LIT_CLASS, 5},  // class
+  {0x0000007469617761ull, 0, LIT_AWAIT, 5},  // await
+  {0x65756e69746e6f63ull, 0, LIT_CONTINUE, 8},  // continue
+  {0x0000000065736163ull, 0, LIT_CASE, 4},  // case
+  {0x0000000068746977ull, 0, LIT_WITH, 4},  // with
+  {0x000000000077656eull, 0, LIT_NEW, 3},  // new
+  {0x0000000000797274ull, 0, LIT_TRY, 3},  // try
+  {0x000063696c627570ull, 0, LIT_PUBLIC, 6},  // public
+  {0x000000006c6c756eull, 0, LIT_NULL, 4},  // null
+  {0x65636e6174736e69ull, 0x666f65636e617473ull, LIT_INSTANCEOF, 10},  // instanceof
+  {0x0000000065757274ull, 0, LIT_TRUE, 4},  // true
+  {0x000000006d6f7266ull, 0, LIT_FROM, 4},  // from
+  {0x0000006b61657262ull, 0, LIT_BREAK, 5},  // break
+  {0x000000000074656cull, 0, LIT_LET, 3},  // let
+  {0x0000000064696f76ull, 0, LIT_VOID, 4},  // void
+  {0x00006574656c6564ull, 0, LIT_DELETE, 6},  // delete
+  {0x0000000000006f64ull, 0, LIT_DO, 2},  // do
+  {0x000074726f707865ull, 0, LIT_EXPORT, 6},  // export
+  {0x6e6f6974636e7566ull, 0, LIT_FUNCTION, 8},  // function
+  {0x0000000000007361ull, 0, LIT_AS, 2},  // as
+  {0x000000006d756e65ull, 0, LIT_ENUM, 4},  // enum
+  {0x0073646e65747865ull, 0, LIT_EXTENDS, 7},  // extends
+  {0x7265676775626564ull, 0, LIT_DEBUGGER, 8},  // debugger
+  {0x0000666f65707974ull, 0, LIT_TYPEOF, 6},  // typeof
+  {0x6361667265746e69ull, 0x656361667265746eull, LIT_INTERFACE, 9},  // interface
+  {0x00796c6c616e6966ull, 0, LIT_FINALLY, 7},  // finally
+  {0x000000646c656979ull, 0, LIT_YIELD, 5},  // yield
+  {0x0000000000006669ull, 0, LIT_IF, 2},  // if
+  {0x000000636e797361ull, 0, LIT_ASYNC, 5},  // async
+  {0x0000000065736c65ull, 0, LIT_ELSE, 4},  // else
+  {0x000000000000666full, 0, LIT_OF, 2},  // of
+  {0x00746c7561666564ull, 0, LIT_DEFAULT, 7},  // default
+  {0x65746365746f7270ull, 0x6465746365746f72ull, LIT_PROTECTED, 9},  // protected
+  {0x0065746176697270ull, 0, LIT_PRIVATE, 7},  // private
+  {0x0000000000746567ull, 0, LIT_GET, 3},  // get
+  {0x0000007265707573ull, 0, LIT_SUPER, 5},  // super
+  {0x656e696665646e75ull, 0x64656e696665646eull, LIT_UNDEFINED, 9},  // undefined
+  {0x0000000000726176ull, 0, LIT_VAR, 3},  // var
+  {0x0000000000726f66ull, 0, LIT_FOR, 3},  // for
+  {0x0000000000006e69ull, 0, LIT_IN, 2},  // in
+  {0x000074726f706d69ull, 0, LIT_IMPORT, 6},  // import
+  {0x000000776f726874ull, 0, LIT_THROW, 5},  // throw
+  {0x00000065736c6166ull, 0, LIT_FALSE, 5},  // false
+  {0x006567616b636170ull, 0, LIT_PACKAGE, 7},  // package
+  {0x00000074736e6f63ull, 0, LIT_CONST, 5},  // const
+  {0x0000006863746163ull, 0, LIT_CATCH, 5},  // catch
+  {0x0000000000746573ull, 0, LIT_SET, 3},  // set
+  {0x0000000073696874ull, 0, LIT_THIS, 4},  // this
+};
+
+// high bit of each byte which is 'a'-'z'
+static inline uint64_t lit_lower(uint64_t w) {
+  uint64_t h = w & 0x7f7f7f7f7f7f7f7full;
+  return (h + 0x1f1f1f1f1f1f1f1full) & ~(h + 0x0505050505050505ull) & ~w & 0x8080808080808080ull;
+}
+
+int consume_known_lit(char *p, uint32_t *out) {
+  // loads read 16 bytes, which is only safe if they don't cross a page (see simd.h)
+  if (((uintptr_t) p & 4095) > 4096 - 16) {
+    return consume_known_lit_trie(p, out);
+  }
+  uint64_t w, next;
+  memcpy(&w, p, 8);
+  memcpy(&next, p + 8, 8);
+
+  // length of the run of 'a'-'z', up to 15
+  uint64_t stop = ~lit_lower(w) & 0x8080808080808080ull;
+  uint64_t stop_next = (~lit_lower(next) & 0x8080808080808080ull) | 0x8000000000000000ull;
+  int len = stop ? __builtin_ctzll(stop) >> 3 : 8 + (__builtin_ctzll(stop_next) >> 3);
+
+  uint64_t head = len < 8 ? w & ((1ull << (len * 8)) - 1) : w;
+  uint64_t tail = 0;
+  if (len > 8) {
+    memcpy(&tail, p + len - 8, 8);
+  }
+
+  uint64_t h = (head ^ ((uint64_t) len << 56)) * _LIT_HASH_MUL;
+  uint32_t slot = ((uint32_t) (h >> 40) & 0xfffff) + lit_hash_disp[h >> 60];
+  const lit_hash_entry *e = &lit_hash_table[slot % 53];
+
+  if (e->len == len && e->head == head && e->tail == tail) {
+    *out = e->out;
+  }
+  return len;
+}
+
+#endif
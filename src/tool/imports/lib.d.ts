@@ -18,8 +18,33 @@
  * Builds a method which rewrites imports from a passed filename into ESM found inside node_modules.
  * Requires a helper which builds a resolver for files.
  *
- * This emits relative paths to node_modules, rather than absolute ones.
+ * This emits relative paths to node_modules, rather than absolute ones. Dynamic `import("...")`
+ * with a plain string is rewritten too.
+ *
+ * If writev is passed, it's called once per file with every part instead of calling write. These
+ * may be views of harness memory, so are only valid during that call.
+ *
+ * Unless cache is false, what's found in each file is kept until it changes, for up to cacheSize
+ * files (by default 4096), dropping the least recently used.
  */
 export default function buildModuleImportRewriter(
   buildResolver: (importer: string) => ((importee: string) => string|undefined),
-): Promise<(file: string, write: (part: Uint8Array) => void) => void>;
+  options?: {cache?: boolean, cacheSize?: number},
+): Promise<(
+  file: string,
+  write: (part: Uint8Array) => void,
+  writev?: (parts: Uint8Array[]) => void,
+) => void>;
+
+/**
+ * Runs buildModuleImportRewriter across worker threads (by default, one per core). Resolvers are
+ * built inside workers, so this is passed the specifier or URL of a module whose default export
+ * builds them.
+ */
+export function buildParallelImportRewriter(
+  resolver: string,
+  options?: {threads?: number},
+): {
+  run(file: string): Promise<Uint8Array>,
+  close(): Promise<void>,
+};
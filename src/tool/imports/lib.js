@@ -15,6 +15,9 @@
  */
 
 import * as common from '../../harness/common.js';
+import * as fs from 'fs';
+import * as os from 'os';
+import {Worker} from 'worker_threads';
 import buildHarness from '../../harness/node-harness.js';
 import rewriter from '../../harness/node-rewriter.js';
 
@@ -23,24 +26,107 @@ import rewriter from '../../harness/node-rewriter.js';
 const allowAllStack = false;
 
 /**
- * @type {(stack: number) => boolean}
+ * Everything but imports and exports is scanned, which skims over function and class bodies. This
+ * still finds dynamic `import("...")` targets, which are rewritten too.
+ *
+ * @type {(stack: number) => boolean|'scan'}
+ */
+const stack = allowAllStack ? () => true : (type) => type === common.stacks.module || 'scan';
+
+const CACHED_SIZE_MAX = 1024 * 1024 * 16;  // larger files are read in chunks, so aren't cached
+const CACHE_ENTRIES_MAX = 4096;  // by default, see buildModuleImportRewriter
+const encoder = new TextEncoder();
+
+/**
+ * What was found in a file the last time it was parsed. Resolution can change even if the file
+ * doesn't, so only the external strings are kept: a hit resolves them again and splices.
+ *
+ * @typedef {{
+ *   mtimeMs: number,
+ *   size: number,
+ *   spans: Int32Array,
+ *   values: (string|undefined)[],
+ * }}
+ * CacheEntry
  */
-const stack = allowAllStack ? () => true : (type) => type === common.stacks.module;
 
 /**
  * Builds a method which rewrites imports from a passed filename into ESM found inside node_modules.
  *
- * This emits relative paths to node_modules, rather than absolute ones.
+ * This emits relative paths to node_modules, rather than absolute ones. If writev is passed, it's
+ * called once with all parts (which may be views of harness memory) instead of calling write.
+ *
+ * Unless cache is false, the external strings found in each file are kept by path, and reused
+ * while its mtime and size are unchanged, so it's only read again (not parsed) to be spliced. Up to
+ * cacheSize files are kept, dropping the least recently used.
  *
  * @param {(importer: string) => (importee: string) => string|undefined} buildResolver
- * @return {Promise<(file: string, write: (part: Uint8Array) => void) => void>}
+ * @param {{cache?: boolean, cacheSize?: number}=} options
+ * @return {Promise<(file: string, write: (part: Uint8Array) => void, writev?: (parts: Uint8Array[]) => void) => void>}
  */
-export default async function buildModuleImportRewriter(buildResolver) {
+export default async function buildModuleImportRewriter(
+    buildResolver, {cache = true, cacheSize = CACHE_ENTRIES_MAX} = {}) {
   const harness = await buildHarness();
-  const {token, run} = rewriter(harness);
+  const {token, run, rewrite} = rewriter(harness);
+
+  /** @type {Map<string, CacheEntry>} in order of use, oldest first */
+  const entries = new Map();
 
-  return (f, write) => {
+  return (f, write, writev) => {
     const resolver = buildResolver(f);
+
+    if (!allowAllStack) {
+      // find every import in C, then resolve them all at once
+      /** @type {(values: (string|undefined)[]) => (string|undefined)[]} */
+      const resolve = (values) => values.map((value) => {
+        const out = value === undefined ? undefined : resolver(value);
+        return out && typeof out === 'string' ? out : undefined;
+      });
+      if (!cache) {
+        return rewrite(f, resolve, {write, writev});
+      }
+
+      const fd = fs.openSync(f, 'r');
+      try {
+        const {mtimeMs, size} = fs.fstatSync(fd);
+        const entry = entries.get(f);
+        entries.delete(f);
+        if (entry && entry.mtimeMs === mtimeMs && entry.size === size) {
+          entries.set(f, entry);
+          return splice(fs.readFileSync(fd), entry, resolve(entry.values), write, writev);
+        } else if (size > CACHED_SIZE_MAX) {
+          return rewrite(f, resolve, {write, writev});
+        }
+
+        const buffer = harness.prepare(size);
+        const read = fs.readSync(fd, buffer, 0, size, 0);
+        if (read !== size) {
+          throw new Error(`did not read all bytes at once: ${read}/${size}`);
+        }
+
+        /** @type {(string|undefined)[]} */
+        let values = [];
+        /** @type {(number|string|Uint8Array|undefined)[]} */
+        const edits = [];
+        const out = harness.runRewrite((v) => resolve(values = v), edits);
+
+        const spans = new Int32Array(edits.length / 3 * 2);
+        for (let i = 0; i < spans.length; i += 2) {
+          spans[i] = /** @type {number} */ (edits[i / 2 * 3]);
+          spans[i + 1] = /** @type {number} */ (edits[i / 2 * 3 + 1]);
+        }
+        entries.set(f, {mtimeMs, size, spans, values});
+        if (entries.size > cacheSize) {
+          entries.delete(entries.keys().next().value);
+        }
+
+        writev ? writev([out]) : write(out);
+        return;
+      } finally {
+        fs.closeSync(fd);
+      }
+    }
+
     const callback = () => {
       if (!(token.special() === common.specials.external && token.type() === common.types.string)) {
         return;
@@ -50,6 +136,99 @@ export default async function buildModuleImportRewriter(buildResolver) {
         return JSON.stringify(out);
       }
     };
-    return run(f, {callback, stack, write});
+    return run(f, {callback, stack, write, writev});
+  };
+}
+
+/**
+ * Writes source with its external strings replaced by those values that changed, as the harness's
+ * runRewrite() would.
+ *
+ * @param {Uint8Array} source
+ * @param {CacheEntry} entry
+ * @param {(string|undefined)[]} resolved
+ * @param {(part: Uint8Array) => void} write
+ * @param {((parts: Uint8Array[]) => void)=} writev
+ */
+function splice(source, {spans, values}, resolved, write, writev) {
+  /** @type {Uint8Array[]} */
+  const parts = [];
+  let sent = 0;
+  resolved.forEach((value, i) => {
+    if (typeof value !== 'string' || value === values[i]) {
+      return;
+    }
+    parts.push(source.subarray(sent, spans[i * 2]), encoder.encode(JSON.stringify(value)));
+    sent = spans[i * 2 + 1];
+  });
+  parts.push(source.subarray(sent));
+
+  if (writev) {
+    writev(parts);
+  } else {
+    parts.forEach((part) => part.length && write(part));
+  }
+}
+
+/**
+ * Builds a rewriter which runs buildModuleImportRewriter across worker threads, each with its own
+ * harness. As resolvers are built inside workers, this is passed the specifier or URL of a module
+ * whose default export builds them (e.g., "esm-resolve").
+ *
+ * @param {string} resolver
+ * @param {{threads?: number}=} options
+ * @return {{run(file: string): Promise<Uint8Array>, close(): Promise<void>}}
+ */
+export function buildParallelImportRewriter(resolver, {threads = os.cpus().length} = {}) {
+  const workerURL = new URL('./worker.js', import.meta.url);
+
+  let nextId = 0;
+
+  const workers = [...Array(Math.max(1, threads))].map(() => {
+    const worker = new Worker(workerURL, {workerData: {resolver}});
+
+    /** @type {Map<number, {resolve(out: Uint8Array): void, reject(error: any): void}>} */
+    const tasks = new Map();
+    const state = {worker, tasks, failed: /** @type {any} */ (undefined)};
+
+    worker.on('message', ({id, out, error}) => {
+      const task = tasks.get(id);
+      tasks.delete(id);
+      tasks.size || worker.unref();
+      error === undefined ? task?.resolve(out) : task?.reject(error);
+    });
+    worker.on('error', (error) => {
+      // the worker has exited, so fail whatever it was given
+      state.failed = error;
+      for (const task of tasks.values()) {
+        task.reject(error);
+      }
+      tasks.clear();
+    });
+
+    worker.unref();
+    return state;
+  });
+
+  return {
+    run(file) {
+      const live = workers.filter(({failed}) => failed === undefined);
+      if (!live.length) {
+        return Promise.reject(workers[0].failed);
+      }
+      const state = live.reduce((best, state) => state.tasks.size < best.tasks.size ? state : best);
+
+      const id = ++nextId;
+      return new Promise((resolve, reject) => {
+        // idle workers don't keep the process alive
+        state.tasks.set(id, {resolve, reject});
+        state.worker.ref();
+        state.worker.postMessage({id, file});
+      });
+    },
+
+    async close() {
+      await Promise.all(workers.map(({worker}) => worker.terminate()));
+    },
   };
 }
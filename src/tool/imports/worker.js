@@ -0,0 +1,50 @@
+/*
+ * Copyright 2021 Sam Thorogood.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @fileoverview Worker for buildParallelImportRewriter. Imports the module named by
+ * `workerData.resolver` for its default export, which must build resolvers as passed to
+ * buildModuleImportRewriter, and rewrites files posted as `{id, file}`.
+ */
+
+import {parentPort, workerData} from 'worker_threads';
+import buildModuleImportRewriter from './lib.js';
+
+const {default: buildResolver} = await import(workerData.resolver);
+const run = await buildModuleImportRewriter(buildResolver);
+
+parentPort?.on('message', ({id, file}) => {
+  /** @type {Uint8Array=} */
+  let out;
+
+  try {
+    run(file, () => {}, (parts) => {
+      // parts may be views of harness memory, which the next file reuses
+      out = new Uint8Array(parts.reduce((length, part) => length + part.length, 0));
+      let at = 0;
+      for (const part of parts) {
+        out.set(part, at);
+        at += part.length;
+      }
+    });
+  } catch (error) {
+    parentPort?.postMessage({id, error});
+    return;
+  }
+
+  out ??= new Uint8Array(0);
+  parentPort?.postMessage({id, out}, [out.buffer]);
+});